@@ -0,0 +1,333 @@
+/*
+    * bench.cpp
+    * This source file is the benchmark suite for the simulation hot paths. It times single trials,
+    * the mortgage formula, random draws, both batch kernels at several thread counts and merging
+    * the batch accumulators, prints a table and can write the results as JSON or compare them to
+    * a saved baseline.
+    *
+    *   bench [--quick] [--trials N] [--json FILE] [--baseline FILE] [--threshold FRACTION]
+    *
+    * Contributors: Kade Miller
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../src/batch.h"
+#include "../src/simulation.h"
+#include "../src/stats.h"
+
+namespace {
+
+struct benchResult
+{
+    std::string name;
+    double value;
+    std::string unit;
+    bool higherIsBetter;
+};
+
+struct benchOptions
+{
+    double minSeconds = 0.5; // each measurement repeats until it has run this long
+    long long trials = 200000;
+    std::string jsonPath;
+    std::string baselinePath;
+    double threshold = 0.10; // slowdown against the baseline reported as a regression
+};
+
+// Keeps results alive so the optimizer can't drop the work being timed.
+volatile double sink;
+
+double now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Calls run(n) with growing n until one call takes minSeconds and returns seconds per unit of n.
+template <class F>
+double secondsPer(double minSeconds, F run)
+{
+    long long n = 1;
+    while (true) {
+        double start = now();
+        run(n);
+        double elapsed = now() - start;
+        if (elapsed >= minSeconds)
+            return elapsed / n;
+        n = elapsed > 0 ? std::max(n * 2, (long long)(n * minSeconds / elapsed * 1.2)) : n * 10;
+    }
+}
+
+void benchSingleTrial(const benchOptions& options, const simulationParams& params, std::vector<benchResult>& out)
+{
+    scenarioSchedule schedule = buildSchedule(params);
+    long long trial = 0;
+    double monthsPerTrial = 0;
+    double perTrial = secondsPer(options.minSeconds, [&](long long n) {
+        long long months = 0;
+        for (long long i = 0; i < n; i++) {
+            RandomStream rng(1, trial++);
+            trialResult r = simulateTrial(params, schedule, rng);
+            months += r.monthsSimulated;
+            sink = r.finalNetWorth;
+        }
+        monthsPerTrial = (double)months / n;
+    });
+    out.push_back({"single_trial_paths_per_sec", 1.0 / perTrial, "paths/s", true});
+    out.push_back({"single_trial_ns_per_month", perTrial / monthsPerTrial * 1e9, "ns", false});
+}
+
+void benchMortgage(const benchOptions& options, std::vector<benchResult>& out)
+{
+    double perCall = secondsPer(options.minSeconds, [](long long n) {
+        double total = 0;
+        for (long long i = 0; i < n; i++)
+            total += calculateMonthlyMortgage(480000 + (i & 1023), 5.0, 30);
+        sink = total;
+    });
+    out.push_back({"mortgage_payment_ns", perCall * 1e9, "ns", false});
+
+    double perLookup = secondsPer(options.minSeconds, [](long long n) {
+        double total = 0;
+        for (long long i = 0; i < n; i++)
+            total += amortizationSchedule(480000, 5.0, 30)->rows[i % 360].principal;
+        sink = total;
+    });
+    out.push_back({"amortization_lookup_ns", perLookup * 1e9, "ns", false});
+}
+
+void benchRandom(const benchOptions& options, std::vector<benchResult>& out)
+{
+    double perDraw = secondsPer(options.minSeconds, [](long long n) {
+        RandomStream rng(1, 0);
+        double total = 0;
+        for (long long i = 0; i < n; i++)
+            total += rng.uniform();
+        sink = total;
+    });
+    out.push_back({"rng_uniform_per_sec", 1.0 / perDraw, "draws/s", true});
+
+    double perFilled = secondsPer(options.minSeconds, [](long long n) {
+        RandomStream rng(1, 0);
+        double block[DRAWS_PER_MONTH * 64];
+        const long long size = DRAWS_PER_MONTH * 64;
+        double total = 0;
+        for (long long done = 0; done < n; done += size) {
+            rng.fillUniform(block, size);
+            total += block[0];
+        }
+        sink = total;
+    });
+    out.push_back({"rng_fill_per_sec", 1.0 / perFilled, "draws/s", true});
+}
+
+void benchBatch(const benchOptions& options, const simulationParams& params, std::vector<benchResult>& out)
+{
+    std::vector<int> threadCounts;
+    int hardware = std::max(1, (int)std::thread::hardware_concurrency());
+    for (int t = 1; t < hardware; t *= 2)
+        threadCounts.push_back(t);
+    threadCounts.push_back(hardware);
+
+    const int months = simulatedMonths(params);
+    for (batchKernel kernel : {KERNEL_SCALAR, KERNEL_SIMD}) {
+        const char* name = kernel == KERNEL_SIMD ? "simd" : "scalar";
+        for (int threads : threadCounts) {
+            ThreadPool pool(threads);
+            batchOptions batch;
+            batch.trials = options.trials;
+            batch.kernel = kernel;
+            batch.pool = &pool;
+            batchResults results = runBatch(params, batch);
+            sink = results.meanNetWorth;
+
+            std::string prefix = std::string("batch_") + name + "_t" + std::to_string(threads);
+            out.push_back({prefix + "_paths_per_sec", results.trialsPerSecond, "paths/s", true});
+            // Per thread and per month of a full path; bankrupt paths stop early, so a month that
+            // is actually simulated costs somewhat more.
+            out.push_back({prefix + "_ns_per_month", 1e9 / (results.trialsPerSecond * months) * threads, "ns", false});
+        }
+    }
+}
+
+void benchMerge(const benchOptions& options, std::vector<benchResult>& out)
+{
+    // Typical worker accumulators: final net worth spread over a few thousand sketch buckets.
+    std::vector<metricStats> workers(8);
+    RandomStream rng(1, 0);
+    for (metricStats& w : workers) {
+        for (int i = 0; i < 20000; i++)
+            w.add((rng.uniform() - 0.1) * 4e6);
+    }
+
+    double perMerge = secondsPer(options.minSeconds, [&](long long n) {
+        for (long long i = 0; i < n; i++) {
+            metricStats merged;
+            merged.merge(workers[i % workers.size()]);
+            merged.merge(workers[(i + 1) % workers.size()]);
+            sink = merged.moments.mean;
+        }
+    });
+    out.push_back({"stats_merge_us", perMerge / 2 * 1e6, "us", false});
+
+    double perAdd = secondsPer(options.minSeconds, [&](long long n) {
+        metricStats stats;
+        for (long long i = 0; i < n; i++)
+            stats.add((double)(i & 65535) * 61.0 - 1e6);
+        sink = stats.moments.mean;
+    });
+    out.push_back({"stats_add_ns", perAdd * 1e9, "ns", false});
+}
+
+std::string jsonEscape(const std::string& text)
+{
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+bool writeJSON(const std::vector<benchResult>& results, const std::string& path)
+{
+    std::ofstream out(path);
+    out << std::setprecision(10);
+    out << "{\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const benchResult& r = results[i];
+        out << "    {\"name\": \"" << jsonEscape(r.name) << "\", \"value\": " << r.value
+            << ", \"unit\": \"" << jsonEscape(r.unit) << "\", \"higherIsBetter\": "
+            << (r.higherIsBetter ? "true" : "false") << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return (bool)out;
+}
+
+// Reads the name/value pairs back out of a file written by writeJSON.
+bool readJSON(const std::string& path, std::vector<benchResult>& results)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    std::string text = buffer.str();
+
+    size_t at = 0;
+    while ((at = text.find("\"name\": \"", at)) != std::string::npos) {
+        at += 9;
+        size_t end = text.find('"', at);
+        size_t value = text.find("\"value\": ", end);
+        if (end == std::string::npos || value == std::string::npos)
+            return false;
+        benchResult r;
+        r.name = text.substr(at, end - at);
+        r.value = std::stod(text.substr(value + 9));
+        r.higherIsBetter = text.compare(text.find("\"higherIsBetter\": ", value) + 18, 4, "true") == 0;
+        results.push_back(r);
+        at = value;
+    }
+    return !results.empty();
+}
+
+// Prints every result next to its baseline. Returns the number of regressions.
+int compareBaseline(const std::vector<benchResult>& results, const std::vector<benchResult>& baseline,
+                    double threshold)
+{
+    int regressions = 0;
+    std::cout << "--------------------------------" << std::endl;
+    std::cout << "Against baseline (regression beyond " << threshold * 100.0 << "%):" << std::endl;
+    for (const benchResult& r : results) {
+        auto match = std::find_if(baseline.begin(), baseline.end(),
+                                  [&](const benchResult& b) { return b.name == r.name; });
+        if (match == baseline.end() || match->value <= 0)
+            continue;
+
+        // Positive change is always an improvement.
+        double change = r.higherIsBetter ? r.value / match->value - 1.0 : match->value / r.value - 1.0;
+        bool regressed = change < -threshold;
+        regressions += regressed;
+        std::cout << "  " << std::left << std::setw(34) << r.name << std::right << std::setw(8)
+                  << std::showpos << change * 100.0 << std::noshowpos << "%" << (regressed ? "  REGRESSION" : "")
+                  << std::endl;
+    }
+    std::cout << "--------------------------------" << std::endl;
+    return regressions;
+}
+
+void printUsage()
+{
+    std::cout << "Usage: bench [--quick] [--trials N] [--json FILE] [--baseline FILE] [--threshold F]" << std::endl;
+    std::cout << "  --quick         shorter measurements (0.1s each instead of 0.5s)" << std::endl;
+    std::cout << "  --trials N      trials per batch measurement (default 200000)" << std::endl;
+    std::cout << "  --json FILE     write the results as JSON" << std::endl;
+    std::cout << "  --baseline FILE compare with a JSON file from an earlier run; exits 1 on a regression" << std::endl;
+    std::cout << "  --threshold F   slowdown that counts as a regression (default 0.10)" << std::endl;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    benchOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--quick")
+            options.minSeconds = 0.1;
+        else if (arg == "--trials" && i + 1 < argc)
+            options.trials = std::stoll(argv[++i]);
+        else if (arg == "--json" && i + 1 < argc)
+            options.jsonPath = argv[++i];
+        else if (arg == "--baseline" && i + 1 < argc)
+            options.baselinePath = argv[++i];
+        else if (arg == "--threshold" && i + 1 < argc)
+            options.threshold = std::stod(argv[++i]);
+        else {
+            printUsage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    simulationParams params;
+    defaultParams(&params);
+    params.homeOwner = true;
+
+    std::vector<benchResult> results;
+    benchSingleTrial(options, params, results);
+    benchMortgage(options, results);
+    benchRandom(options, results);
+    benchBatch(options, params, results);
+    benchMerge(options, results);
+
+    std::cout << "--------------------------------" << std::endl;
+    for (const benchResult& r : results) {
+        std::cout << "  " << std::left << std::setw(34) << r.name << std::right << std::setw(16)
+                  << std::fixed << std::setprecision(r.value < 100 ? 2 : 0) << r.value << " " << r.unit << std::endl;
+    }
+
+    if (!options.jsonPath.empty() && !writeJSON(results, options.jsonPath)) {
+        std::cout << "Could not write " << options.jsonPath << std::endl;
+        return 1;
+    }
+
+    if (!options.baselinePath.empty()) {
+        std::vector<benchResult> baseline;
+        if (!readJSON(options.baselinePath, baseline)) {
+            std::cout << "Could not read " << options.baselinePath << std::endl;
+            return 1;
+        }
+        std::cout << std::setprecision(1);
+        return compareBaseline(results, baseline, options.threshold) > 0 ? 1 : 0;
+    }
+    std::cout << "--------------------------------" << std::endl;
+    return 0;
+}
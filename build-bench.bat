@@ -0,0 +1,22 @@
+@echo off
+setlocal enabledelayedexpansion
+
+rem Builds the benchmark suite (bench\bench.cpp plus every source file except main.cpp) and runs it.
+rem Arguments are passed on to the benchmark, e.g. build-bench.bat --baseline bench\baseline.json
+
+mkdir bin 2>nul || rem Silently continue if bin already exists
+
+set files=
+for %%f in (src\*.cpp) do (
+    if /i not "%%~nxf"=="main.cpp" set files=!files! "%%f"
+)
+
+echo Compiling benchmark
+g++ -std=c++17 -O2 -pthread -o bin/bench.exe bench/bench.cpp %files%
+
+if %errorlevel% equ 0 (
+    bin\bench.exe %*
+) else (
+    echo Compilation failed with error %errorlevel%
+    exit /b %errorlevel%
+)
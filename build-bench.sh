@@ -0,0 +1,22 @@
+#!/bin/bash
+
+# Builds the benchmark suite (bench/bench.cpp plus every source file except main.cpp) and runs it.
+# Arguments are passed on to the benchmark, e.g. ./build-bench.sh --baseline bench/baseline.json
+
+mkdir -p bin || { echo "Failed to create bin directory"; exit 1; }
+
+files=()
+for file in src/*.cpp; do
+    if [ -f "$file" ] && [ "$file" != "src/main.cpp" ]; then
+        files+=("$file")
+    fi
+done
+
+echo "Compiling benchmark"
+
+g++ -std=c++17 -O2 -Wall -Wextra -pthread bench/bench.cpp "${files[@]}" -o bin/bench || {
+    echo "Compilation failed!"
+    exit 1
+}
+
+./bin/bench "$@"
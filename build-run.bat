@@ -10,7 +10,7 @@ for %%f in (*.cpp) do (
 )
 
 echo Compiling files: %files%
-g++ -o ../bin/final-project.exe %files%
+g++ -O2 -pthread -o ../bin/final-project.exe %files%
 
 if %errorlevel% equ 0 (
     cd ../bin/
@@ -25,7 +25,7 @@ fi
 echo "Compiling files: ${files[@]}"
 
 # Compile the project
-g++ -Wall -Wextra "${files[@]}" -o ../bin/final-project || {
+g++ -O2 -Wall -Wextra -pthread "${files[@]}" -o ../bin/final-project || {
     echo "Compilation failed!"
     exit 1
 }
@@ -0,0 +1,479 @@
+/*
+    * batch-kernel.cpp
+    * This source file implements the batched structure-of-arrays simulation kernel.
+    *
+    * The month update mirrors simulateMonth operation for operation (non-interactive path) so
+    * both produce the same doubles. Per lane branches become selects; the only branch left in
+    * the loop, homeOwner, is the same for every lane and gets hoisted by the compiler.
+    * The kernel is cloned for AVX-512, AVX2 and baseline x86-64 and picked at load time.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "batch-kernel.h"
+#include "profile.h"
+
+// The kernel never looks at floating point exception flags. Without no-trapping-math GCC
+// refuses to turn the per lane selects into vector blends, because computing both sides could
+// raise a flag the scalar code wouldn't; results are unaffected. fp-contract=off stops the
+// AVX-512 clone from fusing multiply-adds, which would round differently from simulateMonth.
+// tree-vectorize turns on the loop vectorizer at -O2 as well.
+#pragma GCC optimize("tree-vectorize", "no-trapping-math", "fp-contract=off")
+
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+#define KERNEL_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define KERNEL_CLONES
+#endif
+
+kernelTables buildKernelTables(const simulationParams& params, const scenarioSchedule& schedule)
+{
+    kernelTables t;
+    t.schedule = schedule;
+    Person p = initialPerson(params);
+
+    for (int k = 0; k < FLUCTUATION_STEPS; k++) {
+        double u = (k + 0.5) / FLUCTUATION_STEPS; // any draw that lands on step k
+        t.etfFactor[k] = 1.0 + getETFReturn(params.etfAnnual, u);
+
+    }
+    t.homeBase = 1 + params.appreciationRate / 100.0 / 12.0;
+
+    t.months = simulatedMonths(params);
+    int years = t.months / 12 + 1;
+
+    double preTaxIncome = params.preTaxIncome;
+    for (int year = 0; year < years; year++) {
+        t.monthlyIncome.push_back(preTaxIncome / 12.0);
+        preTaxIncome *= 1.05; // Assume a 5% salary increase each year
+    }
+
+    t.initialMortgageBalance = p.mortgageBalance;
+    t.rehireChance = 1.0 - (5.0 / 6.0) * (5.0 / 6.0) * (5.0 / 6.0) * (5.0 / 6.0);
+    t.homeOwner = params.homeOwner;
+    return t;
+}
+
+void initPathBlock(pathBlock& block, const kernelTables& tables, const simulationParams& params,
+                   uint64_t firstTrial, size_t size, bool antitheticPairs)
+{
+    Person p = initialPerson(params);
+
+    block.size = size;
+    block.streamId.resize(size);
+    block.flip.resize(size);
+    for (size_t i = 0; i < size; i++) {
+        RandomStream rng = RandomStream::forTrial(0, firstTrial + i, antitheticPairs);
+        block.streamId[i] = rng.stream();
+        block.flip[i] = rng.antithetic() ? ~0u : 0u;
+    }
+
+    block.bankBalance.assign(size, p.bankBalance);
+    block.etfBalance.assign(size, p.etfBalance);
+    block.homeValue.assign(size, p.homeValue);
+    block.mortgageBalance.assign(size, tables.initialMortgageBalance);
+    block.totalEquity.assign(size, p.totalEquity);
+    block.totalPaidOnMortgage.assign(size, p.totalPaidOnMortgage);
+
+    block.employed.assign(size, p.employed);
+    block.active.assign(size, 1);
+    block.homeSold.assign(size, 0);
+    block.monthsSimulated.assign(size, 0);
+
+    block.draws.resize(size * DRAWS_PER_MONTH);
+
+    if (block.trackControls) {
+        block.etfGrowth.assign(size, 1.0);
+        block.homeGrowth.assign(size, 1.0);
+        block.layoffMonths.assign(size * LAYOFF_WINDOWS, 0.0);
+    }
+}
+
+int layoffWindow(int month)
+{
+    int window = 0;
+    while (window + 1 < LAYOFF_WINDOWS && month >= LAYOFF_WINDOW_START[window + 1])
+        window++;
+    return window;
+}
+
+namespace {
+
+// RandomStream::toUniform. The optimize pragma above stops GCC inlining functions compiled
+// without it, and a call per draw keeps the conversion loops below from vectorizing.
+inline double laneUniform(uint32_t hi, uint32_t lo)
+{
+    uint32_t top = hi >> 11;
+    uint32_t bottom = (hi << 21) | (lo >> 11);
+    double low = (double)(int32_t)(bottom ^ 0x80000000u) + 2147483648.0;
+    return ((double)(int32_t)top * 4294967296.0 + low) * (1.0 / 9007199254740992.0);
+}
+
+// Writes draws [position, position + count) of streams (seed, streams[i]) to
+// out[d * lanes + i]: the same values RandomStream::fillUniform gives each lane, with the
+// Philox rounds run for a tile of lanes at once so they vectorize across streams. Lanes with
+// flips[i] set get the antithetic draws.
+KERNEL_CLONES
+void fillLaneDraws(uint64_t seed, const uint64_t* streams, const uint32_t* flips, size_t lanes,
+                   uint64_t position, size_t count, double* out)
+{
+    const size_t TILE = 64;
+    uint32_t c0[TILE], c1[TILE], c2[TILE], c3[TILE];
+
+    uint64_t firstBlock = position >> 1;
+    uint64_t lastBlock = (position + count - 1) >> 1;
+
+    for (uint64_t block = firstBlock; block <= lastBlock; block++) {
+        uint64_t p = block * 2;
+        bool useWord0 = p >= position;
+        bool useWord1 = p + 1 < position + count;
+
+        for (size_t tile = 0; tile < lanes; tile += TILE) {
+            size_t width = lanes - tile < TILE ? lanes - tile : TILE;
+
+            // All ten rounds per lane, unrolled so the counter stays in registers and the loop
+            // over lanes is the one that vectorizes.
+            for (size_t i = 0; i < width; i++) {
+                uint32_t x0 = (uint32_t)block, x1 = (uint32_t)(block >> 32);
+                uint32_t x2 = (uint32_t)streams[tile + i], x3 = (uint32_t)(streams[tile + i] >> 32);
+                uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+#pragma GCC unroll 10
+                for (int round = 0; round < RandomStream::PHILOX_ROUNDS; round++) {
+                    uint64_t product0 = (uint64_t)RandomStream::PHILOX_M0 * x0;
+                    uint64_t product1 = (uint64_t)RandomStream::PHILOX_M1 * x2;
+                    x0 = (uint32_t)(product1 >> 32) ^ x1 ^ k0;
+                    x1 = (uint32_t)product1;
+                    x2 = (uint32_t)(product0 >> 32) ^ x3 ^ k1;
+                    x3 = (uint32_t)product0;
+                    k0 += RandomStream::PHILOX_W0;
+                    k1 += RandomStream::PHILOX_W1;
+                }
+                c0[i] = x0;
+                c1[i] = x1;
+                c2[i] = x2;
+                c3[i] = x3;
+            }
+
+            if (useWord0) {
+                double* row = out + (p - position) * lanes + tile;
+                for (size_t i = 0; i < width; i++)
+                    row[i] = laneUniform(c1[i] ^ flips[tile + i], c0[i] ^ flips[tile + i]);
+            }
+            if (useWord1) {
+                double* row = out + (p + 1 - position) * lanes + tile;
+                for (size_t i = 0; i < width; i++)
+                    row[i] = laneUniform(c3[i] ^ flips[tile + i], c2[i] ^ flips[tile + i]);
+            }
+        }
+    }
+}
+
+// Multiplies in this month's ETF and home growth factors and counts layoff draws into the
+// month's window, the same way streamControls in precision.cpp does from a RandomStream.
+KERNEL_CLONES
+void updateControls(size_t n, const double* __restrict etfFactor, double homeBase,
+                    const double* __restrict uEtf, const double* __restrict uHome,
+                    const double* __restrict uUnemployment,
+                    double* __restrict etfGrowth, double* __restrict homeGrowth, double* __restrict layoffMonths)
+{
+    for (size_t i = 0; i < n; i++) {
+        etfGrowth[i] *= etfFactor[(int)(uEtf[i] * FLUCTUATION_STEPS)];
+        float fluctuation = ((int)(uHome[i] * FLUCTUATION_STEPS) - 200) / 10000.0;
+        homeGrowth[i] *= homeBase + fluctuation;
+        layoffMonths[i] += uUnemployment[i] < LAYOFF_CHANCE ? 1.0 : 0.0;
+    }
+}
+
+// Per-month constants the lane loop reads.
+struct monthConstants
+{
+    double income;
+    double rent;
+    double fixedCosts; // mortgage + property tax + HOA, charged again while unemployed
+    double principalPayment;
+    double monthlyPropertyTax;
+    double monthlyHOA;
+    double rehireChance;
+    double homeBase;
+};
+
+// Lanes' events counted by stepLanes<HomeOwner, true>, in profileCounter terms.
+enum laneTally
+{
+    TALLY_MONTHS = 0,
+    TALLY_LAYOFFS,
+    TALLY_REHIRES,
+    TALLY_HOME_SALES,
+    TALLY_BANKRUPTCIES,
+    LANE_TALLIES
+};
+
+// The lane arrays are passed as restrict parameters of a function that isn't inlined (GCC
+// ignores restrict on local pointers and drops it when inlining) so the loop vectorizes
+// without runtime alias checks. With Count set it also adds up the lanes' events into tally,
+// for the profiler; without it the loop is the same as if the counting weren't there.
+template <bool HomeOwner, bool Count>
+KERNEL_CLONES
+void stepLanes(size_t n, const monthConstants c,
+               const double* __restrict etfFactor,
+               const double* __restrict uEtf, const double* __restrict uHome,
+               const double* __restrict uRehire, const double* __restrict uUnemployment,
+               const double* __restrict uHomeSale,
+               double* __restrict bank, double* __restrict etf, double* __restrict home,
+               double* __restrict mortgage, double* __restrict equity, double* __restrict paid,
+               int64_t* __restrict employed, int64_t* __restrict active,
+               int64_t* __restrict homeSold, int64_t* __restrict months, int64_t* __restrict tally)
+{
+    const double income = c.income;
+    const double rent = c.rent;
+    const double fixedCosts = c.fixedCosts;
+    const double principalPayment = c.principalPayment;
+    const double monthlyPropertyTax = c.monthlyPropertyTax;
+    const double monthlyHOA = c.monthlyHOA;
+    const double rehireChance = c.rehireChance;
+    const double homeBase = c.homeBase;
+    int64_t stepped = 0, layoffs = 0, rehires = 0, sales = 0, bankruptcies = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        int64_t isActive = active[i];
+        int64_t isEmployed = employed[i];
+
+        double newEtf = etf[i] * etfFactor[(int)(uEtf[i] * FLUCTUATION_STEPS)];
+
+        // rent is 0 for homeowners, and x - 0.0 == x
+        double newBank = bank[i] - rent;
+        double paidIn = income;
+        double paidOut = -fixedCosts;
+        newBank += isEmployed ? paidIn : paidOut;
+
+        // computed rather than looked up: same operations as simulateMonth, and AVX2 can't
+        // gather from a table under the isActive mask renters end up with
+        float fluctuation = ((int)(uHome[i] * FLUCTUATION_STEPS) - 200) / 10000.0;
+        double newHome = home[i] * (homeBase + fluctuation);
+
+        double newMortgage = 0;
+        double newPaid = 0;
+        double newEquity = 0;
+        if (HomeOwner) {
+            newBank -= fixedCosts;
+            newMortgage = mortgage[i] - principalPayment;
+            newPaid = paid[i] + (principalPayment + monthlyPropertyTax + monthlyHOA);
+            newEquity = newHome - newMortgage;
+        } else {
+            newBank -= rent;
+        }
+
+        // rehire, then possibly lose the job again
+        int64_t rehired = uRehire[i] < rehireChance;
+        int64_t laidOff = uUnemployment[i] < LAYOFF_CHANCE;
+        if (Count) {
+            rehires += isActive & (isEmployed ^ 1) & rehired;
+            layoffs += isActive & laidOff;
+        }
+        isEmployed = (isEmployed | rehired) & (laidOff ^ 1);
+
+        // sell just enough ETF to cover a negative balance
+        double sellAmount = -newBank / (1.0 - ETF_SALE_FEE);
+        sellAmount = sellAmount > newEtf ? newEtf : sellAmount;
+        double transactionFee = sellAmount * ETF_SALE_FEE;
+        int64_t sellETF = (int64_t)(newBank < 0) & (int64_t)(newEtf >= -newBank);
+        double etfAfterSale = newEtf - sellAmount;
+        double bankAfterSale = newBank + (sellAmount - transactionFee);
+        double bankBeforeSale = newBank;
+        newEtf = sellETF ? etfAfterSale : newEtf;
+        newBank = sellETF ? bankAfterSale : newBank;
+
+        // capital gains tax is always 0 here: the sale price equals the current home value
+        int64_t sellHome = 0;
+        if (HomeOwner) {
+            sellHome = (int64_t)(newBank <= 0) & (int64_t)(uHomeSale[i] >= 0.5);
+            double bankAfterHomeSale = newBank + newHome;
+            newBank = sellHome ? bankAfterHomeSale : newBank;
+            newHome = sellHome ? 0.0 : newHome;
+            newMortgage = sellHome ? 0.0 : newMortgage;
+            newEquity = sellHome ? 0.0 : newEquity;
+            newPaid = sellHome ? 0.0 : newPaid;
+        }
+
+        // Same as newBank < 0. For renters GCC would fold that into a select between two
+        // comparisons it can't vectorize, so spell it out as an integer select.
+        int64_t negative = (int64_t)(newBank < 0);
+        if (!HomeOwner)
+            negative = sellETF ? (int64_t)(bankAfterSale < 0) : (int64_t)(bankBeforeSale < 0);
+        int64_t bankrupt = negative & (isEmployed ^ 1);
+        if (Count) {
+            stepped += isActive;
+            sales += isActive & sellHome;
+            bankruptcies += isActive & bankrupt;
+        }
+
+        // bankrupt paths are frozen at the state of the month they went bankrupt
+        bank[i] = isActive ? newBank : bank[i];
+        etf[i] = isActive ? newEtf : etf[i];
+        home[i] = isActive ? newHome : home[i];
+        if (HomeOwner) {
+            mortgage[i] = isActive ? newMortgage : mortgage[i];
+            equity[i] = isActive ? newEquity : equity[i];
+            paid[i] = isActive ? newPaid : paid[i];
+        } else {
+            // renters have these zeroed every month, so even frozen lanes hold 0
+            mortgage[i] = 0;
+            equity[i] = 0;
+            paid[i] = 0;
+        }
+        employed[i] = isActive ? isEmployed : employed[i];
+        homeSold[i] |= isActive & sellHome;
+        months[i] += isActive;
+        active[i] = isActive & (bankrupt ^ 1);
+    }
+
+    if (Count) {
+        tally[TALLY_MONTHS] += stepped;
+        tally[TALLY_LAYOFFS] += layoffs;
+        tally[TALLY_REHIRES] += rehires;
+        tally[TALLY_HOME_SALES] += sales;
+        tally[TALLY_BANKRUPTCIES] += bankruptcies;
+    }
+}
+
+template <bool HomeOwner, bool Count>
+void stepBlockLanes(pathBlock& block, const kernelTables& tables, const monthConstants& c, int64_t* tally)
+{
+    const size_t n = block.size;
+    const double* draws = block.draws.data();
+    stepLanes<HomeOwner, Count>(n, c, tables.etfFactor,
+                                draws + DRAW_ETF * n, draws + DRAW_HOME * n, draws + DRAW_REHIRE * n,
+                                draws + DRAW_UNEMPLOYMENT * n, draws + DRAW_HOME_SALE * n,
+                                block.bankBalance.data(), block.etfBalance.data(), block.homeValue.data(),
+                                block.mortgageBalance.data(), block.totalEquity.data(),
+                                block.totalPaidOnMortgage.data(), block.employed.data(), block.active.data(),
+                                block.homeSold.data(), block.monthsSimulated.data(), tally);
+}
+
+// Fills block.draws with month `month` of every lane's stream.
+void drawMonth(pathBlock& block, uint64_t seed, int month)
+{
+    ProfilePhase phase(PHASE_DRAWS);
+    fillLaneDraws(seed, block.streamId.data(), block.flip.data(), block.size,
+                  (uint64_t)month * DRAWS_PER_MONTH, DRAWS_PER_MONTH, block.draws.data());
+    profileCount(COUNT_DRAWS, (uint64_t)block.size * DRAWS_PER_MONTH);
+}
+
+}
+
+void stepPathBlock(pathBlock& block, const kernelTables& tables, int month)
+{
+    const int year = month / 12;
+
+    monthConstants c;
+    const amortizationRow& payment = tables.schedule.payment(month);
+
+    c.income = tables.monthlyIncome[year];
+    c.rent = tables.homeOwner ? 0.0 : tables.schedule.monthlyRent[year];
+    c.monthlyPropertyTax = tables.schedule.monthlyPropertyTax[year];
+    c.monthlyHOA = tables.schedule.monthlyHOA[year];
+    c.fixedCosts = payment.payment + c.monthlyPropertyTax + c.monthlyHOA;
+    c.principalPayment = payment.principal;
+    c.rehireChance = tables.rehireChance;
+    c.homeBase = tables.homeBase;
+
+    if (!profiling()) {
+        if (tables.homeOwner)
+            stepBlockLanes<true, false>(block, tables, c, nullptr);
+        else
+            stepBlockLanes<false, false>(block, tables, c, nullptr);
+        return;
+    }
+
+    int64_t tally[LANE_TALLIES] = {};
+    if (tables.homeOwner)
+        stepBlockLanes<true, true>(block, tables, c, tally);
+    else
+        stepBlockLanes<false, true>(block, tables, c, tally);
+    profileCount(COUNT_MONTHS, tally[TALLY_MONTHS]);
+    profileCount(COUNT_LAYOFFS, tally[TALLY_LAYOFFS]);
+    profileCount(COUNT_REHIRES, tally[TALLY_REHIRES]);
+    profileCount(COUNT_HOME_SALES, tally[TALLY_HOME_SALES]);
+    profileCount(COUNT_BANKRUPTCIES, tally[TALLY_BANKRUPTCIES]);
+}
+
+void runPathBlock(pathBlock& block, const kernelTables& tables, uint64_t seed,
+                  const std::function<void(int)>& snapshot, int interval)
+{
+    int steps = tables.months / interval;
+    int recorded = 0; // steps passed to snapshot so far
+    if (snapshot)
+        snapshot(recorded++);
+
+    bool anyActive = true;
+    for (int month = 0; month < tables.months; month++) {
+        drawMonth(block, seed, month);
+
+        if (block.trackControls) {
+            const size_t n = block.size;
+            const double* draws = block.draws.data();
+            updateControls(n, tables.etfFactor, tables.homeBase,
+                           draws + DRAW_ETF * n, draws + DRAW_HOME * n, draws + DRAW_UNEMPLOYMENT * n,
+                           block.etfGrowth.data(), block.homeGrowth.data(),
+                           block.layoffMonths.data() + layoffWindow(month) * n);
+        }
+
+        if (anyActive) {
+            ProfilePhase phase(PHASE_SIMULATE);
+            stepPathBlock(block, tables, month);
+            if (snapshot && (month + 1) % interval == 0)
+                snapshot(recorded++);
+
+            int64_t active = 0;
+            for (size_t i = 0; i < block.size; i++)
+                active |= block.active[i];
+            anyActive = active != 0;
+        }
+
+        // Without controls to finish there's nothing left to do once every lane is bankrupt.
+        if (!anyActive && !block.trackControls)
+            break;
+    }
+
+    // Every lane is frozen once bankrupt, so the remaining steps just repeat the final state.
+    while (snapshot && recorded <= steps)
+        snapshot(recorded++);
+}
+
+void runPathBlockPair(pathBlock& a, const kernelTables& tablesA, pathBlock& b, const kernelTables& tablesB,
+                      uint64_t seed)
+{
+    auto anyActive = [](const pathBlock& block) {
+        int64_t active = 0;
+        for (size_t i = 0; i < block.size; i++)
+            active |= block.active[i];
+        return active != 0;
+    };
+
+    bool activeA = tablesA.months > 0, activeB = tablesB.months > 0;
+    for (int month = 0; activeA || activeB; month++) {
+        drawMonth(a, seed, month);
+        ProfilePhase phase(PHASE_SIMULATE);
+
+        if (activeA) {
+            stepPathBlock(a, tablesA, month);
+            activeA = month + 1 < tablesA.months && anyActive(a);
+        }
+        if (activeB) {
+            // lend b the month's draws rather than copying them
+            a.draws.swap(b.draws);
+            stepPathBlock(b, tablesB, month);
+            a.draws.swap(b.draws);
+            activeB = month + 1 < tablesB.months && anyActive(b);
+        }
+    }
+}
+
+double laneNetWorth(const pathBlock& block, const kernelTables& tables, size_t lane)
+{
+    double worth = block.bankBalance[lane] - block.mortgageBalance[lane] + block.etfBalance[lane];
+    if (tables.homeOwner) {
+        worth += block.homeValue[lane];
+    }
+    return worth;
+}
@@ -0,0 +1,95 @@
+/*
+    * batch-kernel.h
+    * This header file defines the batched simulation kernel. A block of trials is stored as
+    * structure-of-arrays and every simulated month is applied to all of them in one branch-free
+    * loop, so the compiler can run several paths per vector instruction. For the same random
+    * streams the kernel gives bit-identical results to simulateTrial.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "simulation.h"
+
+// Scenario constants and lookup tables read by the kernel, built once per batch.
+struct kernelTables
+{
+    double etfFactor[FLUCTUATION_STEPS];  // monthly ETF growth factor for each fluctuation step
+
+    std::vector<double> monthlyIncome; // per simulated year
+    scenarioSchedule schedule;         // mortgage, rent, property tax and HOA
+
+    double initialMortgageBalance;
+    double rehireChance;
+    double homeBase; // 1 + monthly appreciation, before the fluctuation is added
+
+    bool homeOwner;
+    int months;
+};
+
+// State of a block of trials. Flags are 0/1 in 64 bit lanes so they line up with the balances
+// and select in the same vector registers.
+struct pathBlock
+{
+    size_t size = 0;
+    std::vector<uint64_t> streamId;
+    std::vector<uint32_t> flip; // all ones for the mirrored half of an antithetic pair
+
+    std::vector<double> bankBalance;
+    std::vector<double> etfBalance;
+    std::vector<double> homeValue;
+    std::vector<double> mortgageBalance;
+    std::vector<double> totalEquity;
+    std::vector<double> totalPaidOnMortgage;
+
+    std::vector<int64_t> employed;
+    std::vector<int64_t> active; // cleared once the path goes bankrupt
+    std::vector<int64_t> homeSold;
+    std::vector<int64_t> monthsSimulated;
+
+    std::vector<double> draws; // DRAWS_PER_MONTH rows of size lanes
+
+    // Control variates, tracked when trackControls is set: products of the monthly ETF and home
+    // growth factors and the number of months a layoff was drawn in each LAYOFF_WINDOW. They only
+    // depend on the draws, so they cover every month of the scenario even for lanes that went
+    // bankrupt.
+    bool trackControls = false;
+    std::vector<double> etfGrowth;
+    std::vector<double> homeGrowth;
+    std::vector<double> layoffMonths; // LAYOFF_WINDOWS rows of size lanes
+};
+
+// Layoffs early on decide most bankruptcies, so they are counted separately by how far into the
+// run they were drawn: months [0, 6), [6, 12), [12, 24), [24, 60) and 60 onwards.
+const int LAYOFF_WINDOWS = 5;
+const int LAYOFF_WINDOW_START[LAYOFF_WINDOWS] = {0, 6, 12, 24, 60};
+int layoffWindow(int month);
+
+kernelTables buildKernelTables(const simulationParams& params, const scenarioSchedule& schedule);
+
+// Resets block to `size` fresh trials firstTrial, firstTrial + 1, ... drawing from the streams
+// RandomStream::forTrial gives them.
+void initPathBlock(pathBlock& block, const kernelTables& tables, const simulationParams& params,
+                   uint64_t firstTrial, size_t size, bool antitheticPairs = false);
+
+// Applies month `month` to every lane using the draws already in block.draws.
+void stepPathBlock(pathBlock& block, const kernelTables& tables, int month);
+
+// Runs every month of the scenario on the block, drawing from streams (seed, streamId[i]).
+// snapshot, if set, is called with step 0 before the first month and then after every
+// `interval` months (every complete year by default), tables.months / interval + 1 calls in
+// all, with the block holding that step's state.
+void runPathBlock(pathBlock& block, const kernelTables& tables, uint64_t seed,
+                  const std::function<void(int)>& snapshot = nullptr, int interval = 12);
+
+// Runs two scenarios over the same trials in one pass: each month is drawn once and both blocks
+// step on it. a and b must have been initialised with the same trials; control variates aren't
+// tracked. Gives the same results as runPathBlock on each block.
+void runPathBlockPair(pathBlock& a, const kernelTables& tablesA, pathBlock& b, const kernelTables& tablesB,
+                      uint64_t seed);
+
+double laneNetWorth(const pathBlock& block, const kernelTables& tables, size_t lane);
@@ -0,0 +1,556 @@
+/*
+    * batch.cpp
+    * This source file implements the headless Monte Carlo batch mode.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "batch.h"
+#include "batch-kernel.h"
+#include "profile.h"
+#include "trajectory.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+
+namespace {
+
+// Per-worker accumulators, padded so neighbouring workers don't share a cache line.
+struct alignas(64) workerTotals : batchTotals
+{
+    std::vector<Person> snapshots; // scratch trajectory for the scalar kernel
+    std::vector<double> paths;     // scratch [field][step][path] block for the trajectory file
+};
+
+metricSummary summarize(const metricStats& stats)
+{
+    metricSummary s;
+    s.mean = stats.moments.mean;
+    s.stddev = stats.moments.stddev();
+    s.p5 = stats.quantiles.quantile(0.05);
+    s.p50 = stats.quantiles.quantile(0.50);
+    s.p95 = stats.quantiles.quantile(0.95);
+    return s;
+}
+
+// One scenario of a runBatches call: the tables shared by its trials and per-worker totals.
+struct batchScenario
+{
+    simulationParams params;
+    policyOptions policy;
+    bool simd;           // runs on KERNEL_SIMD
+    scenarioSchedule schedule;
+    kernelTables tables; // KERNEL_SIMD only
+    int years;           // year summaries kept, -1 when options.yearly is off
+    TrajectoryWriter* trajectory; // every path goes here when set
+    int interval;        // months between snapshots: the trajectory's interval, else a year
+    std::shared_ptr<const EconomicScenarios> economy; // when options.economy is enabled
+    std::vector<workerTotals> totals;
+};
+
+// A chunk of trials [begin, end) of one scenario.
+struct workItem
+{
+    size_t scenario;
+    size_t begin;
+    size_t end;
+    int cost; // months simulated per trial, so long scenarios are handed out first
+};
+
+void prepareScenario(batchScenario& s, const simulationParams& params, const batchOptions& options, int workers)
+{
+    ProfilePhase phase(PHASE_SETUP);
+    s.params = params;
+    s.policy = options.policy;
+    s.simd = usesSimdKernel(options);
+    s.schedule = buildSchedule(s.params);
+    if (s.simd)
+        s.tables = buildKernelTables(s.params, s.schedule);
+    s.years = options.yearly ? simulatedMonths(s.params) / 12 : -1;
+    s.trajectory = nullptr;
+    s.interval = 12;
+    if (options.economy.enabled)
+        s.economy = economicScenarios(options.economy, options.seed, simulatedMonths(s.params));
+    s.totals.resize(workers);
+    for (workerTotals& t : s.totals)
+        t.years.resize(s.years + 1);
+}
+
+// Adds the fields of one path at one snapshot to the worker's trajectory block.
+void recordPath(double* paths, size_t steps, size_t count, int step, size_t lane, double worth,
+                double bank, double etf, double home, double mortgage, double equity)
+{
+    const double values[TRAJECTORY_FIELDS] = {worth, bank, etf, home, mortgage, equity};
+    for (int field = 0; field < TRAJECTORY_FIELDS; field++)
+        paths[(field * steps + step) * count + lane] = values[field];
+}
+
+// Adds the final state of every lane of block to totals, and its net worth to finals if set.
+void addBlockFinals(workerTotals& totals, const pathBlock& block, const kernelTables& tables, double* finals)
+{
+    for (size_t i = 0; i < block.size; i++) {
+        double worth = laneNetWorth(block, tables, i);
+        if (finals != nullptr)
+            finals[i] = worth;
+        totals.trials++;
+        totals.finalNetWorth.add(worth);
+        totals.bankruptcies += !block.active[i];
+        totals.homeSales += block.homeSold[i];
+    }
+}
+
+void addTrialFinal(workerTotals& totals, const trialResult& r)
+{
+    totals.trials++;
+    totals.finalNetWorth.add(r.finalNetWorth);
+    totals.bankruptcies += r.bankrupt;
+    totals.homeSales += r.homeSold;
+}
+
+// Runs trials [begin, end) of s into worker's totals. If finals is set it also receives each
+// trial's final net worth at finals[trial - begin].
+void runChunk(batchScenario& s, const batchOptions& options, size_t begin, size_t end, int worker,
+              pathBlock& block, double* finals = nullptr)
+{
+    ProfilePhase phase(PHASE_SIMULATE);
+    workerTotals& local = s.totals[worker];
+    const int years = s.years;
+    const int interval = s.interval;
+    const size_t count = end - begin;
+    const size_t steps = simulatedMonths(s.params) / interval + 1;
+    if (s.trajectory != nullptr)
+        local.paths.resize(TRAJECTORY_FIELDS * steps * count);
+    profileCount(COUNT_TRIALS, count);
+
+    if (s.simd) {
+        const kernelTables& tables = s.tables;
+        initPathBlock(block, tables, s.params, begin, count);
+
+        std::function<void(int)> snapshot;
+        if (years >= 0 || s.trajectory != nullptr) {
+            snapshot = [&](int step) {
+                ProfilePhase aggregate(PHASE_AGGREGATE);
+                if (s.trajectory != nullptr) {
+                    for (size_t i = 0; i < count; i++)
+                        recordPath(local.paths.data(), steps, count, step, i, laneNetWorth(block, tables, i),
+                                   block.bankBalance[i], block.etfBalance[i], block.homeValue[i],
+                                   block.mortgageBalance[i], block.totalEquity[i]);
+                }
+                if (years < 0 || step * interval % 12 != 0)
+                    return;
+                yearlyMetrics& y = local.years[step * interval / 12];
+                for (size_t i = 0; i < count; i++) {
+                    y.netWorth.add(laneNetWorth(block, tables, i));
+                    y.equity.add(block.totalEquity[i]);
+                    y.bankBalance.add(block.bankBalance[i]);
+                    y.etfBalance.add(block.etfBalance[i]);
+                }
+            };
+        }
+        runPathBlock(block, tables, options.seed, snapshot, interval);
+        ProfilePhase aggregate(PHASE_AGGREGATE);
+        addBlockFinals(local, block, tables, finals);
+    }
+    else {
+        bool keepSnapshots = years >= 0 || s.trajectory != nullptr;
+        local.snapshots.resize(steps);
+        withPolicy(s.policy, [&](const auto& policy) {
+            for (size_t trial = begin; trial < end; trial++) {
+                // every trial owns stream (seed, trial) so results don't depend on scheduling
+                RandomStream rng(options.seed, trial);
+                trialResult r = simulateTrial(s.params, s.schedule, rng, policy,
+                                              keepSnapshots ? local.snapshots.data() : nullptr, interval,
+                                              s.economy != nullptr ? s.economy->path(trial) : nullptr);
+                ProfilePhase aggregate(PHASE_AGGREGATE);
+                if (finals != nullptr)
+                    finals[trial - begin] = r.finalNetWorth;
+                addTrialFinal(local, r);
+
+                if (s.trajectory != nullptr) {
+                    for (size_t step = 0; step < steps; step++) {
+                        const Person& p = local.snapshots[step];
+                        recordPath(local.paths.data(), steps, count, step, trial - begin, netWorth(p),
+                                   p.bankBalance, p.etfBalance, p.homeValue, p.mortgageBalance, p.totalEquity);
+                    }
+                }
+
+                for (int year = 0; year <= years; year++) {
+                    const Person& p = local.snapshots[year * 12 / interval];
+                    yearlyMetrics& y = local.years[year];
+                    y.netWorth.add(netWorth(p));
+                    y.equity.add(p.totalEquity);
+                    y.bankBalance.add(p.bankBalance);
+                    y.etfBalance.add(p.etfBalance);
+                }
+            }
+        });
+    }
+
+    if (s.trajectory != nullptr) {
+        ProfilePhase output(PHASE_OUTPUT);
+        s.trajectory->writeBlock((begin - options.firstTrial) / options.chunkSize, count, local.paths.data());
+    }
+}
+
+// Runs trials [begin, end) of a and b together, drawing every month once for both, into their
+// totals and the final net worths into finalsA and finalsB. Neither keeps yearly summaries.
+void runPairedChunk(batchScenario& a, batchScenario& b, const batchOptions& options, size_t begin, size_t end,
+                    int worker, pathBlock& blockA, pathBlock& blockB, double* finalsA, double* finalsB)
+{
+    ProfilePhase phase(PHASE_SIMULATE);
+    const size_t count = end - begin;
+    profileCount(COUNT_TRIALS, 2 * count);
+    if (a.simd) {
+        initPathBlock(blockA, a.tables, a.params, begin, count);
+        initPathBlock(blockB, b.tables, b.params, begin, count);
+        runPathBlockPair(blockA, a.tables, blockB, b.tables, options.seed);
+        ProfilePhase aggregate(PHASE_AGGREGATE);
+        addBlockFinals(a.totals[worker], blockA, a.tables, finalsA);
+        addBlockFinals(b.totals[worker], blockB, b.tables, finalsB);
+        return;
+    }
+
+    withPolicy(a.policy, [&](const auto& policy) {
+        using Policy = std::decay_t<decltype(policy)>;
+        for (size_t trial = begin; trial < end; trial++) {
+            RandomStream rng(options.seed, trial);
+            Simulation<Policy> simA(a.params, a.schedule, rng, policy);
+            Simulation<Policy> simB(b.params, b.schedule, rng, policy);
+            if (a.economy != nullptr) {
+                simA.useEconomy(a.economy->path(trial));
+                simB.useEconomy(b.economy->path(trial));
+            }
+
+            monthDraws draws;
+            while (!simA.finished() || !simB.finished()) {
+                fillMonthDraws(rng, draws);
+                simA.step(draws);
+                simB.step(draws);
+            }
+
+            ProfilePhase aggregate(PHASE_AGGREGATE);
+            trialResult ra = simA.result(), rb = simB.result();
+            finalsA[trial - begin] = ra.finalNetWorth;
+            finalsB[trial - begin] = rb.finalNetWorth;
+            addTrialFinal(a.totals[worker], ra);
+            addTrialFinal(b.totals[worker], rb);
+        }
+    });
+}
+
+// Merge in worker order; the sketches give the same quantiles whatever the split was.
+batchTotals collectTotals(const batchScenario& s)
+{
+    batchTotals merged;
+    merged.years.resize(s.years + 1);
+    for (const workerTotals& t : s.totals)
+        merged.merge(t);
+    return merged;
+}
+
+// Runs options.trials trials of every prepared scenario in one parallel pass. Trial i draws
+// from stream (seed, i) in every scenario, so scenarios are compared on common random numbers.
+// If finals is set, (*finals)[k][trial - options.firstTrial] receives the final net worth of
+// every trial of runs[k].
+std::vector<batchResults> runScenarios(std::vector<batchScenario>& runs, ThreadPool& pool, const batchOptions& options,
+                                       std::vector<batchTotals>* totals,
+                                       std::vector<std::vector<double>>* finals = nullptr)
+{
+    std::vector<workItem> work;
+    for (size_t k = 0; k < runs.size(); k++) {
+        int cost = simulatedMonths(runs[k].params);
+        const long long last = options.firstTrial + options.trials;
+        for (long long begin = options.firstTrial; begin < last; begin += options.chunkSize) {
+            long long end = std::min(begin + (long long)options.chunkSize, last);
+            work.push_back({k, (size_t)begin, (size_t)end, cost});
+        }
+    }
+
+    // Longest chunks first, so the cheap ones fill in the gaps at the end instead of one long
+    // scenario finishing alone. Chunks that end early (bankruptcies) just free the worker
+    // sooner since work is handed out dynamically.
+    std::stable_sort(work.begin(), work.end(), [](const workItem& a, const workItem& b) {
+        return a.cost > b.cost;
+    });
+
+    if (finals != nullptr)
+        finals->assign(runs.size(), std::vector<double>(options.trials));
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<pathBlock> blocks(pool.size()); // reused by each worker between chunks
+    pool.parallelFor(work.size(), 1, [&](size_t begin, size_t end, int worker) {
+        for (size_t w = begin; w < end; w++) {
+            const workItem& item = work[w];
+            double* out = finals != nullptr ? (*finals)[item.scenario].data() + (item.begin - options.firstTrial)
+                                            : nullptr;
+            runChunk(runs[item.scenario], options, item.begin, item.end, worker, blocks[worker], out);
+        }
+    });
+
+    auto stop = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(stop - start).count();
+    double totalTrials = (double)options.trials * runs.size();
+
+    ProfilePhase phase(PHASE_AGGREGATE);
+    std::vector<batchResults> results;
+    if (totals != nullptr)
+        totals->clear();
+    for (const batchScenario& s : runs) {
+        batchTotals merged = collectTotals(s);
+        batchResults r = summarizeTotals(merged);
+        if (totals != nullptr)
+            totals->push_back(merged);
+        r.elapsedSeconds = elapsed;
+        r.trialsPerSecond = elapsed > 0 ? totalTrials / elapsed : 0;
+        results.push_back(r);
+    }
+    return results;
+}
+
+}
+
+void batchTotals::merge(const batchTotals& other)
+{
+    trials += other.trials;
+    finalNetWorth.merge(other.finalNetWorth);
+    bankruptcies += other.bankruptcies;
+    homeSales += other.homeSales;
+    for (size_t year = 0; year < years.size() && year < other.years.size(); year++)
+        years[year].merge(other.years[year]);
+}
+
+batchResults summarizeTotals(const batchTotals& totals)
+{
+    batchResults results = {};
+    results.trials = totals.trials;
+    if (totals.trials <= 0)
+        return results;
+
+    metricSummary finalWorth = summarize(totals.finalNetWorth);
+    results.meanNetWorth = finalWorth.mean;
+    results.stddevNetWorth = finalWorth.stddev;
+    results.p5NetWorth = finalWorth.p5;
+    results.p50NetWorth = finalWorth.p50;
+    results.p95NetWorth = finalWorth.p95;
+    results.bankruptcyRate = (double)totals.bankruptcies / totals.trials;
+    results.homeSaleRate = (double)totals.homeSales / totals.trials;
+
+    for (size_t year = 0; year < totals.years.size(); year++) {
+        const yearlyMetrics& y = totals.years[year];
+        yearSummary summary;
+        summary.year = (int)year;
+        summary.netWorth = summarize(y.netWorth);
+        summary.equity = summarize(y.equity);
+        summary.bankBalance = summarize(y.bankBalance);
+        summary.etfBalance = summarize(y.etfBalance);
+        results.years.push_back(summary);
+    }
+    return results;
+}
+
+bool usesSimdKernel(const batchOptions& options)
+{
+    return options.kernel == KERNEL_SIMD && options.policy.isDefault() && !options.economy.enabled;
+}
+
+batchResults runBatch(const simulationParams& params, const batchOptions& options, batchTotals* totals)
+{
+    std::vector<batchTotals> scenarioTotals;
+    batchResults results = runBatches(std::vector<simulationParams>(1, params), options,
+                                      totals != nullptr ? &scenarioTotals : nullptr)[0];
+    if (totals != nullptr)
+        *totals = scenarioTotals[0];
+    return results;
+}
+
+std::vector<batchResults> runBatches(const std::vector<simulationParams>& scenarios, const batchOptions& options,
+                                     std::vector<batchTotals>* totals)
+{
+    if (options.trials <= 0) {
+        batchResults empty = {};
+        if (totals != nullptr)
+            totals->assign(scenarios.size(), batchTotals());
+        return std::vector<batchResults>(scenarios.size(), empty);
+    }
+
+    std::unique_ptr<ThreadPool> ownPool;
+    ThreadPool* pool = options.pool;
+    if (pool == nullptr) {
+        ownPool.reset(new ThreadPool(options.threads));
+        pool = ownPool.get();
+    }
+
+    std::vector<batchScenario> runs(scenarios.size());
+    for (size_t k = 0; k < scenarios.size(); k++) {
+        prepareScenario(runs[k], scenarios[k], options, pool->size());
+        if (options.trajectory != nullptr && scenarios.size() == 1) {
+            runs[k].trajectory = options.trajectory;
+            runs[k].interval = options.trajectory->interval();
+        }
+    }
+    return runScenarios(runs, *pool, options, totals);
+}
+
+std::vector<batchResults> runPolicies(const simulationParams& params, const std::vector<policyOptions>& policies,
+                                      const batchOptions& options, std::vector<std::vector<double>>* finals)
+{
+    if (options.trials <= 0) {
+        batchResults empty = {};
+        if (finals != nullptr)
+            finals->assign(policies.size(), std::vector<double>());
+        return std::vector<batchResults>(policies.size(), empty);
+    }
+
+    std::unique_ptr<ThreadPool> ownPool;
+    ThreadPool* pool = options.pool;
+    if (pool == nullptr) {
+        ownPool.reset(new ThreadPool(options.threads));
+        pool = ownPool.get();
+    }
+
+    std::vector<batchScenario> runs(policies.size());
+    for (size_t k = 0; k < policies.size(); k++) {
+        batchOptions candidate = options;
+        candidate.policy = policies[k];
+        prepareScenario(runs[k], params, candidate, pool->size());
+    }
+    return runScenarios(runs, *pool, options, nullptr, finals);
+}
+
+pairedResults runPaired(const simulationParams& first, const simulationParams& second, const batchOptions& options,
+                        pairedFinals* finals)
+{
+    pairedResults results = {};
+    if (options.trials <= 0)
+        return results;
+
+    std::unique_ptr<ThreadPool> ownPool;
+    ThreadPool* pool = options.pool;
+    if (pool == nullptr) {
+        ownPool.reset(new ThreadPool(options.threads));
+        pool = ownPool.get();
+    }
+
+    batchOptions pairedOptions = options;
+    pairedOptions.yearly = false;
+
+    batchScenario a, b;
+    prepareScenario(a, first, pairedOptions, pool->size());
+    prepareScenario(b, second, pairedOptions, pool->size());
+
+    // Per-worker paired statistics and scratch space, padded like workerTotals.
+    struct alignas(64) pairTotals
+    {
+        metricStats difference;
+        long long firstWins = 0;
+        pathBlock blockA;
+        pathBlock blockB;
+        std::vector<double> finalsA;
+        std::vector<double> finalsB;
+    };
+    std::vector<pairTotals> totals(pool->size());
+    if (finals != nullptr) {
+        finals->first.assign(options.trials, 0);
+        finals->second.assign(options.trials, 0);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    pool->parallelFor(options.trials, options.chunkSize, [&](size_t begin, size_t end, int worker) {
+        pairTotals& local = totals[worker];
+        local.finalsA.resize(end - begin);
+        local.finalsB.resize(end - begin);
+
+        // both sides of trial i step on the same draws from stream (seed, i)
+        runPairedChunk(a, b, pairedOptions, begin, end, worker, local.blockA, local.blockB,
+                       local.finalsA.data(), local.finalsB.data());
+
+        for (size_t i = 0; i < end - begin; i++) {
+            local.difference.add(local.finalsA[i] - local.finalsB[i]);
+            local.firstWins += local.finalsA[i] > local.finalsB[i];
+        }
+        if (finals != nullptr) {
+            std::copy(local.finalsA.begin(), local.finalsA.end(), finals->first.begin() + begin);
+            std::copy(local.finalsB.begin(), local.finalsB.end(), finals->second.begin() + begin);
+        }
+    });
+
+    auto stop = std::chrono::steady_clock::now();
+
+    ProfilePhase phase(PHASE_AGGREGATE);
+    metricStats difference;
+    long long firstWins = 0;
+    for (const pairTotals& t : totals) {
+        difference.merge(t.difference);
+        firstWins += t.firstWins;
+    }
+
+    results.first = summarizeTotals(collectTotals(a));
+    results.second = summarizeTotals(collectTotals(b));
+    results.meanDifference = difference.moments.mean;
+    results.differenceStdError = difference.moments.stddev() / std::sqrt((double)difference.moments.count);
+    results.difference = summarize(difference);
+    results.firstWinRate = (double)firstWins / options.trials;
+
+    double elapsed = std::chrono::duration<double>(stop - start).count();
+    for (batchResults* r : {&results.first, &results.second}) {
+        r->elapsedSeconds = elapsed;
+        r->trialsPerSecond = elapsed > 0 ? 2.0 * options.trials / elapsed : 0;
+    }
+    return results;
+}
+
+void printBatchResults(const batchResults& results)
+{
+    ProfilePhase phase(PHASE_OUTPUT);
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "--------------------------------" << std::endl;
+    std::cout << "Trials: " << results.trials << std::endl;
+    std::cout << "Mean Net Worth: $" << results.meanNetWorth << std::endl;
+    std::cout << "Net Worth p5 / p50 / p95: $" << results.p5NetWorth
+              << " / $" << results.p50NetWorth
+              << " / $" << results.p95NetWorth << std::endl;
+    std::cout << "Bankruptcy Rate: " << results.bankruptcyRate * 100.0 << "%" << std::endl;
+    std::cout << "Home Sale Rate: " << results.homeSaleRate * 100.0 << "%" << std::endl;
+    if (results.elapsedSeconds > 0) {
+        std::cout << "Elapsed: " << results.elapsedSeconds << "s ("
+                  << results.trialsPerSecond << " trials/sec)" << std::endl;
+    }
+    std::cout << "--------------------------------" << std::endl;
+
+    std::cout << "Net Worth by Year (p5 / p50 / p95):" << std::endl;
+    for (const yearSummary& y : results.years) {
+        std::cout << "Year " << std::setw(2) << y.year << ": $" << y.netWorth.p5
+                  << " / $" << y.netWorth.p50
+                  << " / $" << y.netWorth.p95 << std::endl;
+    }
+    std::cout << "--------------------------------" << std::endl;
+}
+
+bool writeYearlyCSV(const batchResults& results, const std::string& path)
+{
+    ProfilePhase phase(PHASE_OUTPUT);
+    std::ofstream out(path);
+    if (!out)
+        return false;
+
+    out << std::fixed << std::setprecision(2);
+    out << "year,metric,mean,stddev,p5,p50,p95" << std::endl;
+    for (const yearSummary& y : results.years) {
+        const std::pair<const char*, const metricSummary*> metrics[] = {
+            {"netWorth", &y.netWorth},
+            {"equity", &y.equity},
+            {"bankBalance", &y.bankBalance},
+            {"etfBalance", &y.etfBalance},
+        };
+        for (const auto& [name, m] : metrics) {
+            out << y.year << "," << name << "," << m->mean << "," << m->stddev << ","
+                << m->p5 << "," << m->p50 << "," << m->p95 << std::endl;
+        }
+    }
+    return (bool)out;
+}
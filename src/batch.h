@@ -0,0 +1,169 @@
+/*
+    * batch.h
+    * This header file defines the headless Monte Carlo batch mode. A batch runs many independent
+    * trials of the same scenario across every core and reports aggregated outcomes.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "economy.h"
+#include "policy.h"
+#include "simulation.h"
+#include "stats.h"
+#include "thread-pool.h"
+
+class TrajectoryWriter;
+
+enum batchKernel
+{
+    KERNEL_SCALAR, // one trial at a time through simulateTrial
+    KERNEL_SIMD    // blocks of trials through the structure-of-arrays kernel
+};
+
+struct batchOptions
+{
+    long long trials = 100000;
+    long long firstTrial = 0; // runBatch and runBatches run trials firstTrial .. firstTrial + trials - 1
+    int threads = 0;          // 0 uses every hardware thread
+    unsigned long long seed = 1;
+    int chunkSize = 1024;     // trials handed to a worker at a time (lanes per block for KERNEL_SIMD)
+    batchKernel kernel = KERNEL_SIMD;
+    policyOptions policy;       // monthly decisions; non-default policies run on KERNEL_SCALAR
+    bool yearly = true;         // keep per-year summaries (batchResults::years)
+    economyOptions economy;     // run trials in generated economies; they use KERNEL_SCALAR
+    ThreadPool* pool = nullptr; // optional pool to reuse instead of starting a new one
+    // Single-scenario batches stream every path here, one block per chunk; the writer must have
+    // been opened for this scenario with trials paths and chunkSize paths per block.
+    TrajectoryWriter* trajectory = nullptr;
+};
+
+// Streaming statistics for every tracked quantity at one year end.
+struct yearlyMetrics
+{
+    metricStats netWorth;
+    metricStats equity;
+    metricStats bankBalance;
+    metricStats etfBalance;
+
+    void merge(const yearlyMetrics& other)
+    {
+        netWorth.merge(other.netWorth);
+        equity.merge(other.equity);
+        bankBalance.merge(other.bankBalance);
+        etfBalance.merge(other.etfBalance);
+    }
+};
+
+// Everything a batch accumulates before it is summarised. Totals of disjoint sets of trials
+// merge into the totals of their union, which is how worker threads and shards (shard.h) are
+// combined.
+struct batchTotals
+{
+    long long trials = 0;
+    metricStats finalNetWorth;
+    long long bankruptcies = 0;
+    long long homeSales = 0;
+    std::vector<yearlyMetrics> years; // empty when yearly summaries are off
+
+    void merge(const batchTotals& other);
+};
+
+struct metricSummary
+{
+    double mean;
+    double stddev;
+    double p5;
+    double p50;
+    double p95;
+};
+
+// Distribution of each tracked quantity across all trials at the end of one simulated year.
+// Year 0 is the starting state; bankrupt trials keep their final state in later years.
+struct yearSummary
+{
+    int year;
+    metricSummary netWorth;
+    metricSummary equity;
+    metricSummary bankBalance;
+    metricSummary etfBalance;
+};
+
+struct batchResults
+{
+    long long trials;
+
+    double meanNetWorth;
+    double stddevNetWorth;
+    double p5NetWorth;
+    double p50NetWorth;
+    double p95NetWorth;
+
+    double bankruptcyRate;
+    double homeSaleRate;
+
+    double elapsedSeconds;
+    double trialsPerSecond;
+
+    std::vector<yearSummary> years; // fan chart data, one entry per simulated year
+};
+
+// Two scenarios run on the same trials. Both sides of a trial step on the same draws, so the
+// per-trial difference has far less noise than two independent batches.
+struct pairedResults
+{
+    batchResults first;
+    batchResults second;
+
+    double meanDifference;     // mean over trials of first - second final net worth
+    double differenceStdError; // standard error of meanDifference
+    metricSummary difference;  // distribution of the per-trial difference
+    double firstWinRate;       // share of trials where first ends with the higher net worth
+};
+
+// Per-trial final net worths of a paired run.
+struct pairedFinals
+{
+    std::vector<double> first;
+    std::vector<double> second;
+};
+
+// The SIMD kernel only implements the default policy, so other policies fall back to the
+// scalar path whatever options.kernel says.
+bool usesSimdKernel(const batchOptions& options);
+
+// Percentiles come from streaming sketches (within 0.5%), so memory doesn't grow with trials.
+// If totals is set it also receives the unsummarised totals.
+batchResults runBatch(const simulationParams& params, const batchOptions& options, batchTotals* totals = nullptr);
+
+// Runs options.trials trials of every scenario in one parallel pass and returns their results
+// in the same order. Trial i uses the same random stream in every scenario. elapsedSeconds and
+// trialsPerSecond cover the whole pass. If totals is set it receives each scenario's totals.
+std::vector<batchResults> runBatches(const std::vector<simulationParams>& scenarios, const batchOptions& options,
+                                     std::vector<batchTotals>* totals = nullptr);
+
+// Runs options.trials trials of params under every policy in one parallel pass, on the same
+// random streams, and returns their results in the same order. Yearly summaries follow
+// options.yearly. If finals is set, (*finals)[k] receives every trial's final net worth under
+// policies[k], indexed by trial - options.firstTrial.
+std::vector<batchResults> runPolicies(const simulationParams& params, const std::vector<policyOptions>& policies,
+                                      const batchOptions& options,
+                                      std::vector<std::vector<double>>* finals = nullptr);
+
+// The results a batch with these totals reports; elapsedSeconds and trialsPerSecond are left 0.
+batchResults summarizeTotals(const batchTotals& totals);
+
+// Runs first and second side by side: every month of a trial is drawn once and both states
+// advance on it, so a pair costs one set of draws. Neither side keeps yearly summaries.
+// If finals isn't null it receives every trial's final net worth on each side, indexed by trial.
+pairedResults runPaired(const simulationParams& first, const simulationParams& second, const batchOptions& options,
+                        pairedFinals* finals = nullptr);
+
+// Leaves out the elapsed time of results that weren't timed, such as merged shards.
+void printBatchResults(const batchResults& results);
+
+// Writes every yearly summary as CSV. Returns false if the file can't be written.
+bool writeYearlyCSV(const batchResults& results, const std::string& path);
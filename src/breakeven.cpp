@@ -0,0 +1,167 @@
+/*
+    * breakeven.cpp
+    * This source file implements the break-even solver.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "breakeven.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include "sweep.h"
+
+namespace {
+
+// Contiguous groups of trials the median's standard error is estimated over (batch means).
+const int MEDIAN_BATCHES = 20;
+
+double median(std::vector<double>::iterator begin, std::vector<double>::iterator end)
+{
+    auto middle = begin + (end - begin) / 2;
+    std::nth_element(begin, middle, end);
+    double upper = *middle;
+    if ((end - begin) % 2 != 0)
+        return upper;
+    return (upper + *std::max_element(begin, middle)) / 2;
+}
+
+// Median of first minus median of second over trials [begin, end). Reorders both ranges.
+double medianDifference(pairedFinals& finals, size_t begin, size_t end)
+{
+    return median(finals.first.begin() + begin, finals.first.begin() + end) -
+           median(finals.second.begin() + begin, finals.second.begin() + end);
+}
+
+class BreakEvenSearch
+{
+public:
+    BreakEvenSearch(const simulationParams& base, const breakEvenOptions& options, const batchOptions& batch,
+                    breakEvenResult& result)
+        : base(base), options(options), batch(batch), result(result), trials(options.minTrials) {}
+
+    // Evaluates owner - renter at value, adding trials until the sign is clear or maxTrials is hit.
+    breakEvenStep evaluate(double value)
+    {
+        while (true) {
+            breakEvenStep step = evaluateOnce(value);
+            result.steps.push_back(step);
+            if (signResolved(step) || trials >= options.maxTrials)
+                return step;
+            trials = std::min(trials * 4, options.maxTrials);
+        }
+    }
+
+    bool signResolved(const breakEvenStep& step) const
+    {
+        return std::fabs(step.difference) > 2.0 * step.stdError;
+    }
+
+private:
+    breakEvenStep evaluateOnce(double value)
+    {
+        simulationParams owner = base;
+        simulationParams renter = base;
+        setParam(owner, options.field, value);
+        setParam(renter, options.field, value);
+        owner.homeOwner = true;
+        renter.homeOwner = false;
+
+        batchOptions pass = batch;
+        pass.trials = trials;
+        pairedFinals finals;
+        pairedResults paired = runPaired(owner, renter, pass, options.statistic == STAT_MEDIAN ? &finals : nullptr);
+        result.totalTrials += 2 * trials;
+
+        breakEvenStep step;
+        step.value = value;
+        step.trials = trials;
+        if (options.statistic == STAT_MEDIAN) {
+            // Trials are independent, so the median differences of disjoint groups are too: their
+            // spread, scaled by sqrt(groups), estimates the full run's standard error.
+            size_t count = finals.first.size();
+            int batches = (int)std::min<size_t>(MEDIAN_BATCHES, count / 2);
+            double sum = 0, sumSquares = 0;
+            for (int k = 0; k < batches; k++) {
+                double d = medianDifference(finals, count * k / batches, count * (k + 1) / batches);
+                sum += d;
+                sumSquares += d * d;
+            }
+            double variance = batches > 1 ? (sumSquares - sum * sum / batches) / (batches - 1) : 0;
+            step.stdError = std::sqrt(std::max(variance, 0.0) / batches);
+            step.difference = medianDifference(finals, 0, count);
+        }
+        else {
+            step.difference = paired.meanDifference;
+            step.stdError = paired.differenceStdError;
+        }
+        return step;
+    }
+
+    const simulationParams& base;
+    const breakEvenOptions& options;
+    const batchOptions& batch;
+    breakEvenResult& result;
+    long long trials;
+};
+
+}
+
+breakEvenResult solveBreakEven(const simulationParams& base, const breakEvenOptions& options,
+                               const batchOptions& batch)
+{
+    breakEvenResult result = {};
+    result.low = options.low;
+    result.high = options.high;
+
+    // Every evaluation is a separate pass, so share one pool between them.
+    std::unique_ptr<ThreadPool> ownPool;
+    batchOptions shared = batch;
+    if (shared.pool == nullptr) {
+        ownPool.reset(new ThreadPool(batch.threads));
+        shared.pool = ownPool.get();
+    }
+
+    BreakEvenSearch search(base, options, shared, result);
+    breakEvenStep low = search.evaluate(options.low);
+    breakEvenStep high = search.evaluate(options.high);
+
+    if ((low.difference < 0) == (high.difference < 0)) {
+        result.value = std::fabs(low.difference) < std::fabs(high.difference) ? low.value : high.value;
+        return result;
+    }
+    result.bracketed = true;
+
+    for (int iteration = 0; iteration < options.maxIterations; iteration++) {
+        double width = high.value - low.value;
+        if (std::fabs(width) <= options.tolerance) {
+            result.converged = true;
+            break;
+        }
+
+        // Secant point, kept away from the ends so the bracket always shrinks by at least 10%.
+        double guess = high.value - high.difference * width / (high.difference - low.difference);
+        double margin = 0.1 * width;
+        guess = std::min(std::max(guess, low.value + margin), high.value - margin);
+
+        breakEvenStep mid = search.evaluate(guess);
+        if (!search.signResolved(mid)) {
+            // Indistinguishable from break-even even at maxTrials.
+            result.withinNoise = true;
+            result.low = low.value;
+            result.high = high.value;
+            result.value = mid.value;
+            return result;
+        }
+
+        if ((mid.difference < 0) == (low.difference < 0))
+            low = mid;
+        else
+            high = mid;
+    }
+
+    result.low = low.value;
+    result.high = high.value;
+    result.value = high.value - high.difference * (high.value - low.value) / (high.difference - low.difference);
+    return result;
+}
@@ -0,0 +1,65 @@
+/*
+    * breakeven.h
+    * This header file defines the break-even solver. It searches one simulationParams field for the
+    * value where buying and renting end with the same expected (or median) net worth, e.g. the
+    * rent above which owning wins.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "batch.h"
+
+enum breakEvenStatistic
+{
+    STAT_MEAN,  // mean final net worth
+    STAT_MEDIAN // median final net worth
+};
+
+struct breakEvenOptions
+{
+    std::string field = "startingRent"; // simulationParams member to solve for
+    double low = 0;
+    double high = 0;
+    double tolerance = 1;               // stop once the bracket is narrower than this
+    breakEvenStatistic statistic = STAT_MEAN;
+    long long minTrials = 2000;         // trials per side far from the root
+    long long maxTrials = 256000;       // trials per side once the root is within noise
+    int maxIterations = 60;
+};
+
+// One evaluation of owner - renter at value.
+struct breakEvenStep
+{
+    double value;
+    long long trials;
+    double difference; // owner - renter, in the chosen statistic
+    double stdError;
+};
+
+struct breakEvenResult
+{
+    bool bracketed;     // owner - renter changes sign between low and high
+    bool converged;     // the bracket shrank below tolerance
+    bool withinNoise;   // stopped on a point whose sign couldn't be told at maxTrials
+    double value;       // break-even estimate
+    double low;         // final bracket
+    double high;
+    long long totalTrials; // trials simulated, counting owner and renter separately
+    std::vector<breakEvenStep> steps;
+};
+
+// Bracketed secant search on owner - renter. Each evaluation runs owner and renter on the same
+// random streams (and the same streams at every value), so the objective is smooth in the field.
+// Evaluations start at minTrials and quadruple whenever the sign of the difference is within two
+// standard errors, so the extra precision is only spent next to the root. If the sign still
+// can't be told apart at maxTrials the search stops there with withinNoise set; running out of
+// maxIterations first leaves both converged and withinNoise false.
+//
+// For STAT_MEDIAN the difference is of exact medians, and its standard error comes from batch
+// means: the median difference of each of 20 contiguous groups of trials.
+breakEvenResult solveBreakEven(const simulationParams& base, const breakEvenOptions& options,
+                               const batchOptions& batch);
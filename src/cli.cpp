@@ -0,0 +1,1209 @@
+/*
+    * cli.cpp
+    * This source file implements the non-interactive command line modes of the simulator.
+    *
+    *   final-project batch [--trials N] [--threads N] [--seed N] [--years N] [--owner | --renter]
+    *                       [--kernel simd | scalar] [--policy POLICY] [--keep-home] [--csv FILE]
+    *                       [--economy [--economy-set NAME=VALUE ...] [--no-recessions]] [--history FILE]
+    *                       [--trajectory FILE [--interval MONTHS] [--encoding float64 | float32 | delta]]
+    *                       [--shard I/N] [--partial FILE] [--dashboard]
+    *   final-project merge FILE [FILE ...] [--csv FILE]
+    *   final-project shards --workers N [--shard-dir DIR] [batch options] [--csv FILE]
+    *   final-project trajectory --trajectory FILE [--month M] [--csv FILE [--paths N]]
+    *   final-project fork --at-month M [--at-month M ...] --branch "OPTIONS" [--branch ...]
+    *                      [batch options]
+    *   final-project trial --trial N [--seed N] [--years N] [--owner | --renter] [--policy POLICY]
+    *                       [--dashboard [--speed MONTHS_PER_SECOND]]
+    *   final-project scenarios --scenarios FILE [batch options] [--csv FILE]
+    *   final-project serve [--socket PATH] [--cache N] [batch options]
+    *   final-project compare [batch options]
+    *   final-project sensitivity [batch options]
+    *   final-project sweep --vary FIELD=START:STOP:STEP | FIELD=V1,V2,... [--vary ...]
+    *                       [batch options] [--csv FILE]
+    *   final-project history --history FILE [--save FILE]
+    *   final-project population [--households N] [--distribution FILE] [--price-impact X] [--rent-impact X]
+    *                            [--years N] [--threads N] [--seed N] [--csv FILE]
+    *   final-project deterministic [--vary FIELD=VALUES ...] [--check] [--policy POLICY] [--csv FILE]
+    *   final-project optimize [--max-bankruptcy PCT] [--population N] [--generations N] [batch options]
+    *   final-project breakeven --solve FIELD=LOW:HIGH [--tolerance X] [--median]
+    *                           [--min-trials N] [--max-trials N] [batch options]
+    *   final-project precision [--target networth | bankruptcy] [--tolerance X] [--confidence C]
+    *                           [--no-antithetic] [--no-control] [--max-trials N] [batch options]
+    *
+    * Any command also takes --set FIELD=VALUE to change a simulationParams field by name, and
+    * --profile / --profile-json FILE to report the profiler's counters and phase times (profile.h)
+    * when it's done.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "cli.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include "batch.h"
+#include "breakeven.h"
+#include "dashboard.h"
+#include "deterministic.h"
+#include "error-func.h"
+#include "fork.h"
+#include "history.h"
+#include "optimize.h"
+#include "population.h"
+#include "precision.h"
+#include "profile.h"
+#include "scenario-file.h"
+#include "sensitivity.h"
+#include "server.h"
+#include "shard.h"
+#include "sweep.h"
+#include "trajectory.h"
+
+namespace {
+
+void printUsage()
+{
+    std::cout << "Usage:" << std::endl;
+    std::cout << "  final-project                 interactive simulation" << std::endl;
+    std::cout << "  final-project batch [options] headless Monte Carlo batch" << std::endl;
+    std::cout << "  final-project trial [options] rerun one trial of a batch (--trial N)" << std::endl;
+    std::cout << "  final-project compare [options] buying against renting on the same trials" << std::endl;
+    std::cout << "  final-project sensitivity [options] rank the parameters by their effect on net worth" << std::endl;
+    std::cout << "  final-project sweep [options] run the batch over a grid of parameters" << std::endl;
+    std::cout << "  final-project scenarios [options] run the batch for every line of a scenario file" << std::endl;
+    std::cout << "  final-project population [options] many households in one market that their trades move" << std::endl;
+    std::cout << "  final-project history [options] summarise a market history file (--history FILE)" << std::endl;
+    std::cout << "  final-project deterministic [options] the scenario without randomness, in closed form" << std::endl;
+    std::cout << "  final-project optimize [options] search for the policy with the best median net worth" << std::endl;
+    std::cout << "  final-project breakeven [options] find where buying and renting end even" << std::endl;
+    std::cout << "  final-project precision [options] run until the estimate is within a tolerance" << std::endl;
+    std::cout << "  final-project trajectory [options] read a trajectory file written by batch" << std::endl;
+    std::cout << "  final-project fork [options]  branch every trial at a month into what-if variants" << std::endl;
+    std::cout << "  final-project serve [options] answer batch queries, one line of batch options each" << std::endl;
+    std::cout << "  final-project merge FILE...   combine the shard files of a sharded batch" << std::endl;
+    std::cout << "  final-project shards [options] run a batch as local worker processes and merge them" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Batch options:" << std::endl;
+    std::cout << "  --trials N    number of independent trials (default 100000)" << std::endl;
+    std::cout << "  --threads N   worker threads, 0 for every core (default 0)" << std::endl;
+    std::cout << "  --seed N      base random seed (default 1)" << std::endl;
+    std::cout << "  --years N     simulation duration in years (default 30)" << std::endl;
+    std::cout << "  --owner       simulate a homeowner (default)" << std::endl;
+    std::cout << "  --renter      simulate a renter" << std::endl;
+    std::cout << "  --kernel K    'simd' batched kernel (default) or 'scalar' one trial at a time" << std::endl;
+    std::cout << "  --policy P    monthly decisions: 'cover' sell ETF to cover shortfalls (default)," << std::endl;
+    std::cout << "                'invest:PCT' invest PCT% of take-home pay, 'emergency:N' keep N months" << std::endl;
+    std::cout << "                of outgoings in the bank and invest the rest" << std::endl;
+    std::cout << "  --keep-home   never sell the home" << std::endl;
+    std::cout << "  --sell-home   sell the home as soon as a buyer shows up" << std::endl;
+    std::cout << "  --sell-home-below X  put the home up for sale once the bank holds X or less (default 0)" << std::endl;
+    std::cout << "  --set F=V     set simulationParams field F (e.g. homePrice=450000)" << std::endl;
+    std::cout << "  --economy     run every trial in one of a set of generated economies with correlated" << std::endl;
+    std::cout << "                ETF, home and layoff moves and recessions (scalar kernel)" << std::endl;
+    std::cout << "  --economy-set S=V  change an economy setting, e.g. etfVolatility=18, paths=4096 or" << std::endl;
+    std::cout << "                etfLayoffCorrelation=-0.6 (see economy.h); implies --economy" << std::endl;
+    std::cout << "  --no-recessions    generated economies without recessions" << std::endl;
+    std::cout << "  --history FILE     bootstrap the economies from a CSV or binary market history instead" << std::endl;
+    std::cout << "                (see history.h); --economy-set blockMonths=N sets the mean run length" << std::endl;
+    std::cout << "  --save FILE        history: write the history in the binary form, which loads by mmap" << std::endl;
+    std::cout << "  --csv FILE    batch: write per-year mean/stddev/p5/p50/p95 of net worth, equity," << std::endl;
+    std::cout << "                bank and ETF balance to FILE; sweep, scenarios: write the results table" << std::endl;
+    std::cout << "  --trial N     trial index to rerun (trial command only)" << std::endl;
+    std::cout << "  --dashboard   batch, trial: show the run live in the terminal" << std::endl;
+    std::cout << "  --speed N     trial --dashboard: months simulated per second, 0 for no pacing (default 120)" << std::endl;
+    std::cout << "  --vary F=A:B:S or F=V1,V2,...  sweep field F over a range or list (sweep only)" << std::endl;
+    std::cout << "  --scenarios FILE  one scenario per line, CSV with a header or JSON objects (scenarios only)" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Trajectory options:" << std::endl;
+    std::cout << "  --trajectory FILE   batch: write every path to FILE; trajectory: the file to read" << std::endl;
+    std::cout << "  --interval N        months between stored states, dividing 12 (default 12)" << std::endl;
+    std::cout << "  --encoding E        'float64' (default), 'float32' or 'delta' (int32 cents)" << std::endl;
+    std::cout << "  --month M           trajectory: month to summarise (default the last stored)" << std::endl;
+    std::cout << "  --paths N           trajectory: only export the first N paths to --csv" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Shard options:" << std::endl;
+    std::cout << "  --shard I/N         batch: run only shard I of N of the trials (needs --partial)" << std::endl;
+    std::cout << "  --partial FILE      batch: save the unsummarised results to FILE for merge" << std::endl;
+    std::cout << "  --workers N         shards: worker processes, one shard each" << std::endl;
+    std::cout << "  --shard-dir DIR     shards: where the shard files and worker logs go (default shards)" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Population options:" << std::endl;
+    std::cout << "  --households N      households in the market (default 100000)" << std::endl;
+    std::cout << "  --distribution FILE CSV of households to draw from: income, age, optional savings and" << std::endl;
+    std::cout << "                      weight columns (default lognormal incomes around preTaxIncome)" << std::endl;
+    std::cout << "  --price-impact X    home price change per net buyer as a share of households (default 2)" << std::endl;
+    std::cout << "  --rent-impact X     rent change per net buyer as a share of households (default 1)" << std::endl;
+    std::cout << "  --csv FILE          write the yearly market and population table" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Deterministic options:" << std::endl;
+    std::cout << "  --vary F=...        evaluate a grid of scenarios and write one CSV row per point" << std::endl;
+    std::cout << "  --check             also step every scenario through the monthly engine and compare" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Optimize options:" << std::endl;
+    std::cout << "  --max-bankruptcy P  most bankruptcies allowed, in percent (default 5)" << std::endl;
+    std::cout << "  --population N      candidates per policy family and generation (default 32)" << std::endl;
+    std::cout << "  --generations N     most generations to run (default 15)" << std::endl;
+    std::cout << "  --trials N          trials per candidate (default 4000)" << std::endl;
+    std::cout << "  --policy P          search only P's family, starting from its settings" << std::endl;
+    std::cout << "  --keep-home         don't search the home sale trigger" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Break-even options:" << std::endl;
+    std::cout << "  --solve F=LOW:HIGH  field to solve for and the range to search" << std::endl;
+    std::cout << "  --tolerance X       stop once the range is narrower than X (default 1)" << std::endl;
+    std::cout << "  --median            compare median instead of mean final net worth" << std::endl;
+    std::cout << "  --min-trials N      trials per side far from the root (default 2000)" << std::endl;
+    std::cout << "  --max-trials N      trials per side close to the root (default 256000)" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Fork options:" << std::endl;
+    std::cout << "  --at-month M        month to fork at, repeatable; every trial is saved there once" << std::endl;
+    std::cout << "  --branch \"OPTIONS\"  options that change from the fork on, e.g. \"--sell-home\"," << std::endl;
+    std::cout << "                      \"--years 40\" or \"--policy invest:20 --set appreciationRate=2\"" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Server options:" << std::endl;
+    std::cout << "  --socket PATH       listen on a Unix socket instead of stdin/stdout" << std::endl;
+    std::cout << "  --cache N           results kept for repeat queries (default 4096)" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Precision options:" << std::endl;
+    std::cout << "  --target T          'networth' mean final net worth (default) or 'bankruptcy' rate" << std::endl;
+    std::cout << "  --tolerance X       stop once the confidence interval is +/- X (default 1000, or" << std::endl;
+    std::cout << "                      0.001 for bankruptcy)" << std::endl;
+    std::cout << "  --confidence C      confidence level of the interval (default 0.95)" << std::endl;
+    std::cout << "  --no-antithetic     don't run trials in mirrored pairs" << std::endl;
+    std::cout << "  --no-control        don't use control variates" << std::endl;
+    std::cout << "  --max-trials N      give up after N trials (default 10000000)" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Profiling (any command):" << std::endl;
+    std::cout << "  --profile           print the run's counters and time per phase at the end" << std::endl;
+    std::cout << "  --profile-json FILE write them to FILE as JSON" << std::endl;
+}
+
+// Reads the value following argv[i], advancing i. Returns false if it is missing or not a number.
+bool readNumber(int argc, char** argv, int& i, double& out)
+{
+    if (i + 1 >= argc || !is_float(argv[i + 1])) {
+        std::cout << "Expected a number after " << argv[i] << std::endl;
+        return false;
+    }
+    out = std::stod(argv[++i]);
+    return true;
+}
+
+// Everything the batch, trial and sweep commands accept.
+struct commandOptions
+{
+    simulationParams params;
+    batchOptions batch;
+    long long trialIndex = 0;
+    std::string csvPath;
+    std::vector<sweepAxis> axes;
+    breakEvenOptions breakEven;
+    bool solveSet = false;
+    precisionOptions precision;
+
+    std::vector<int> forkMonths;
+    std::vector<std::string> branches; // option strings, applied on top of the base options
+
+    std::string scenarioPath;
+    std::string savePath;
+
+    optimizeOptions optimize;
+    populationOptions population;
+    bool trialsSet = false;
+    bool check = false;
+    bool dashboard = false;
+    double monthsPerSecond = 120;
+
+    std::string socketPath;
+    long long cacheEntries = 4096;
+
+    shardSpec shard;
+    bool shardSet = false;
+    std::string partialPath;
+    int workers = 0;
+    std::string shardDirectory = "shards";
+
+    std::string trajectoryPath;
+    int trajectoryInterval = 12;
+    trajectoryEncoding encoding = ENCODING_FLOAT64;
+    int month = -1;
+    long long maxPaths = 0;
+
+    // Shared by breakeven and precision with different defaults; negative when not given.
+    double tolerance = -1;
+    long long maxTrials = -1;
+};
+
+// Applies argv[first, argc) on top of command. Returns false on an unknown option.
+bool applyCommandOptions(int argc, char** argv, int first, commandOptions& command)
+{
+    simulationParams& params = command.params;
+    batchOptions& options = command.batch;
+
+    for (int i = first; i < argc; i++) {
+        std::string arg = argv[i];
+        double value = 0;
+        if (arg == "--owner")
+            params.homeOwner = true;
+        else if (arg == "--renter")
+            params.homeOwner = false;
+        else if (arg == "--trials" && readNumber(argc, argv, i, value)) {
+            options.trials = (long long)value;
+            command.trialsSet = true;
+        }
+        else if (arg == "--threads" && readNumber(argc, argv, i, value))
+            options.threads = (int)value;
+        else if (arg == "--seed" && readNumber(argc, argv, i, value))
+            options.seed = (unsigned long long)value;
+        else if (arg == "--years" && readNumber(argc, argv, i, value))
+            params.simulationDuration = value;
+        else if (arg == "--kernel" && i + 1 < argc && std::string(argv[i + 1]) == "scalar" && ++i)
+            options.kernel = KERNEL_SCALAR;
+        else if (arg == "--kernel" && i + 1 < argc && std::string(argv[i + 1]) == "simd" && ++i)
+            options.kernel = KERNEL_SIMD;
+        else if (arg == "--policy" && i + 1 < argc) {
+            if (!parsePolicy(argv[++i], options.policy))
+                return false;
+        }
+        else if (arg == "--keep-home")
+            options.policy.keepHome = true;
+        else if (arg == "--sell-home")
+            options.policy.homeSaleTrigger = INFINITY;
+        else if (arg == "--sell-home-below" && readNumber(argc, argv, i, value))
+            options.policy.homeSaleTrigger = value;
+        else if (arg == "--at-month" && readNumber(argc, argv, i, value))
+            command.forkMonths.push_back((int)value);
+        else if (arg == "--branch" && i + 1 < argc)
+            command.branches.push_back(argv[++i]);
+        else if (arg == "--trial" && readNumber(argc, argv, i, value))
+            command.trialIndex = (long long)value;
+        else if (arg == "--csv" && i + 1 < argc)
+            command.csvPath = argv[++i];
+        else if (arg == "--set" && i + 1 < argc) {
+            std::string spec = argv[++i];
+            size_t equals = spec.find('=');
+            std::string name = spec.substr(0, equals);
+            std::string number = equals == std::string::npos ? "" : spec.substr(equals + 1);
+            if (!is_float(number) || !setParam(params, name, std::stod(number))) {
+                std::cout << "Expected --set FIELD=NUMBER with a simulationParams field, got " << spec << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--vary" && i + 1 < argc) {
+            sweepAxis axis;
+            if (!parseSweepAxis(argv[++i], axis))
+                return false;
+            command.axes.push_back(axis);
+        }
+        else if (arg == "--solve" && i + 1 < argc) {
+            std::string spec = argv[++i];
+            size_t equals = spec.find('=');
+            size_t colon = spec.find(':', equals == std::string::npos ? 0 : equals);
+            simulationParams probe = params;
+            if (equals == std::string::npos || colon == std::string::npos ||
+                !is_float(spec.substr(equals + 1, colon - equals - 1)) || !is_float(spec.substr(colon + 1)) ||
+                !setParam(probe, spec.substr(0, equals), 0)) {
+                std::cout << "Expected --solve FIELD=LOW:HIGH with a simulationParams field, got " << spec << std::endl;
+                return false;
+            }
+            command.breakEven.field = spec.substr(0, equals);
+            command.breakEven.low = std::stod(spec.substr(equals + 1, colon - equals - 1));
+            command.breakEven.high = std::stod(spec.substr(colon + 1));
+            command.solveSet = true;
+        }
+        else if (arg == "--tolerance" && readNumber(argc, argv, i, value))
+            command.tolerance = value;
+        else if (arg == "--median")
+            command.breakEven.statistic = STAT_MEDIAN;
+        else if (arg == "--min-trials" && readNumber(argc, argv, i, value))
+            command.breakEven.minTrials = (long long)value;
+        else if (arg == "--max-trials" && readNumber(argc, argv, i, value))
+            command.maxTrials = (long long)value;
+        else if (arg == "--target" && i + 1 < argc && std::string(argv[i + 1]) == "networth" && ++i)
+            command.precision.target = TARGET_NET_WORTH;
+        else if (arg == "--target" && i + 1 < argc && std::string(argv[i + 1]) == "bankruptcy" && ++i)
+            command.precision.target = TARGET_BANKRUPTCY;
+        else if (arg == "--confidence" && readNumber(argc, argv, i, value))
+            command.precision.confidence = value;
+        else if (arg == "--no-antithetic")
+            command.precision.antithetic = false;
+        else if (arg == "--no-control")
+            command.precision.controlVariates = false;
+        else if (arg == "--trajectory" && i + 1 < argc)
+            command.trajectoryPath = argv[++i];
+        else if (arg == "--scenarios" && i + 1 < argc)
+            command.scenarioPath = argv[++i];
+        else if (arg == "--interval" && readNumber(argc, argv, i, value))
+            command.trajectoryInterval = (int)value;
+        else if (arg == "--encoding" && i + 1 < argc) {
+            if (!parseTrajectoryEncoding(argv[++i], command.encoding))
+                return false;
+        }
+        else if (arg == "--month" && readNumber(argc, argv, i, value))
+            command.month = (int)value;
+        else if (arg == "--paths" && readNumber(argc, argv, i, value))
+            command.maxPaths = (long long)value;
+        else if (arg == "--economy")
+            options.economy.enabled = true;
+        else if (arg == "--economy-set" && i + 1 < argc) {
+            if (!parseEconomySetting(argv[++i], options.economy))
+                return false;
+        }
+        else if (arg == "--history" && i + 1 < argc) {
+            options.economy.enabled = true;
+            options.economy.history = argv[++i];
+        }
+        else if (arg == "--save" && i + 1 < argc)
+            command.savePath = argv[++i];
+        else if (arg == "--no-recessions")
+            options.economy.recessions = false;
+        else if (arg == "--socket" && i + 1 < argc)
+            command.socketPath = argv[++i];
+        else if (arg == "--cache" && readNumber(argc, argv, i, value))
+            command.cacheEntries = (long long)value;
+        else if (arg == "--population" && readNumber(argc, argv, i, value))
+            command.optimize.population = value;
+        else if (arg == "--generations" && readNumber(argc, argv, i, value))
+            command.optimize.generations = value;
+        else if (arg == "--max-bankruptcy" && readNumber(argc, argv, i, value))
+            command.optimize.maxBankruptcyRate = value / 100.0;
+        else if (arg == "--households" && readNumber(argc, argv, i, value))
+            command.population.households = (long long)value;
+        else if (arg == "--distribution" && i + 1 < argc)
+            command.population.distributionPath = argv[++i];
+        else if (arg == "--price-impact" && readNumber(argc, argv, i, value))
+            command.population.priceImpact = value;
+        else if (arg == "--rent-impact" && readNumber(argc, argv, i, value))
+            command.population.rentImpact = value;
+        else if (arg == "--dashboard")
+            command.dashboard = true;
+        else if (arg == "--speed" && readNumber(argc, argv, i, value))
+            command.monthsPerSecond = value;
+        else if (arg == "--check")
+            command.check = true;
+        else if (arg == "--shard" && i + 1 < argc) {
+            if (!parseShard(argv[++i], command.shard))
+                return false;
+            command.shardSet = true;
+        }
+        else if (arg == "--partial" && i + 1 < argc)
+            command.partialPath = argv[++i];
+        else if (arg == "--workers" && readNumber(argc, argv, i, value))
+            command.workers = (int)value;
+        else if (arg == "--shard-dir" && i + 1 < argc)
+            command.shardDirectory = argv[++i];
+        else {
+            std::cout << "Unknown option " << arg << std::endl;
+            printUsage();
+            return false;
+        }
+    }
+    return true;
+}
+
+// Prints why and returns false if params can't be simulated; label says which ones they are.
+bool validParams(const simulationParams& params, const std::string& label = "")
+{
+    std::string problem;
+    if (checkParams(params, problem))
+        return true;
+    std::cout << (label.empty() ? "" : label + ": ") << problem << std::endl;
+    return false;
+}
+
+// Parses the options shared by every command. Returns false on an unknown option or parameters
+// that can't be simulated.
+bool parseCommandOptions(int argc, char** argv, commandOptions& command)
+{
+    defaultParams(&command.params);
+    command.params.homeOwner = true;
+    return applyCommandOptions(argc, argv, 2, command) && validParams(command.params) &&
+           (!command.batch.economy.enabled || checkEconomy(command.batch.economy));
+}
+
+int runBatchCommand(int argc, char** argv)
+{
+    commandOptions command;
+    if (!parseCommandOptions(argc, argv, command))
+        return 1;
+
+    if (!command.batch.policy.isDefault())
+        std::cout << "Policy: " << describePolicy(command.batch.policy) << std::endl;
+    if (command.batch.economy.enabled) {
+        auto economy = economicScenarios(command.batch.economy, command.batch.seed, simulatedMonths(command.params));
+        std::cout << std::fixed << std::setprecision(1);
+        if (economy->historyMonths() > 0) {
+            std::cout << "Economy: " << economy->paths() << " paths bootstrapped from " << economy->historyMonths()
+                      << " months of " << command.batch.economy.history << " in runs of "
+                      << command.batch.economy.blockMonths << " months on average" << std::endl;
+        }
+        else {
+            std::cout << "Economy: " << economy->paths() << " generated paths, " << economy->recessionShare() * 100.0
+                      << "% of months in recession" << std::endl;
+        }
+    }
+
+    // A shard runs its own range of trials; without --shard, --partial saves the whole batch.
+    const batchOptions wholeBatch = command.batch;
+    if (command.shardSet && command.partialPath.empty()) {
+        std::cout << "--shard needs --partial FILE to save the shard's results to" << std::endl;
+        return 1;
+    }
+    if (!command.partialPath.empty()) {
+        if (!command.trajectoryPath.empty()) {
+            std::cout << "--trajectory can't be combined with --shard or --partial" << std::endl;
+            return 1;
+        }
+        command.batch = shardOptions(wholeBatch, command.shard);
+    }
+
+    TrajectoryWriter trajectory;
+    if (!command.trajectoryPath.empty()) {
+        if (!trajectory.open(command.trajectoryPath, command.params, command.batch.seed, command.batch.trials,
+                             command.batch.chunkSize, command.trajectoryInterval, command.encoding))
+            return 1;
+        command.batch.trajectory = &trajectory;
+    }
+
+    batchTotals totals;
+    batchResults results;
+    if (command.dashboard) {
+        if (!command.trajectoryPath.empty()) {
+            std::cout << "--trajectory can't be combined with --dashboard" << std::endl;
+            return 1;
+        }
+        Dashboard dashboard("Batch: " + std::to_string(command.batch.trials) + " trials");
+        dashboard.start();
+        results = runDashboardBatch(command.params, command.batch, dashboard, &totals);
+        dashboard.finish();
+    }
+    else {
+        results = runBatch(command.params, command.batch, &totals);
+    }
+    printBatchResults(results);
+
+    if (!command.trajectoryPath.empty() && !trajectory.close())
+        return 1;
+    if (!command.partialPath.empty() &&
+        !writeShardFile(command.partialPath, command.params, wholeBatch, command.shard, totals))
+        return 1;
+
+    if (!command.csvPath.empty() && !writeYearlyCSV(results, command.csvPath)) {
+        std::cout << "Could not write " << command.csvPath << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Reruns a single trial of a batch from its (seed, trial) stream; the result is bit-identical
+// to what that trial produced inside the batch.
+int runTrialCommand(int argc, char** argv)
+{
+    commandOptions command;
+    if (!parseCommandOptions(argc, argv, command))
+        return 1;
+
+    profileCount(COUNT_TRIALS);
+    trialResult r;
+    if (command.dashboard) {
+        Dashboard dashboard("Trial " + std::to_string(command.trialIndex) + " (seed " +
+                            std::to_string(command.batch.seed) + ")");
+        dashboard.start();
+        r = runDashboardTrial(command.params, command.batch, command.trialIndex, command.monthsPerSecond, dashboard);
+        dashboard.finish();
+    }
+    else {
+        RandomStream rng(command.batch.seed, command.trialIndex);
+        scenarioSchedule schedule = buildSchedule(command.params);
+        std::shared_ptr<const EconomicScenarios> economy;
+        if (command.batch.economy.enabled)
+            economy = economicScenarios(command.batch.economy, command.batch.seed, simulatedMonths(command.params));
+        withPolicy(command.batch.policy, [&](const auto& policy) {
+            r = simulateTrial(command.params, schedule, rng, policy, nullptr, 12,
+                              economy != nullptr ? economy->path(command.trialIndex) : nullptr);
+        });
+    }
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Trial " << command.trialIndex << " (seed " << command.batch.seed << ")" << std::endl;
+    std::cout << "Months Simulated: " << r.monthsSimulated << std::endl;
+    std::cout << "Bank Balance: $" << r.finalState.bankBalance << std::endl;
+    std::cout << "ETF Balance: $" << r.finalState.etfBalance << std::endl;
+    std::cout << "Home Value: $" << r.finalState.homeValue << std::endl;
+    std::cout << "Mortgage Balance: $" << r.finalState.mortgageBalance << std::endl;
+    std::cout << "Net Worth: $" << r.finalNetWorth << std::endl;
+    std::cout << "Bankrupt: " << (r.bankrupt ? "yes" : "no")
+              << ", Home Sold: " << (r.homeSold ? "yes" : "no") << std::endl;
+    return 0;
+}
+
+// Runs the scenario as an owner and as a renter on the same trials and reports the difference.
+int runCompareCommand(int argc, char** argv)
+{
+    commandOptions command;
+    if (!parseCommandOptions(argc, argv, command))
+        return 1;
+
+    simulationParams owner = command.params, renter = command.params;
+    owner.homeOwner = true;
+    renter.homeOwner = false;
+    pairedResults result = runPaired(owner, renter, command.batch);
+    if (result.first.trials <= 0)
+        return 1;
+
+    // What the interval would be with the two sides drawn independently.
+    double unpairedError = std::sqrt((result.first.stddevNetWorth * result.first.stddevNetWorth +
+                                      result.second.stddevNetWorth * result.second.stddevNetWorth) /
+                                     result.first.trials);
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "--------------------------------" << std::endl;
+    std::cout << "Paired trials: " << result.first.trials << std::endl;
+    std::cout << "Owner:  mean $" << result.first.meanNetWorth << ", median $" << result.first.p50NetWorth
+              << ", bankrupt " << result.first.bankruptcyRate * 100.0 << "%" << std::endl;
+    std::cout << "Renter: mean $" << result.second.meanNetWorth << ", median $" << result.second.p50NetWorth
+              << ", bankrupt " << result.second.bankruptcyRate * 100.0 << "%" << std::endl;
+    std::cout << "--------------------------------" << std::endl;
+    std::cout << "Owner - renter: $" << result.meanDifference << " +/- $" << 1.96 * result.differenceStdError
+              << " (95%; unpaired +/- $" << 1.96 * unpairedError << ")" << std::endl;
+    std::cout << "P5 / P50 / P95 difference: $" << result.difference.p5 << " / $" << result.difference.p50
+              << " / $" << result.difference.p95 << std::endl;
+    std::cout << "Owning ends ahead in " << result.firstWinRate * 100.0 << "% of trials" << std::endl;
+    std::cout << "Elapsed: " << result.first.elapsedSeconds << "s (" << result.first.trialsPerSecond / 2
+              << " pairs/sec)" << std::endl;
+    std::cout << "--------------------------------" << std::endl;
+    return 0;
+}
+
+// Prints and optionally exports the merged results of the shard files at paths.
+int mergeShardFiles(const std::vector<std::string>& paths, const std::string& csvPath)
+{
+    std::vector<shardFile> shards(paths.size());
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (!readShardFile(paths[i], shards[i]))
+            return 1;
+    }
+    batchTotals totals;
+    if (!mergeShards(shards, totals))
+        return 1;
+
+    std::cout << "Merged " << shards.size() << " shard(s)" << std::endl;
+    batchResults results = summarizeTotals(totals);
+    printBatchResults(results);
+
+    if (!csvPath.empty() && !writeYearlyCSV(results, csvPath)) {
+        std::cout << "Could not write " << csvPath << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Combines the shard files named on the command line into the results of the whole batch.
+int runMergeCommand(int argc, char** argv)
+{
+    std::vector<std::string> paths;
+    std::string csvPath;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--csv" && i + 1 < argc)
+            csvPath = argv[++i];
+        else if (arg.rfind("--", 0) == 0) {
+            std::cout << "Unknown option " << arg << std::endl;
+            printUsage();
+            return 1;
+        }
+        else
+            paths.push_back(arg);
+    }
+    return mergeShardFiles(paths, csvPath);
+}
+
+// Runs a batch as --workers local processes, one shard each, and merges their shard files.
+int runShardsCommand(int argc, char** argv)
+{
+    commandOptions command;
+    if (!parseCommandOptions(argc, argv, command))
+        return 1;
+    if (command.workers <= 0) {
+        std::cout << "shards needs --workers N" << std::endl;
+        return 1;
+    }
+    if (command.shardSet || !command.partialPath.empty() || !command.trajectoryPath.empty()) {
+        std::cout << "shards picks the shards itself; --shard, --partial and --trajectory don't apply" << std::endl;
+        return 1;
+    }
+
+    // Workers get every batch option except the ones only the coordinator uses.
+    std::vector<std::string> batchArgs;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--workers" || arg == "--shard-dir" || arg == "--csv")
+            i++;
+        else
+            batchArgs.push_back(arg);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> files;
+    if (!runShardWorkers(argv[0], batchArgs, command.workers, command.shardDirectory, files))
+        return 1;
+    auto stop = std::chrono::steady_clock::now();
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Workers finished in " << std::chrono::duration<double>(stop - start).count() << "s" << std::endl;
+    return mergeShardFiles(files, command.csvPath);
+}
+
+int runSensitivityCommand(int argc, char** argv)
+{
+    commandOptions command;
+    if (!parseCommandOptions(argc, argv, command))
+        return 1;
+
+    sensitivityResults results = runSensitivity(command.params, command.batch);
+    printSensitivityResults(results);
+    return 0;
+}
+
+int runSweepCommand(int argc, char** argv)
+{
+    commandOptions command;
+    if (!parseCommandOptions(argc, argv, command))
+        return 1;
+    if (command.axes.empty()) {
+        std::cout << "sweep needs at least one --vary FIELD=VALUES" << std::endl;
+        return 1;
+    }
+    std::vector<double> point;
+    for (size_t n = 0; n < sweepPoints(command.axes); n++) {
+        simulationParams params = sweepPoint(command.params, command.axes, n, point);
+        std::ostringstream label;
+        label << "Grid point";
+        for (size_t a = 0; a < command.axes.size(); a++)
+            label << " " << command.axes[a].field << "=" << point[a];
+        if (!validParams(params, label.str()))
+            return 1;
+    }
+
+    std::vector<sweepResult> results = runSweep(command.params, command.axes, command.batch);
+
+    if (command.csvPath.empty()) {
+        writeSweepCSV(std::cout, command.axes, results);
+    }
+    else {
+        std::ofstream out(command.csvPath);
+        writeSweepCSV(out, command.axes, results);
+        if (!out) {
+            std::cout << "Could not write " << command.csvPath << std::endl;
+            return 1;
+        }
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << "Wrote " << results.size() << " grid points to " << command.csvPath << " in "
+                  << results[0].results.elapsedSeconds << "s ("
+                  << results[0].results.trialsPerSecond << " trials/sec)" << std::endl;
+    }
+    return 0;
+}
+
+// Loads a history file and reports its averages, optionally saving it in the binary form.
+int runHistoryCommand(int argc, char** argv)
+{
+    commandOptions command;
+    if (!parseCommandOptions(argc, argv, command))
+        return 1;
+    if (command.batch.economy.history.empty()) {
+        std::cout << "history needs --history FILE" << std::endl;
+        return 1;
+    }
+
+    // Read on its own rather than through loadHistory, which has it cached already.
+    HistoricalSeries history;
+    auto start = std::chrono::steady_clock::now();
+    bool loaded = history.open(command.batch.economy.history);
+    auto stop = std::chrono::steady_clock::now();
+    if (!loaded)
+        return 1;
+
+    auto annual = [](double monthly) { return (std::pow(monthly, 12) - 1) * 100.0; };
+    const historySummary& s = history.summary();
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "--------------------------------" << std::endl;
+    std::cout << "Months: " << history.months() << " (" << (history.mapped() ? "mapped" : "parsed") << " in "
+              << std::chrono::duration<double, std::milli>(stop - start).count() << "ms)" << std::endl;
+    std::cout << std::setprecision(2);
+    std::cout << "ETF: " << annual(s.etfGrowth) << "% a year, volatility " << s.etfVolatility << "%" << std::endl;
+    std::cout << "Home prices: " << annual(s.homeGrowth) << "% a year, volatility " << s.homeVolatility << "%"
+              << std::endl;
+    std::cout << "Rent: " << annual(s.rentGrowth) << "% a year, volatility " << s.rentVolatility << "%" << std::endl;
+    std::cout << "Unemployment: " << s.unemployment << "% on average" << std::endl;
+    std::cout << "--------------------------------" << std::endl;
+
+    if (!command.savePath.empty()) {
+        if (!saveHistory(command.savePath, history))
+            return 1;
+        std::cout << "Wrote " << command.savePath << std::endl;
+    }
+    return 0;
+}
+
+// Evaluates the deterministic model in closed form: one scenario as a yearly table, or with
+// --vary a grid of them as CSV. --check steps every evaluation through the engine as well.
+int runDeterministicCommand(int argc, char** argv)
+{
+    const double TOLERANCE = 1e-9;
+
+    commandOptions command;
+    if (!parseCommandOptions(argc, argv, command))
+        return 1;
+
+    if (command.axes.empty()) {
+        deterministicResult result = evaluateDeterministic(command.params, command.batch.policy);
+        if (!command.batch.policy.isDefault())
+            std::cout << "Policy: " << describePolicy(command.batch.policy) << std::endl;
+        printDeterministicResult(result);
+        if (!command.check)
+            return 0;
+
+        double difference = deterministicDifference(result, stepDeterministic(command.params, command.batch.policy));
+        std::cout << std::scientific << std::setprecision(2);
+        std::cout << "Stepped engine: max relative difference " << difference << " (" << result.steppedYears
+                  << " of " << result.years.size() << " years stepped)" << std::endl;
+        return difference <= TOLERANCE ? 0 : 1;
+    }
+
+    ThreadPool pool(command.batch.threads);
+    deterministicSweepSummary summary;
+    if (command.csvPath.empty()) {
+        summary = runDeterministicSweep(command.params, command.axes, command.batch.policy, pool, command.check,
+                                        std::cout);
+    }
+    else {
+        std::ofstream out(command.csvPath);
+        summary = runDeterministicSweep(command.params, command.axes, command.batch.policy, pool, command.check, out);
+        if (!out) {
+            std::cout << "Could not write " << command.csvPath << std::endl;
+            return 1;
+        }
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << "Wrote " << summary.points << " grid points to " << command.csvPath << " in "
+                  << summary.elapsedSeconds << "s (" << summary.points / summary.elapsedSeconds << " points/sec)"
+                  << std::endl;
+        if (command.check) {
+            std::cout << std::scientific << std::setprecision(2);
+            std::cout << "Stepped engine: max relative difference " << summary.maxDifference << std::endl;
+        }
+    }
+    return command.check && summary.maxDifference > TOLERANCE ? 1 : 0;
+}
+
+int runOptimizeCommand(int argc, char** argv)
+{
+    commandOptions command;
+    if (!parseCommandOptions(argc, argv, command))
+        return 1;
+    // Every candidate of every generation runs the batch, so it defaults to far fewer trials.
+    if (!command.trialsSet)
+        command.batch.trials = 4000;
+
+    optimizeResults results = optimizePolicy(command.params, command.optimize, command.batch);
+    printOptimizeResults(results, command.optimize);
+    return results.feasible ? 0 : 1;
+}
+
+int runPopulationCommand(int argc, char** argv)
+{
+    commandOptions command;
+    if (!parseCommandOptions(argc, argv, command))
+        return 1;
+
+    populationOptions& options = command.population;
+    options.threads = command.batch.threads;
+    options.seed = command.batch.seed;
+    populationResults results;
+    if (!runPopulation(command.params, options, results))
+        return 1;
+    printPopulationResults(results);
+
+    if (!command.csvPath.empty() && !writePopulationCSV(results, command.csvPath)) {
+        std::cout << "Could not write " << command.csvPath << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int runBreakEvenCommand(int argc, char** argv)
+{
+    commandOptions command;
+    if (!parseCommandOptions(argc, argv, command))
+        return 1;
+    if (!command.solveSet) {
+        std::cout << "breakeven needs --solve FIELD=LOW:HIGH" << std::endl;
+        return 1;
+    }
+
+    breakEvenOptions& options = command.breakEven;
+    for (double end : {options.low, options.high}) {
+        simulationParams params = command.params;
+        setParam(params, options.field, end);
+        std::ostringstream label;
+        label << options.field << " = " << end;
+        if (!validParams(params, label.str()))
+            return 1;
+    }
+    if (command.tolerance >= 0)
+        options.tolerance = command.tolerance;
+    if (command.maxTrials >= 0)
+        options.maxTrials = command.maxTrials;
+    breakEvenResult result = solveBreakEven(command.params, options, command.batch);
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "--------------------------------" << std::endl;
+    for (const breakEvenStep& step : result.steps) {
+        std::cout << options.field << " = " << step.value << ": owner - renter = $" << step.difference
+                  << " +/- $" << step.stdError << " (" << step.trials << " trials)" << std::endl;
+    }
+    std::cout << "--------------------------------" << std::endl;
+
+    if (!result.bracketed) {
+        std::cout << "Owner - renter has the same sign at both ends of " << options.field << " = "
+                  << options.low << ":" << options.high << "; no break-even in range." << std::endl;
+        return 1;
+    }
+
+    std::cout << "Break-even " << options.field << ": " << result.value
+              << " (between " << result.low << " and " << result.high << ")" << std::endl;
+    if (result.withinNoise)
+        std::cout << "Stopped early: the difference is within noise at " << options.maxTrials << " trials." << std::endl;
+    else if (!result.converged)
+        std::cout << "Stopped after " << options.maxIterations << " iterations without narrowing to "
+                  << options.tolerance << "." << std::endl;
+
+    // A sweep at the same resolution and precision would need every point at maxTrials.
+    double gridPoints = std::floor((options.high - options.low) / options.tolerance) + 1;
+    std::cout << "Trials simulated: " << result.totalTrials << " (a sweep at the same resolution: "
+              << std::setprecision(0) << gridPoints * 2 * options.maxTrials << ")" << std::endl;
+    std::cout << "--------------------------------" << std::endl;
+    return 0;
+}
+
+// Runs every scenario of a scenario file and writes one CSV row of results per scenario.
+int runScenariosCommand(int argc, char** argv)
+{
+    commandOptions command;
+    if (!parseCommandOptions(argc, argv, command))
+        return 1;
+    if (command.scenarioPath.empty()) {
+        std::cout << "scenarios needs --scenarios FILE" << std::endl;
+        return 1;
+    }
+
+    scenarioFileSummary summary;
+    if (command.csvPath.empty()) {
+        if (!runScenarioFile(command.scenarioPath, command.params, command.batch, std::cout, summary))
+            return 1;
+    }
+    else {
+        std::ofstream out(command.csvPath);
+        if (!runScenarioFile(command.scenarioPath, command.params, command.batch, out, summary))
+            return 1;
+        if (!out) {
+            std::cout << "Could not write " << command.csvPath << std::endl;
+            return 1;
+        }
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << "Wrote " << summary.scenarios << " scenarios to " << command.csvPath << " in "
+                  << summary.elapsedSeconds << "s" << std::endl;
+    }
+
+    // Every good line has run; a bad one still fails the command so scripts notice.
+    if (summary.badLines > 0) {
+        std::cout << summary.badLines << " line(s) of " << command.scenarioPath << " skipped" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Answers batch queries, one line of batch options each, until stdin ends or a client sends
+// "shutdown". Options on the command line are the defaults every query starts from.
+int runServeCommand(int argc, char** argv)
+{
+    commandOptions base;
+    if (!parseCommandOptions(argc, argv, base))
+        return 1;
+
+    QueryServer server(base.batch.threads, (size_t)std::max(0LL, base.cacheEntries));
+    queryHandler handler = [&](const std::string& line) -> std::string {
+        std::istringstream words(line);
+        std::vector<std::string> args(std::istream_iterator<std::string>(words), {});
+        if (args.empty())
+            return formatQueryError("empty query");
+        if (args[0] == "quit")
+            return "";
+        if (args[0] == "shutdown")
+            return SHUTDOWN_RESPONSE;
+        if (args[0] == "stats") {
+            const ResultCache& cache = server.results();
+            return "{\"ok\": true, \"entries\": " + std::to_string(cache.size()) + ", \"hits\": " +
+                   std::to_string(cache.hits) + ", \"misses\": " + std::to_string(cache.misses) + "}";
+        }
+
+        std::vector<char*> argvQuery;
+        for (std::string& arg : args)
+            argvQuery.push_back(&arg[0]);
+
+        // Parse errors are printed; catch them for the response instead of the output stream. The
+        // economy is checked (and its history loaded) here too, so those problems are caught as well.
+        commandOptions query = base;
+        std::ostringstream messages;
+        std::streambuf* output = std::cout.rdbuf(messages.rdbuf());
+        bool parsed = applyCommandOptions((int)argvQuery.size(), argvQuery.data(), 0, query) &&
+                      (!query.batch.economy.enabled || checkEconomy(query.batch.economy));
+        std::cout.rdbuf(output);
+        if (!parsed) {
+            std::string message = messages.str();
+            return formatQueryError(message.substr(0, message.find('\n')));
+        }
+        std::string problem;
+        if (!checkParams(query.params, problem))
+            return formatQueryError(problem);
+        if (query.batch.trials <= 0)
+            return formatQueryError("--trials must be at least 1");
+        if ((double)query.batch.trials * simulatedMonths(query.params) > MAX_QUERY_MONTHS)
+            return formatQueryError("too many trials for one query: trials x months must be at most " +
+                                    std::to_string((long long)MAX_QUERY_MONTHS));
+
+        // A query that fails anyway (e.g. runs out of memory) mustn't take the server down.
+        try {
+            auto start = std::chrono::steady_clock::now();
+            bool cached;
+            batchResults results = server.run(query.params, query.batch, cached);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return formatQueryResponse(results, cached, seconds);
+        }
+        catch (const std::exception& e) {
+            return formatQueryError(std::string("the query failed: ") + e.what());
+        }
+    };
+
+    if (base.socketPath.empty()) {
+        serveStream(std::cin, std::cout, handler);
+        return 0;
+    }
+    return serveSocket(base.socketPath, handler) ? 0 : 1;
+}
+
+// Summarises one month of a trajectory file across every path, and optionally exports it as CSV.
+int runTrajectoryCommand(int argc, char** argv)
+{
+    commandOptions command;
+    if (!parseCommandOptions(argc, argv, command))
+        return 1;
+    if (command.trajectoryPath.empty()) {
+        std::cout << "trajectory needs --trajectory FILE" << std::endl;
+        return 1;
+    }
+
+    TrajectoryReader reader;
+    if (!reader.open(command.trajectoryPath))
+        return 1;
+    const trajectoryHeader& header = reader.info();
+
+    int lastMonth = (reader.steps() - 1) * header.interval;
+    int month = command.month < 0 ? lastMonth : command.month;
+    if (month > lastMonth || month % header.interval != 0) {
+        std::cout << "Month " << month << " is not stored; " << command.trajectoryPath << " holds every "
+                  << header.interval << " months up to " << lastMonth << std::endl;
+        return 1;
+    }
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "--------------------------------" << std::endl;
+    std::cout << "Paths: " << reader.paths() << " (seed " << header.seed << ", "
+              << (header.params.homeOwner ? "owner" : "renter") << ")" << std::endl;
+    std::cout << "Steps: " << reader.steps() << " every " << header.interval << " months" << std::endl;
+    std::cout << "Month " << month << ":" << std::endl;
+
+    std::vector<double> values;
+    for (int field = 0; field < TRAJECTORY_FIELDS; field++) {
+        reader.stepValues(field, month / header.interval, values);
+        double sum = 0;
+        for (double v : values)
+            sum += v;
+        auto percentile = [&](double q) {
+            size_t rank = (size_t)(q * (values.size() - 1));
+            std::nth_element(values.begin(), values.begin() + rank, values.end());
+            return values[rank];
+        };
+        std::cout << "  " << trajectoryFieldName(field) << ": mean $" << sum / values.size()
+                  << ", p5 / p50 / p95 $" << percentile(0.05) << " / $" << percentile(0.50)
+                  << " / $" << percentile(0.95) << std::endl;
+    }
+    std::cout << "--------------------------------" << std::endl;
+
+    if (!command.csvPath.empty()) {
+        std::ofstream out(command.csvPath);
+        if (!writeTrajectoryCSV(reader, out, command.maxPaths)) {
+            std::cout << "Could not write " << command.csvPath << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Forks every trial of the base scenario at the --at-month points into the --branch variants.
+int runForkCommand(int argc, char** argv)
+{
+    commandOptions command;
+    if (!parseCommandOptions(argc, argv, command))
+        return 1;
+    if (command.forkMonths.empty() || command.branches.empty()) {
+        std::cout << "fork needs at least one --at-month M and one --branch \"OPTIONS\"" << std::endl;
+        return 1;
+    }
+    for (int month : command.forkMonths) {
+        if (month < 0 || month > simulatedMonths(command.params)) {
+            std::cout << "--at-month " << month << " is outside the base run" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<forkBranch> branches;
+    for (const std::string& spec : command.branches) {
+        std::istringstream words(spec);
+        std::vector<std::string> args(std::istream_iterator<std::string>(words), {});
+        std::vector<char*> argvBranch;
+        for (std::string& arg : args)
+            argvBranch.push_back(&arg[0]);
+
+        commandOptions branchCommand = command;
+        if (!applyCommandOptions((int)argvBranch.size(), argvBranch.data(), 0, branchCommand) ||
+            !validParams(branchCommand.params, "Branch \"" + spec + "\""))
+            return 1;
+        std::string fixed = purchaseFieldChanged(command.params, branchCommand.params);
+        if (!fixed.empty()) {
+            std::cout << "Branch \"" << spec << "\" changes " << fixed
+                      << ", which is settled when the home is bought and can't change at the fork" << std::endl;
+            return 1;
+        }
+        branches.push_back({args.empty() ? "unchanged" : spec, branchCommand.params, branchCommand.batch.policy});
+    }
+
+    forkResults results = runFork(command.params, command.forkMonths, branches, command.batch);
+    printForkResults(results);
+    return 0;
+}
+
+int runPrecisionCommand(int argc, char** argv)
+{
+    commandOptions command;
+    if (!parseCommandOptions(argc, argv, command))
+        return 1;
+
+    precisionOptions& options = command.precision;
+    if (options.target == TARGET_BANKRUPTCY)
+        options.tolerance = 0.001;
+    if (command.tolerance >= 0)
+        options.tolerance = command.tolerance;
+    if (command.maxTrials >= 0)
+        options.maxTrials = command.maxTrials;
+
+    precisionResults results = runToPrecision(command.params, options, command.batch);
+    printPrecisionResults(results, options);
+    return results.converged ? 0 : 1;
+}
+
+int dispatchCommand(int argc, char** argv)
+{
+    std::string command = argv[1];
+    if (command == "batch")
+        return runBatchCommand(argc, argv);
+    if (command == "trial")
+        return runTrialCommand(argc, argv);
+    if (command == "sweep")
+        return runSweepCommand(argc, argv);
+    if (command == "population")
+        return runPopulationCommand(argc, argv);
+    if (command == "history")
+        return runHistoryCommand(argc, argv);
+    if (command == "deterministic")
+        return runDeterministicCommand(argc, argv);
+    if (command == "optimize")
+        return runOptimizeCommand(argc, argv);
+    if (command == "breakeven")
+        return runBreakEvenCommand(argc, argv);
+    if (command == "precision")
+        return runPrecisionCommand(argc, argv);
+    if (command == "trajectory")
+        return runTrajectoryCommand(argc, argv);
+    if (command == "fork")
+        return runForkCommand(argc, argv);
+    if (command == "scenarios")
+        return runScenariosCommand(argc, argv);
+    if (command == "serve")
+        return runServeCommand(argc, argv);
+    if (command == "compare")
+        return runCompareCommand(argc, argv);
+    if (command == "sensitivity")
+        return runSensitivityCommand(argc, argv);
+    if (command == "merge")
+        return runMergeCommand(argc, argv);
+    if (command == "shards")
+        return runShardsCommand(argc, argv);
+
+    printUsage();
+    return command == "help" || command == "--help" ? 0 : 1;
+}
+
+// Takes --profile and --profile-json FILE out of argv, wherever they are, so every command
+// accepts them. Returns false if --profile-json has no file.
+bool takeProfileOptions(int& argc, char** argv, bool& print, std::string& jsonPath)
+{
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--profile")
+            print = true;
+        else if (arg == "--profile-json") {
+            if (i + 1 >= argc) {
+                std::cout << "Expected a file after --profile-json" << std::endl;
+                return false;
+            }
+            jsonPath = argv[++i];
+        }
+        else
+            argv[kept++] = argv[i];
+    }
+    argc = kept;
+    return true;
+}
+
+}
+
+int runCommand(int argc, char** argv)
+{
+    bool printReport = false;
+    std::string jsonPath;
+    if (!takeProfileOptions(argc, argv, printReport, jsonPath))
+        return 1;
+    if (argc < 2) {
+        printUsage();
+        return 1;
+    }
+    if (!printReport && jsonPath.empty())
+        return dispatchCommand(argc, argv);
+
+    startProfile();
+    int code = dispatchCommand(argc, argv);
+    profileReport report = collectProfile();
+    if (printReport)
+        printProfile(report);
+    if (!jsonPath.empty() && !writeProfileJSON(report, jsonPath)) {
+        std::cout << "Could not write " << jsonPath << std::endl;
+        return 1;
+    }
+    return code;
+}
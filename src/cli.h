@@ -0,0 +1,11 @@
+/*
+    * cli.h
+    * This header file defines the non-interactive command line modes of the simulator.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+// Runs the command named by argv[1]. Returns the process exit code.
+int runCommand(int argc, char** argv);
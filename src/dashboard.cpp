@@ -0,0 +1,256 @@
+/*
+    * dashboard.cpp
+    * This source file implements the live terminal dashboard and the runs that feed it.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "dashboard.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include "economy.h"
+#include "policy.h"
+
+namespace {
+
+const int BAR_WIDTH = 30;
+
+// Rounds per batch run at least, so the view moves along even for short batches.
+const long long MIN_ROUNDS = 100;
+
+const char* const CLEAR_LINE = "\x1b[K";
+const char* const HIDE_CURSOR = "\x1b[?25l";
+const char* const SHOW_CURSOR = "\x1b[?25h";
+
+std::string progressBar(double share)
+{
+    share = std::min(1.0, std::max(0.0, share));
+    int filled = (int)(share * BAR_WIDTH);
+    return "[" + std::string(filled, '#') + std::string(BAR_WIDTH - filled, '.') + "]";
+}
+
+}
+
+Dashboard::Dashboard(const std::string& title, double framesPerSecond)
+    : title(title), framesPerSecond(framesPerSecond > 0 ? framesPerSecond : 20) {}
+
+Dashboard::~Dashboard()
+{
+    finish();
+}
+
+void Dashboard::start()
+{
+    if (renderer.joinable())
+        return;
+    stopping.store(false);
+    renderer = std::thread([this] { renderLoop(); });
+}
+
+void Dashboard::finish()
+{
+    if (!renderer.joinable())
+        return;
+    stopping.store(true, std::memory_order_release);
+    renderer.join();
+}
+
+void Dashboard::renderLoop()
+{
+    const auto period = std::chrono::duration<double>(1.0 / framesPerSecond);
+    dashboardFrame frame = {};
+    int drawnLines = 0;
+
+    std::cout << HIDE_CURSOR;
+    std::cout.flush();
+    while (true) {
+        // Anything published before finish() is readable by the time stopping reads true.
+        bool last = stopping.load(std::memory_order_acquire);
+        if (latest.read(frame)) {
+            // Back to the top of the previous frame and over it, one write for the whole frame.
+            std::string text = draw(frame);
+            std::string out;
+            if (drawnLines > 0)
+                out = "\x1b[" + std::to_string(drawnLines) + "F";
+            out += text;
+            drawnLines = std::count(text.begin(), text.end(), '\n');
+            std::cout.write(out.data(), out.size());
+            std::cout.flush();
+        }
+        if (last)
+            break;
+        std::this_thread::sleep_for(period);
+    }
+    std::cout << SHOW_CURSOR;
+    std::cout.flush();
+}
+
+std::string Dashboard::draw(const dashboardFrame& f) const
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    auto line = [&out]() { out << CLEAR_LINE << '\n'; };
+
+    out << title;
+    line();
+    out << "--------------------------------";
+    line();
+    if (f.batch) {
+        double share = f.totalTrials > 0 ? (double)f.trials / f.totalTrials : 0;
+        out << "Trials " << f.trials << " / " << f.totalTrials << " " << progressBar(share) << " "
+            << std::setprecision(0) << share * 100.0 << "%" << std::setprecision(2);
+        line();
+        out << "Final Net Worth so far: mean $" << f.meanNetWorth;
+        line();
+        out << "p5 / p50 / p95: $" << f.p5NetWorth << " / $" << f.p50NetWorth << " / $" << f.p95NetWorth;
+        line();
+        double trials = std::max(1LL, f.trials);
+        out << "Bankrupt: " << f.bankruptcies * 100.0 / trials << "%, Home Sold: " << f.homeSales * 100.0 / trials
+            << "%";
+        line();
+        out << "Elapsed: " << f.elapsedSeconds << "s ("
+            << (f.elapsedSeconds > 0 ? f.trials / f.elapsedSeconds : 0) << " trials/sec)";
+        line();
+    }
+    else {
+        double share = f.months > 0 ? (double)f.month / f.months : 0;
+        if (f.month == 0)
+            out << "Starting state       ";
+        else
+            out << "Year " << std::setw(3) << (f.month - 1) / 12 + 1 << ", Month " << std::setw(2) << (f.month - 1) % 12 + 1;
+        out << " " << progressBar(share) << " " << f.month << " / " << f.months << " months";
+        line();
+        out << "Bank Balance:     $" << f.bankBalance;
+        line();
+        out << "ETF Balance:      $" << f.etfBalance;
+        line();
+        out << "Home Value:       $" << f.homeValue;
+        line();
+        out << "Mortgage Balance: $" << f.mortgageBalance;
+        line();
+        out << "Total Equity:     $" << f.equity;
+        line();
+        out << "Net Worth:        $" << f.netWorth;
+        line();
+        out << (f.employed ? "Employed" : "Unemployed") << ", " << (f.homeOwner ? "homeowner" : "renting");
+        line();
+        out << "Layoffs: " << f.layoffs << ", Rehires: " << f.rehires << ", Home Sold: " << f.homeSales
+            << ", Bankrupt: " << f.bankruptcies;
+        line();
+    }
+    out << "--------------------------------";
+    line();
+    return out.str();
+}
+
+trialResult runDashboardTrial(const simulationParams& params, const batchOptions& options, long long trial,
+                              double monthsPerSecond, Dashboard& dashboard)
+{
+    scenarioSchedule schedule = buildSchedule(params);
+    std::shared_ptr<const EconomicScenarios> economy;
+    if (options.economy.enabled)
+        economy = economicScenarios(options.economy, options.seed, simulatedMonths(params));
+
+    trialResult result;
+    withPolicy(options.policy, [&](const auto& policy) {
+        using Policy = std::decay_t<decltype(policy)>;
+        Simulation<Policy> sim(params, schedule, RandomStream(options.seed, trial), policy);
+        if (economy != nullptr)
+            sim.useEconomy(economy->path(trial));
+
+        dashboardFrame frame = {};
+        frame.months = sim.months();
+        auto start = std::chrono::steady_clock::now();
+        while (true) {
+            const Person& p = sim.person();
+            frame.month = sim.month();
+            frame.bankBalance = p.bankBalance;
+            frame.etfBalance = p.etfBalance;
+            frame.homeValue = p.homeValue;
+            frame.mortgageBalance = p.mortgageBalance;
+            frame.equity = p.totalEquity;
+            frame.netWorth = netWorth(p);
+            frame.employed = p.employed;
+            frame.homeOwner = p.homeOwner;
+            frame.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            dashboard.publish(frame);
+            if (sim.finished())
+                break;
+
+            int events = sim.step();
+            frame.layoffs += (events & EVENT_UNEMPLOYED) != 0;
+            frame.rehires += (events & EVENT_REHIRED) != 0;
+            frame.homeSales += (events & EVENT_HOME_SOLD) != 0;
+            frame.bankruptcies += (events & EVENT_BANKRUPT) != 0;
+            if (monthsPerSecond > 0)
+                std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                         std::chrono::duration<double>(sim.month() / monthsPerSecond)));
+        }
+        result = sim.result();
+    });
+    return result;
+}
+
+batchResults runDashboardBatch(const simulationParams& params, const batchOptions& options, Dashboard& dashboard,
+                               batchTotals* totals)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::unique_ptr<ThreadPool> ownPool;
+    ThreadPool* pool = options.pool;
+    if (pool == nullptr) {
+        ownPool.reset(new ThreadPool(options.threads));
+        pool = ownPool.get();
+    }
+
+    // Whole chunks per round, enough of them to keep every worker busy.
+    long long chunk = std::max(1, options.chunkSize);
+    long long roundTrials = std::max(chunk * pool->size(), options.trials / MIN_ROUNDS);
+    roundTrials = (roundTrials + chunk - 1) / chunk * chunk;
+
+    batchOptions round = options;
+    round.pool = pool;
+    round.trajectory = nullptr;
+
+    batchTotals merged;
+    dashboardFrame frame = {};
+    frame.batch = true;
+    frame.totalTrials = options.trials;
+    for (long long done = 0; done < options.trials;) {
+        round.firstTrial = options.firstTrial + done;
+        round.trials = std::min(roundTrials, options.trials - done);
+        batchTotals part;
+        runBatch(params, round, &part);
+        if (done == 0)
+            merged = part;
+        else
+            merged.merge(part);
+        done += round.trials;
+
+        // The view only shows the final results, so the yearly ones aren't summarised.
+        batchTotals finals;
+        finals.trials = merged.trials;
+        finals.finalNetWorth = merged.finalNetWorth;
+        batchResults sofar = summarizeTotals(finals);
+        frame.trials = done;
+        frame.meanNetWorth = sofar.meanNetWorth;
+        frame.p5NetWorth = sofar.p5NetWorth;
+        frame.p50NetWorth = sofar.p50NetWorth;
+        frame.p95NetWorth = sofar.p95NetWorth;
+        frame.bankruptcies = merged.bankruptcies;
+        frame.homeSales = merged.homeSales;
+        frame.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        dashboard.publish(frame);
+    }
+
+    batchResults results = summarizeTotals(merged);
+    results.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    results.trialsPerSecond = results.elapsedSeconds > 0 ? results.trials / results.elapsedSeconds : 0;
+    if (totals != nullptr)
+        *totals = merged;
+    return results;
+}
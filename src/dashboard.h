@@ -0,0 +1,129 @@
+/*
+    * dashboard.h
+    * This header file defines the live terminal dashboard. The simulation publishes a snapshot
+    * (a dashboardFrame) whenever it has something new, into a lock-free triple buffer; a render
+    * thread wakes at a fixed rate, takes the newest snapshot and redraws the view in place with
+    * ANSI cursor movement, writing each frame with a single write. The simulation never waits on
+    * the terminal: when the renderer falls behind, the snapshots in between are overwritten, and
+    * the last one published is always the one drawn last.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include "batch.h"
+
+// The latest value written by one producer thread, for one consumer thread: a triple buffer.
+// The producer fills its own slot and swaps it with the shared middle one; the consumer swaps
+// the middle slot for its own when it holds something new. Neither side blocks or takes a lock,
+// and a write is only ever replaced by a newer one, so the consumer always ends up with the
+// last value written.
+template <class T>
+class LatestValue
+{
+public:
+    // Producer.
+    void write(const T& value)
+    {
+        slots[back] = value;
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // Consumer: returns false, leaving value alone, when nothing was written since the last read.
+    bool read(T& value)
+    {
+        if ((middle.load(std::memory_order_relaxed) & FRESH) == 0)
+            return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        value = slots[front];
+        return true;
+    }
+
+private:
+    static const unsigned INDEX = 3;
+    static const unsigned FRESH = 4; // set in middle when it holds a value the consumer hasn't read
+
+    T slots[3];
+    // On their own cache lines so the two threads don't invalidate each other's.
+    alignas(64) unsigned back = 0;            // producer only
+    alignas(64) std::atomic<unsigned> middle{1};
+    alignas(64) unsigned front = 2;           // consumer only
+};
+
+// Everything one redraw shows. Counters are running totals, so a dropped frame loses nothing.
+struct dashboardFrame
+{
+    bool batch; // a batch's progress rather than a single run
+
+    // A single run: the month and the balances at its end.
+    int month;
+    int months;
+    double bankBalance;
+    double etfBalance;
+    double homeValue;
+    double mortgageBalance;
+    double equity;
+    double netWorth;
+    bool employed;
+    bool homeOwner;
+    long long layoffs;
+    long long rehires;
+
+    // Both: home sales and bankruptcies so far (a batch counts trials).
+    long long homeSales;
+    long long bankruptcies;
+
+    // A batch: trials done, and the final net worth of the trials done so far.
+    long long trials;
+    long long totalTrials;
+    double meanNetWorth;
+    double p5NetWorth;
+    double p50NetWorth;
+    double p95NetWorth;
+
+    double elapsedSeconds;
+};
+
+class Dashboard
+{
+public:
+    explicit Dashboard(const std::string& title, double framesPerSecond = 20);
+    ~Dashboard();
+
+    Dashboard(const Dashboard&) = delete;
+    Dashboard& operator=(const Dashboard&) = delete;
+
+    // Starts the render thread and takes over the terminal.
+    void start();
+
+    // Called from the simulation's thread. Never blocks.
+    void publish(const dashboardFrame& frame) { latest.write(frame); }
+
+    // Draws the last published frame, stops the render thread and gives the terminal back with
+    // the cursor below the view.
+    void finish();
+
+private:
+    void renderLoop();
+    std::string draw(const dashboardFrame& frame) const;
+
+    std::string title;
+    double framesPerSecond;
+    LatestValue<dashboardFrame> latest;
+    std::thread renderer;
+    std::atomic<bool> stopping{false};
+};
+
+// Runs one trial of params a month at a time, publishing a frame after every month, paced at
+// monthsPerSecond (0 for as fast as it goes). Returns the trial's result.
+trialResult runDashboardTrial(const simulationParams& params, const batchOptions& options, long long trial,
+                              double monthsPerSecond, Dashboard& dashboard);
+
+// runBatch in rounds, publishing the running results after every round. The results are those
+// of one runBatch over the same trials; totals, if set, receives the merged totals.
+batchResults runDashboardBatch(const simulationParams& params, const batchOptions& options, Dashboard& dashboard,
+                               batchTotals* totals = nullptr);
@@ -0,0 +1,372 @@
+/*
+    * deterministic.cpp
+    * This source file implements the closed form evaluator of the deterministic model, its
+    * stepped reference and the deterministic sweep.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "deterministic.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+
+namespace {
+
+// What stays fixed for the whole run of one scenario.
+struct modelTerms
+{
+    bool owner;
+    int months;        // simulatedMonths(params)
+    double principal;
+    double monthlyRate;
+    double payment;
+    int loanMonths;
+    double propertyTax; // monthly
+    double hoa;         // monthly
+    double startingRent;
+    double rentGrowth;  // annual factor
+    double etfGrowth;   // monthly factors
+    double homeGrowth;
+};
+
+// What changes from year to year; constant within the year.
+struct yearTerms
+{
+    double netIncome;  // monthly take-home pay
+    double outgoings;  // monthly mortgage, property tax and HOA, or rent (charged twice)
+};
+
+struct modelState
+{
+    double bank;
+    double etf;
+    double home;
+    double income;  // annual pre-tax, raised 5% every year
+    double lastNet; // last month's take-home pay, what FixedInvestPolicy invests a share of
+    int month;      // months simulated
+};
+
+modelTerms termsFor(const simulationParams& params)
+{
+    modelTerms t;
+    t.owner = params.homeOwner;
+    t.months = simulatedMonths(params);
+    // the same expressions initialPerson and buildSchedule use
+    t.principal = params.homePrice - params.homePrice * (params.downPayRatio / 100.0);
+    t.monthlyRate = params.mortgageInterest / 12.0 / 100.0;
+    t.loanMonths = (int)params.loanLength * 12;
+    t.payment = t.loanMonths > 0 ? amortizedPayment(t.principal, t.monthlyRate, t.loanMonths) : 0.0;
+    t.propertyTax = params.homePrice * (params.propertyTaxRate / 12.0f / 100.0);
+    t.hoa = params.hoaAnnual / 12.0;
+    t.startingRent = params.startingRent;
+    t.rentGrowth = 1 + params.rentInflation / 100.0;
+    t.etfGrowth = 1.0 + (std::pow(1.0 + params.etfAnnual / 100.0, 1.0 / 12.0) - 1.0);
+    t.homeGrowth = 1 + params.appreciationRate / 100.0 / 12.0;
+    return t;
+}
+
+yearTerms yearTermsFor(const modelTerms& t, const modelState& s, int year)
+{
+    yearTerms y;
+    y.netIncome = s.income / 12.0;
+    // loans run whole years, so the payment is the same all year
+    double payment = s.month < t.loanMonths ? t.payment : 0.0;
+    y.outgoings = t.owner ? payment + t.propertyTax + t.hoa : 2 * t.startingRent * std::pow(t.rentGrowth, year);
+    return y;
+}
+
+// Remaining balance after `payments` payments of the loan, P ((1+r)^n - (1+r)^k) / ((1+r)^n - 1)
+// for n payments in all. expm1 keeps it accurate for rates near zero.
+double loanBalance(const modelTerms& t, int payments)
+{
+    if (t.loanMonths <= 0)
+        return t.principal;
+    payments = std::min(payments, t.loanMonths);
+    if (t.monthlyRate == 0)
+        return t.principal * (t.loanMonths - payments) / t.loanMonths;
+    double growth = std::log1p(t.monthlyRate);
+    double full = std::expm1(t.loanMonths * growth);
+    return t.principal * (full - std::expm1(payments * growth)) / full;
+}
+
+// The investment the policy asks for this month, as policy.h computes it.
+double investment(const policyOptions& policy, const modelState& s, const yearTerms& y)
+{
+    switch (policy.kind) {
+    case POLICY_FIXED_INVEST: {
+        double amount = s.lastNet * policy.investFraction;
+        return amount < s.bank ? amount : s.bank;
+    }
+    case POLICY_EMERGENCY_FUND:
+        return s.bank - policy.emergencyMonths * y.outgoings;
+    default:
+        return 0.0;
+    }
+}
+
+// One month, in the order simulateMonth goes through it.
+void stepMonth(const modelTerms& t, const policyOptions& policy, const yearTerms& y, modelState& s)
+{
+    s.etf *= t.etfGrowth;
+
+    double invest = investment(policy, s, y);
+    if (invest > 0 && invest <= s.bank) {
+        s.bank -= invest;
+        s.etf += invest;
+    }
+
+    s.bank += y.netIncome - y.outgoings;
+    s.lastNet = y.netIncome;
+    s.home *= t.homeGrowth;
+
+    // CoverShortfallPolicy::sellETF, which every policy uses
+    if (s.bank < 0 && !(s.etf < -s.bank)) {
+        double sell = std::min(-s.bank / (1.0 - ETF_SALE_FEE), s.etf);
+        if (sell > 0) {
+            s.etf -= sell;
+            s.bank += sell - sell * ETF_SALE_FEE;
+        }
+    }
+    s.month++;
+}
+
+// Sums the next `months` months of the year in closed form, the month before them having set
+// lastNet to this year's pay. Returns false, leaving s alone, if a decision would change course
+// during them.
+bool sumMonths(const modelTerms& t, const policyOptions& policy, const yearTerms& y, modelState& s, int months)
+{
+    if (months <= 0)
+        return true;
+
+    const double g = t.etfGrowth;
+    // 1 + g + ... + g^(n - 1)
+    auto series = [g](int n) { return g == 1.0 ? (double)n : (std::pow(g, n) - 1) / (g - 1); };
+    const double flow = y.netIncome - y.outgoings;
+    const double b = s.bank;
+    const double reserve = policy.emergencyMonths * y.outgoings; // EmergencyFundPolicy
+    const int last = months - 1;
+
+    double bank, etf;
+    bool invests = false;
+    if (policy.kind == POLICY_FIXED_INVEST && s.lastNet * policy.investFraction > 0) {
+        // invests v a month while v stays below the bank balance, which moves by flow - v a month
+        double v = s.lastNet * policy.investFraction;
+        if (!(std::min(b, b + last * (flow - v)) > v))
+            return false;
+        bank = b + months * (flow - v);
+        etf = std::pow(g, months) * s.etf + v * series(months);
+        invests = true;
+    }
+    else if (policy.kind == POLICY_EMERGENCY_FUND && reserve >= 0 && b > reserve && flow > 0) {
+        // invests everything above the reserve the first month and the month's surplus after that
+        bank = reserve + flow;
+        etf = std::pow(g, months) * s.etf + (b - reserve) * std::pow(g, last) + flow * series(last);
+        invests = true;
+    }
+    else {
+        // invests nothing all along
+        if (policy.kind == POLICY_EMERGENCY_FUND && std::max(b, b + last * flow) > reserve)
+            return false;
+        bank = b + months * flow;
+        etf = std::pow(g, months) * s.etf;
+    }
+
+    // any month ending below zero with ETF to sell would sell some
+    if ((invests || s.etf > 0) && std::min(b + flow, bank) < 0)
+        return false;
+
+    s.bank = bank;
+    s.etf = etf;
+    s.home *= std::pow(t.homeGrowth, months);
+    s.month += months;
+    return true;
+}
+
+deterministicYear snapshot(const modelTerms& t, const modelState& s, int year)
+{
+    deterministicYear y;
+    y.year = year;
+    y.bankBalance = s.bank;
+    y.etfBalance = s.etf;
+    y.homeValue = s.home;
+    // renters start out with the loan on the books too (initialPerson) and drop it after a month
+    y.mortgageBalance = t.owner ? loanBalance(t, s.month) : s.month == 0 ? t.principal : 0.0;
+    y.equity = t.owner || s.month == 0 ? s.home - y.mortgageBalance : 0.0;
+    y.netWorth = s.bank - y.mortgageBalance + s.etf + (t.owner ? s.home : 0.0);
+    return y;
+}
+
+deterministicYear snapshot(const Person& p, int year)
+{
+    deterministicYear y;
+    y.year = year;
+    y.netWorth = netWorth(p);
+    y.bankBalance = p.bankBalance;
+    y.etfBalance = p.etfBalance;
+    y.homeValue = p.homeValue;
+    y.mortgageBalance = p.mortgageBalance;
+    y.equity = p.totalEquity;
+    return y;
+}
+
+// Relative to the year's largest amount rather than each amount's own size: a paid off loan
+// is left with a few cents' worth of rounding in the amortization table, which is nothing
+// next to the home but all of the balance.
+double yearDifference(const deterministicYear& a, const deterministicYear& b)
+{
+    const double x[] = {a.netWorth, a.bankBalance, a.etfBalance, a.homeValue, a.mortgageBalance, a.equity};
+    const double y[] = {b.netWorth, b.bankBalance, b.etfBalance, b.homeValue, b.mortgageBalance, b.equity};
+    double scale = 1.0, difference = 0.0;
+    for (int i = 0; i < 6; i++) {
+        scale = std::max({scale, std::fabs(x[i]), std::fabs(y[i])});
+        difference = std::max(difference, std::fabs(x[i] - y[i]));
+    }
+    return difference / scale;
+}
+
+}
+
+monthDraws deterministicDraws()
+{
+    monthDraws draws;
+    draws.u[DRAW_ETF] = 0.5;          // fluctuation step 200 of 400: no move
+    draws.u[DRAW_HOME] = 0.5;
+    draws.u[DRAW_REHIRE] = 0.0;
+    draws.u[DRAW_UNEMPLOYMENT] = 1.0; // never below the layoff chance
+    draws.u[DRAW_HOME_SALE] = 0.0;    // attemptHomeSale never succeeds
+    return draws;
+}
+
+deterministicResult evaluateDeterministic(const simulationParams& params, const policyOptions& policy, bool yearly)
+{
+    const modelTerms t = termsFor(params);
+
+    deterministicResult result = {};
+    modelState s = {};
+    s.home = params.homePrice;
+    s.income = params.preTaxIncome;
+    if (yearly)
+        result.years.push_back(snapshot(t, s, 0));
+
+    for (int year = 0; year * 12 < t.months; year++) {
+        int months = std::min(12, t.months - year * 12);
+        if (year > 0)
+            s.income *= 1.05; // the raise Simulation::step gives at every year start
+        const yearTerms y = yearTermsFor(t, s, year);
+
+        stepMonth(t, policy, y, s);
+        if (!sumMonths(t, policy, y, s, months - 1)) {
+            for (int month = 1; month < months; month++)
+                stepMonth(t, policy, y, s);
+            result.steppedYears++;
+        }
+
+        if (yearly && months == 12)
+            result.years.push_back(snapshot(t, s, year + 1));
+    }
+
+    result.final = snapshot(t, s, t.months / 12);
+    return result;
+}
+
+deterministicResult stepDeterministic(const simulationParams& params, const policyOptions& policy, bool yearly)
+{
+    const scenarioSchedule schedule = buildSchedule(params);
+    const monthDraws draws = deterministicDraws();
+
+    deterministicResult result = {};
+    withPolicy(policy, [&](const auto& policy) {
+        using Policy = std::decay_t<decltype(policy)>;
+        Simulation<Policy> sim(params, schedule, RandomStream(), policy);
+        if (yearly)
+            result.years.push_back(snapshot(sim.person(), 0));
+        while (!sim.finished()) {
+            sim.step(draws);
+            if (yearly && sim.month() % 12 == 0)
+                result.years.push_back(snapshot(sim.person(), sim.month() / 12));
+        }
+        result.final = snapshot(sim.person(), sim.month() / 12);
+        result.steppedYears = (sim.month() + 11) / 12;
+    });
+    return result;
+}
+
+double deterministicDifference(const deterministicResult& a, const deterministicResult& b)
+{
+    double difference = yearDifference(a.final, b.final);
+    for (size_t i = 0; i < a.years.size() && i < b.years.size(); i++)
+        difference = std::max(difference, yearDifference(a.years[i], b.years[i]));
+    return difference;
+}
+
+deterministicSweepSummary runDeterministicSweep(const simulationParams& base, const std::vector<sweepAxis>& axes,
+                                                const policyOptions& policy, ThreadPool& pool, bool check,
+                                                std::ostream& out)
+{
+    // Points are evaluated a block at a time and written in order, so the grid can be far
+    // larger than what would fit in memory.
+    const size_t BLOCK_POINTS = 1 << 16;
+
+    deterministicSweepSummary summary = {};
+    summary.points = sweepPoints(axes);
+
+    out << std::fixed << std::setprecision(2);
+    for (const sweepAxis& axis : axes)
+        out << axis.field << ",";
+    out << "netWorth,bankBalance,etfBalance,homeValue,mortgageBalance,equity" << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<deterministicYear> finals;
+    std::vector<double> differences(pool.size(), 0.0);
+    std::vector<double> point;
+    for (size_t first = 0; first < summary.points; first += BLOCK_POINTS) {
+        size_t count = std::min(BLOCK_POINTS, summary.points - first);
+        finals.resize(count);
+        pool.parallelFor(count, 256, [&](size_t begin, size_t end, int worker) {
+            std::vector<double> local;
+            for (size_t i = begin; i < end; i++) {
+                simulationParams params = sweepPoint(base, axes, first + i, local);
+                deterministicResult r = evaluateDeterministic(params, policy, false);
+                finals[i] = r.final;
+                if (check) {
+                    double d = deterministicDifference(r, stepDeterministic(params, policy, false));
+                    differences[worker] = std::max(differences[worker], d);
+                }
+            }
+        });
+
+        for (size_t i = 0; i < count; i++) {
+            sweepPoint(base, axes, first + i, point);
+            for (double value : point)
+                out << value << ",";
+            const deterministicYear& f = finals[i];
+            out << f.netWorth << "," << f.bankBalance << "," << f.etfBalance << "," << f.homeValue << ","
+                << f.mortgageBalance << "," << f.equity << "\n";
+        }
+    }
+    out.flush();
+
+    auto stop = std::chrono::steady_clock::now();
+    summary.elapsedSeconds = std::chrono::duration<double>(stop - start).count();
+    for (double d : differences)
+        summary.maxDifference = std::max(summary.maxDifference, d);
+    return summary;
+}
+
+void printDeterministicResult(const deterministicResult& result)
+{
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "--------------------------------" << std::endl;
+    std::cout << "Deterministic model: no market moves, no layoffs, no home sale" << std::endl;
+    std::cout << "Year: net worth / bank / ETF / home / mortgage" << std::endl;
+    for (const deterministicYear& y : result.years) {
+        std::cout << "Year " << std::setw(2) << y.year << ": $" << y.netWorth << " / $" << y.bankBalance
+                  << " / $" << y.etfBalance << " / $" << y.homeValue << " / $" << y.mortgageBalance << std::endl;
+    }
+    std::cout << "--------------------------------" << std::endl;
+    std::cout << "Final Net Worth: $" << result.final.netWorth << std::endl;
+    std::cout << "--------------------------------" << std::endl;
+}
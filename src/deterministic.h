@@ -0,0 +1,80 @@
+/*
+    * deterministic.h
+    * This header file defines the deterministic model and its closed form evaluator. The
+    * deterministic model is the simulation with every random event turned off: the ETF and the
+    * home move by exactly their expected monthly rate, nobody is laid off and no buyer turns up
+    * for the home. What is left are geometric series (the 5% raises, rent inflation,
+    * appreciation, amortization and ETF compounding), so a scenario can be evaluated a year at a
+    * time instead of a month at a time.
+    *
+    * Within a year income and outgoings are constant, so after the year's first month the bank
+    * balance moves along a line and the ETF along a geometric series. The evaluator steps each
+    * year's first month (where last year's pay and the new year's costs meet) and sums the other
+    * months in closed form. A year in which a policy decision changes course part way (an
+    * investment capped by the bank balance, an ETF sale) is stepped month by month instead, so
+    * the result always matches stepDeterministic, the same model run through the monthly engine,
+    * to rounding.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include "policy.h"
+#include "simulation.h"
+#include "sweep.h"
+#include "thread-pool.h"
+
+// The draws of every month of the deterministic model: no market moves, no layoff, no buyer.
+monthDraws deterministicDraws();
+
+// State of the deterministic model at the end of a year (year 0 is the starting state).
+struct deterministicYear
+{
+    int year;
+    double netWorth;
+    double bankBalance;
+    double etfBalance;
+    double homeValue;
+    double mortgageBalance;
+    double equity;
+};
+
+struct deterministicResult
+{
+    deterministicYear final;              // at the end of the run; year is the last complete year
+    std::vector<deterministicYear> years; // every complete year when asked for, like batchResults
+    int steppedYears;                     // years evaluated month by month
+};
+
+// Closed form evaluation, O(years).
+deterministicResult evaluateDeterministic(const simulationParams& params, const policyOptions& policy,
+                                          bool yearly = true);
+
+// The same model run through Simulation on deterministicDraws, O(months); the reference the
+// closed form is checked against.
+deterministicResult stepDeterministic(const simulationParams& params, const policyOptions& policy,
+                                      bool yearly = true);
+
+// Largest difference between any two matching values of a and b, relative to the largest
+// amount of that year (at least $1).
+double deterministicDifference(const deterministicResult& a, const deterministicResult& b);
+
+struct deterministicSweepSummary
+{
+    size_t points;
+    double elapsedSeconds;
+    double maxDifference; // against stepDeterministic over every point, when checked
+};
+
+// Evaluates every point of the grid in closed form on pool and writes one CSV row per point:
+// the axis values followed by the final balances. With check, every point is also stepped
+// through the engine and maxDifference reports the largest deterministicDifference.
+deterministicSweepSummary runDeterministicSweep(const simulationParams& base, const std::vector<sweepAxis>& axes,
+                                                const policyOptions& policy, ThreadPool& pool, bool check,
+                                                std::ostream& out);
+
+// Prints the yearly table of a deterministic run.
+void printDeterministicResult(const deterministicResult& result);
@@ -0,0 +1,159 @@
+/*
+    * dual.h
+    * This header file defines Dual, a number for forward-mode automatic differentiation: a value
+    * together with its partial derivatives along N directions. Arithmetic on Duals applies the
+    * chain rule as it goes, so the simulation's monthly math run on them carries the derivatives
+    * of every amount with respect to N inputs along with the amounts themselves.
+    *
+    * The value is computed with exactly the operations a double would go through, so a run on
+    * Duals has the same values as the same run on doubles. Comparisons only look at the value.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <cmath>
+#include <ostream>
+
+template <int N>
+struct Dual
+{
+    double value;
+    double d[N]; // d value / d input i
+
+    Dual() : value(0), d() {}
+    Dual(double value) : value(value), d() {}
+
+    // Input number `direction`: derivative 1 along it and 0 along the others.
+    static Dual variable(double value, int direction)
+    {
+        Dual x(value);
+        x.d[direction] = 1.0;
+        return x;
+    }
+
+    Dual& operator+=(const Dual& b)
+    {
+        value += b.value;
+        for (int i = 0; i < N; i++)
+            d[i] += b.d[i];
+        return *this;
+    }
+
+    Dual& operator-=(const Dual& b)
+    {
+        value -= b.value;
+        for (int i = 0; i < N; i++)
+            d[i] -= b.d[i];
+        return *this;
+    }
+
+    Dual& operator*=(const Dual& b)
+    {
+        for (int i = 0; i < N; i++)
+            d[i] = d[i] * b.value + value * b.d[i];
+        value *= b.value;
+        return *this;
+    }
+
+    Dual& operator/=(const Dual& b)
+    {
+        for (int i = 0; i < N; i++)
+            d[i] = (d[i] * b.value - value * b.d[i]) / (b.value * b.value);
+        value /= b.value;
+        return *this;
+    }
+
+    Dual& operator+=(double b) { value += b; return *this; }
+    Dual& operator-=(double b) { value -= b; return *this; }
+
+    Dual& operator*=(double b)
+    {
+        value *= b;
+        for (int i = 0; i < N; i++)
+            d[i] *= b;
+        return *this;
+    }
+
+    Dual& operator/=(double b)
+    {
+        value /= b;
+        for (int i = 0; i < N; i++)
+            d[i] /= b;
+        return *this;
+    }
+
+    friend Dual operator-(Dual a)
+    {
+        a.value = -a.value;
+        for (int i = 0; i < N; i++)
+            a.d[i] = -a.d[i];
+        return a;
+    }
+
+    friend Dual operator+(Dual a, const Dual& b) { return a += b; }
+    friend Dual operator-(Dual a, const Dual& b) { return a -= b; }
+    friend Dual operator*(Dual a, const Dual& b) { return a *= b; }
+    friend Dual operator/(Dual a, const Dual& b) { return a /= b; }
+
+    friend Dual operator+(Dual a, double b) { return a += b; }
+    friend Dual operator-(Dual a, double b) { return a -= b; }
+    friend Dual operator*(Dual a, double b) { return a *= b; }
+    friend Dual operator/(Dual a, double b) { return a /= b; }
+
+    friend Dual operator+(double a, Dual b)
+    {
+        b.value = a + b.value;
+        return b;
+    }
+
+    friend Dual operator-(double a, const Dual& b)
+    {
+        Dual r = -b;
+        r.value = a - b.value;
+        return r;
+    }
+
+    friend Dual operator*(double a, Dual b)
+    {
+        b.value = a * b.value;
+        for (int i = 0; i < N; i++)
+            b.d[i] *= a;
+        return b;
+    }
+
+    friend Dual operator/(double a, const Dual& b) { return Dual(a) / b; }
+
+    // x^y for a constant exponent.
+    friend Dual pow(const Dual& x, double y)
+    {
+        Dual r(std::pow(x.value, y));
+        double slope = y * std::pow(x.value, y - 1);
+        for (int i = 0; i < N; i++)
+            r.d[i] = slope * x.d[i];
+        return r;
+    }
+
+    friend bool operator<(const Dual& a, const Dual& b) { return a.value < b.value; }
+    friend bool operator<=(const Dual& a, const Dual& b) { return a.value <= b.value; }
+    friend bool operator>(const Dual& a, const Dual& b) { return a.value > b.value; }
+    friend bool operator>=(const Dual& a, const Dual& b) { return a.value >= b.value; }
+    friend bool operator==(const Dual& a, const Dual& b) { return a.value == b.value; }
+    friend bool operator!=(const Dual& a, const Dual& b) { return a.value != b.value; }
+
+    friend bool operator<(const Dual& a, double b) { return a.value < b; }
+    friend bool operator<=(const Dual& a, double b) { return a.value <= b; }
+    friend bool operator>(const Dual& a, double b) { return a.value > b; }
+    friend bool operator>=(const Dual& a, double b) { return a.value >= b; }
+    friend bool operator==(const Dual& a, double b) { return a.value == b; }
+    friend bool operator!=(const Dual& a, double b) { return a.value != b; }
+
+    friend std::ostream& operator<<(std::ostream& out, const Dual& x) { return out << x.value; }
+};
+
+// The plain value of a number of any type the simulation runs on.
+inline double valueOf(double x) { return x; }
+
+template <int N>
+double valueOf(const Dual<N>& x) { return x.value; }
@@ -0,0 +1,254 @@
+/*
+    * economy.cpp
+    * This source file implements the economic scenario generator.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "economy.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include "error-func.h"
+#include "history.h"
+
+namespace {
+
+// Economy streams use their own key so they never overlap a trial's stream (seed, trial).
+const uint64_t ECONOMY_KEY = 0x45434f4e4f4d5921ull;
+const uint64_t BOOTSTRAP_KEY = 0x424f4f5453545250ull;
+
+// Uniforms per generated month: two Box-Muller pairs (three of the four normals are used) and
+// one for the recession switch.
+const int ECONOMY_DRAWS = 5;
+
+struct economyField
+{
+    const char* name;
+    double economyOptions::* member;
+};
+
+const economyField ECONOMY_FIELDS[] = {
+    {"etfVolatility", &economyOptions::etfVolatility},
+    {"homeVolatility", &economyOptions::homeVolatility},
+    {"layoffVolatility", &economyOptions::layoffVolatility},
+    {"etfHomeCorrelation", &economyOptions::etfHomeCorrelation},
+    {"etfLayoffCorrelation", &economyOptions::etfLayoffCorrelation},
+    {"homeLayoffCorrelation", &economyOptions::homeLayoffCorrelation},
+    {"recessionStart", &economyOptions::recessionStart},
+    {"recessionEnd", &economyOptions::recessionEnd},
+    {"recessionEtfReturn", &economyOptions::recessionEtfReturn},
+    {"recessionHomeReturn", &economyOptions::recessionHomeReturn},
+    {"recessionLayoffFactor", &economyOptions::recessionLayoffFactor},
+    {"blockMonths", &economyOptions::blockMonths},
+};
+
+// Lower triangular L with L L^T = the correlation matrix of (ETF, home, layoff) shocks.
+// Returns false if the matrix isn't positive semi-definite.
+bool choleskyFactor(const economyOptions& o, double l[3][3])
+{
+    double a = o.etfHomeCorrelation, b = o.etfLayoffCorrelation, c = o.homeLayoffCorrelation;
+    l[0][0] = 1; l[0][1] = 0; l[0][2] = 0;
+    l[1][0] = a; l[1][2] = 0;
+    l[2][0] = b;
+    if (1 - a * a <= 0)
+        return false;
+    l[1][1] = std::sqrt(1 - a * a);
+    l[2][1] = (c - a * b) / l[1][1];
+    double rest = 1 - b * b - l[2][1] * l[2][1];
+    if (rest < -1e-12)
+        return false;
+    l[2][2] = std::sqrt(std::max(0.0, rest));
+    return true;
+}
+
+}
+
+bool parseEconomySetting(const std::string& spec, economyOptions& options)
+{
+    size_t equals = spec.find('=');
+    std::string name = spec.substr(0, equals);
+    std::string number = equals == std::string::npos ? "" : spec.substr(equals + 1);
+    if (!is_float(number)) {
+        std::cout << "Expected NAME=NUMBER for the economy, got " << spec << std::endl;
+        return false;
+    }
+
+    double value = std::stod(number);
+    options.enabled = true;
+    if (name == "paths") {
+        // Clamped before the conversion so a huge value is rejected by checkEconomy, not wrapped.
+        options.paths = (int)std::min(std::max(value, 0.0), (double)MAX_ECONOMY_PATHS + 1);
+        return true;
+    }
+    if (name == "recessions") {
+        options.recessions = value != 0;
+        return true;
+    }
+    for (const economyField& f : ECONOMY_FIELDS) {
+        if (name == f.name) {
+            options.*(f.member) = value;
+            return true;
+        }
+    }
+    std::cout << "Unknown economy setting " << name << std::endl;
+    return false;
+}
+
+bool checkEconomy(const economyOptions& options)
+{
+    double l[3][3];
+    if (!choleskyFactor(options, l)) {
+        std::cout << "The economy correlations don't form a valid correlation matrix" << std::endl;
+        return false;
+    }
+    if (options.paths <= 0 || options.paths > MAX_ECONOMY_PATHS) {
+        std::cout << "Economy paths must be between 1 and " << MAX_ECONOMY_PATHS << std::endl;
+        return false;
+    }
+    if (options.etfVolatility < 0 || options.homeVolatility < 0 || options.layoffVolatility < 0 ||
+        options.recessionLayoffFactor < 0) {
+        std::cout << "Economy volatilities and factors can't be negative" << std::endl;
+        return false;
+    }
+    if (options.recessionStart < 0 || options.recessionStart > 1 || options.recessionEnd < 0 ||
+        options.recessionEnd > 1) {
+        std::cout << "Recession start and end chances must be between 0 and 1" << std::endl;
+        return false;
+    }
+    if (options.blockMonths < 1) {
+        std::cout << "Economy blockMonths must be at least 1" << std::endl;
+        return false;
+    }
+    return options.history.empty() || loadHistory(options.history) != nullptr;
+}
+
+EconomicScenarios::EconomicScenarios(const economyOptions& options, uint64_t seed, int months)
+    : pathCount(options.paths), monthCount(months), data((size_t)options.paths * months)
+{
+    if (!options.history.empty()) {
+        bootstrap(options, seed);
+        return;
+    }
+
+    // checkEconomy has rejected settings whose correlations have no Cholesky factor.
+    double l[3][3];
+    choleskyFactor(options, l);
+
+    // Lognormal monthly factors with mean 1 outside recessions; a recession shifts the log
+    // return by its annual rate spread over twelve months.
+    const double etfSigma = options.etfVolatility / 100.0 / std::sqrt(12.0);
+    const double homeSigma = options.homeVolatility / 100.0 / std::sqrt(12.0);
+    const double layoffSigma = options.layoffVolatility;
+    const double etfShift = std::log(1 + options.recessionEtfReturn / 100.0) / 12.0;
+    const double homeShift = std::log(1 + options.recessionHomeReturn / 100.0) / 12.0;
+
+    std::vector<double> u((size_t)months * ECONOMY_DRAWS);
+    std::vector<double> z((size_t)months * 3);
+    for (int path = 0; path < pathCount; path++) {
+        RandomStream rng(seed ^ ECONOMY_KEY, path);
+        rng.fillUniform(u.data(), u.size());
+
+        // Box-Muller for the whole path in one branch-free pass, then correlate the normals.
+        for (int m = 0; m < months; m++) {
+            const double* d = &u[(size_t)m * ECONOMY_DRAWS];
+            double n0, n1, n2, unused;
+            normalPair(d[0], d[1], n0, n1);
+            normalPair(d[2], d[3], n2, unused);
+            z[m * 3 + 0] = n0;
+            z[m * 3 + 1] = l[1][0] * n0 + l[1][1] * n1;
+            z[m * 3 + 2] = l[2][0] * n0 + l[2][1] * n1 + l[2][2] * n2;
+        }
+
+        bool recession = false;
+        economyMonth* out = &data[(size_t)path * months];
+        for (int m = 0; m < months; m++) {
+            if (options.recessions) {
+                double switchDraw = u[(size_t)m * ECONOMY_DRAWS + 4];
+                recession = recession ? switchDraw >= options.recessionEnd : switchDraw < options.recessionStart;
+            }
+            recessionMonths += recession;
+
+            const double* shock = &z[m * 3];
+            out[m].etfFactor = std::exp(etfSigma * shock[0] - etfSigma * etfSigma / 2 + (recession ? etfShift : 0));
+            out[m].homeFactor = std::exp(homeSigma * shock[1] - homeSigma * homeSigma / 2 + (recession ? homeShift : 0));
+            double layoff = LAYOFF_CHANCE * std::exp(layoffSigma * shock[2] - layoffSigma * layoffSigma / 2);
+            out[m].layoffChance = std::min(1.0, recession ? layoff * options.recessionLayoffFactor : layoff);
+            out[m].rentLevel = 1;
+        }
+    }
+}
+
+void EconomicScenarios::bootstrap(const economyOptions& options, uint64_t seed)
+{
+    // checkEconomy has loaded the history already. Without it there is nothing to resample, and
+    // average months would pass for an answer.
+    std::shared_ptr<const HistoricalSeries> history = loadHistory(options.history);
+    if (history == nullptr)
+        throw std::runtime_error("could not read the history " + options.history);
+
+    const historyMonth* rows = history->data();
+    const size_t length = history->months();
+    const historySummary& average = history->summary();
+    const double restart = 1.0 / options.blockMonths;
+    sourceMonths = length;
+
+    // Two uniforms a month, drawn for the whole path at once: whether a new block starts and
+    // where it starts.
+    std::vector<double> u((size_t)monthCount * 2);
+    for (int path = 0; path < pathCount; path++) {
+        RandomStream rng(seed ^ BOOTSTRAP_KEY, path);
+        rng.fillUniform(u.data(), u.size());
+
+        size_t index = (size_t)(u[1] * length);
+        double rentLevel = 1;
+        economyMonth* out = &data[(size_t)path * monthCount];
+        for (int m = 0; m < monthCount; m++) {
+            if (m > 0)
+                index = u[2 * m] < restart ? (size_t)(u[2 * m + 1] * length) : (index + 1) % length;
+
+            const historyMonth& h = rows[index];
+            // Arithmetic means, so a month's expected factor is 1. The geometric ones would leave
+            // it about half the variance above 1 and the expected rates that much too high.
+            rentLevel *= h.rentGrowth / average.rentMeanGrowth;
+            out[m].etfFactor = h.etfGrowth / average.etfMeanGrowth;
+            out[m].homeFactor = h.homeGrowth / average.homeMeanGrowth;
+            out[m].layoffChance = average.unemployment > 0
+                                      ? std::min(1.0, LAYOFF_CHANCE * h.unemployment / average.unemployment)
+                                      : LAYOFF_CHANCE;
+            out[m].rentLevel = rentLevel;
+        }
+    }
+}
+
+std::shared_ptr<const EconomicScenarios> economicScenarios(const economyOptions& options, uint64_t seed, int months)
+{
+    // Each set is paths x months economyMonths, megabytes at the defaults, so only the last few
+    // used are kept; a batch still holding an older set keeps it alive.
+    typedef std::pair<std::vector<double>, std::shared_ptr<const EconomicScenarios>> cacheEntry;
+    static std::mutex cacheLock;
+    static std::list<cacheEntry> cache; // most recently used first
+
+    std::vector<double> key = {(double)(uint32_t)seed, (double)(seed >> 32), (double)options.paths,
+                               (double)options.recessions, (double)std::hash<std::string>()(options.history)};
+    for (const economyField& f : ECONOMY_FIELDS)
+        key.push_back(options.*(f.member));
+
+    std::lock_guard<std::mutex> guard(cacheLock);
+    auto found = std::find_if(cache.begin(), cache.end(), [&](const cacheEntry& e) { return e.first == key; });
+    if (found != cache.end())
+        cache.splice(cache.begin(), cache, found);
+    else {
+        cache.emplace_front(key, nullptr);
+        if (cache.size() > ECONOMY_CACHE_SIZE)
+            cache.pop_back();
+    }
+
+    std::shared_ptr<const EconomicScenarios>& entry = cache.front().second;
+    if (entry == nullptr || entry->months() < months)
+        entry = std::make_shared<EconomicScenarios>(options, seed, months);
+    return entry;
+}
@@ -0,0 +1,104 @@
+/*
+    * economy.h
+    * This header file defines the economic scenario generator. Instead of every trial drawing
+    * its own independent market moves, a set of economies is generated once per seed: monthly
+    * ETF returns, home appreciation and layoff odds that move together through a correlation
+    * matrix, with optional recessions that cut returns and raise layoffs for months at a time.
+    * Every trial runs in one of them (its random stream id picks which), so buying and renting,
+    * and every scenario of a sweep, face exactly the same economies.
+    *
+    * With a history (history.h) the economies are resampled from it instead, by stationary block
+    * bootstrap: each month continues the history from the month before, or with chance
+    * 1 / blockMonths jumps to a random month, wrapping around at the end. Runs of real months
+    * keep the history's fat tails, cross-correlations and momentum. The growth factors are
+    * divided by the history's own arithmetic means, so a month's expected factor is 1: the
+    * scenario's rates stay the expected ones and the history supplies the moves around them.
+    * Unemployment scales the layoff odds and the rent index the rent. Recessions and the volatility and correlation settings don't apply.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "simulation.h"
+
+// Most economies one run can generate; each is months x 32 bytes.
+const int MAX_ECONOMY_PATHS = 16384;
+
+struct economyOptions
+{
+    bool enabled = false;
+    int paths = 1024; // economies generated; trial streams take them in turn
+
+    // Annual volatility in percent of the ETF and home returns, and the spread of the log
+    // layoff odds around LAYOFF_CHANCE.
+    double etfVolatility = 15;
+    double homeVolatility = 5;
+    double layoffVolatility = 0.3;
+
+    // Correlations between the monthly ETF, home and layoff shocks.
+    double etfHomeCorrelation = 0.3;
+    double etfLayoffCorrelation = -0.5;
+    double homeLayoffCorrelation = -0.3;
+
+    // Recessions: monthly chances of one starting and ending, what they add to the annual ETF
+    // and home returns (percent), and how much they multiply the layoff odds.
+    bool recessions = true;
+    double recessionStart = 1.0 / 120;
+    double recessionEnd = 1.0 / 12;
+    double recessionEtfReturn = -20;
+    double recessionHomeReturn = -8;
+    double recessionLayoffFactor = 2;
+
+    // Bootstrap the economies from this history file instead of generating them.
+    std::string history;
+    double blockMonths = 12; // mean length of a bootstrapped run of history
+};
+
+// Sets the economyOptions field named in "name=value" (the member names above) and turns the
+// economy on. Prints the problem and returns false for an unknown name or a bad value.
+bool parseEconomySetting(const std::string& spec, economyOptions& options);
+
+// Prints why and returns false if the correlations don't form a valid correlation matrix, a
+// setting is out of range or the history can't be read.
+bool checkEconomy(const economyOptions& options);
+
+// options.paths generated economies of `months` months each. Throws std::runtime_error if
+// options.history can't be read; checkEconomy reports that first everywhere it is called.
+class EconomicScenarios
+{
+public:
+    EconomicScenarios(const economyOptions& options, uint64_t seed, int months);
+
+    int paths() const { return pathCount; }
+    int months() const { return monthCount; }
+
+    // The economy trials drawing from random stream `stream` run in.
+    const economyMonth* path(uint64_t stream) const { return &data[(stream % pathCount) * monthCount]; }
+
+    // Months of the history the economies were bootstrapped from, 0 for generated ones.
+    size_t historyMonths() const { return sourceMonths; }
+
+    // Share of all generated months spent in a recession.
+    double recessionShare() const { return recessionMonths / ((double)pathCount * monthCount); }
+
+private:
+    void bootstrap(const economyOptions& options, uint64_t seed);
+
+    int pathCount;
+    int monthCount;
+    long long recessionMonths = 0;
+    size_t sourceMonths = 0;
+    std::vector<economyMonth> data; // path by path
+};
+
+// Returns the shared economies for (options, seed) covering at least `months` months, generating
+// them on first use. Economy p is drawn from its own stream, month by month, so a longer set has
+// the shorter one as its prefix. Thread safe. The last ECONOMY_CACHE_SIZE sets used are cached;
+// older ones live on only while someone holds them.
+const size_t ECONOMY_CACHE_SIZE = 4;
+std::shared_ptr<const EconomicScenarios> economicScenarios(const economyOptions& options, uint64_t seed, int months);
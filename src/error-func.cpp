@@ -6,6 +6,8 @@
 */
 
 #include "error-func.h"
+#include <charconv>
+#include <cmath>
 
 bool check_range(int lower, int upper, int x)
 {
@@ -19,52 +21,48 @@ int equality_test(int x, int y)
 		   -1;
 }
 
-bool is_int(std::string num)
+bool is_int(const std::string& num)
 {
     if (num.length() == 0) // If the string is empty, it can't be a number.
         return false;
 
     // loop through each character, than check if it's between 48 and 57 on the ascii table.
+    // A leading minus sign is allowed.
     for (int i = 0; i < num.length(); i++)
     {
         char c = num[i];
+        if (i == 0 && c == '-' && num.length() > 1)
+            continue;
         if ((int)c < 48 || (int)c > 57)
             return false;
     }
     return true;
 }
 
-bool is_float(std::string f)
+bool is_float(const std::string& f)
 {
-    if (f.length() == 0) // If the string is empty, it can't be a float.
-        return false;
-
-    int periodCount = 0; // Count the number of periods in the string
-
-    // loop through each character, than check if it's between 48 and 57 on the ascii table.
-    for (int i = 0; i < f.length(); i++)
-    {
-        char c = f[i];
+    double value;
+    return parse_float(f.data(), f.data() + f.length(), value);
+}
 
-        if ((int)c == 46) // period
-        {
-            if (i <= 0) // If the period is the first character, that isn't valid here.
-                return false;
-            if (i == f.length() - 1) // If the period is the last character, that isn't valid here.
-                return false;
-            periodCount++; // increment the period count
-            if (periodCount > 1) // If there is more than one period, that isn't valid here.
-                return false;
-            continue; // continue with the next itteration.
-        }
+// Parses all of [first, last) as a finite decimal number: an optional sign, digits with at most
+// one period, and an optional exponent ("-1.5", "4.5e5"). Doesn't allocate or copy.
+bool parse_float(const char* first, const char* last, double& out)
+{
+    if (first != last && *first == '+') // from_chars only takes a minus sign
+        first++;
+    if (first == last || *first == '+')
+        return false;
 
-        if ((int)c < 48 || (int)c > 57)
-            return false;
-    }
+    double value;
+    std::from_chars_result result = std::from_chars(first, last, value, std::chars_format::general);
+    if (result.ec != std::errc() || result.ptr != last || !std::isfinite(value))
+        return false;
+    out = value;
     return true;
 }
 
-void string_to_int(std::string num, int& v)
+void string_to_int(const std::string& num, int& v)
 {
 	if (is_int(num))
 		v = std::stoi(num);
@@ -10,8 +10,9 @@
 
 bool check_range(int lower, int upper, int x);
 int equality_test(int x, int y);
-bool is_int(std::string num);
-bool is_float(std::string num);
-void string_to_int(std::string num, int& out);
+bool is_int(const std::string& num);
+bool is_float(const std::string& num);
+bool parse_float(const char* first, const char* last, double& out);
+void string_to_int(const std::string& num, int& out);
 void swap(int& n, int& m);
 int word_count(std::string sentence);
\ No newline at end of file
@@ -0,0 +1,189 @@
+/*
+    * fork.cpp
+    * This source file implements forked what-if runs.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "fork.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <memory>
+#include "stats.h"
+
+namespace {
+
+// Per-worker accumulators for one branch, padded so neighbouring workers don't share a cache line.
+struct alignas(64) branchTotals
+{
+    metricStats finalNetWorth;
+    runningStats difference;
+    long long bankruptcies = 0;
+    long long homeSales = 0;
+    long long months = 0;     // simulated by this run
+    long long fullMonths = 0; // the same paths simulated from month 0
+
+    void add(const trialResult& r, double baseWorth, int startMonth)
+    {
+        finalNetWorth.add(r.finalNetWorth);
+        difference.add(r.finalNetWorth - baseWorth);
+        bankruptcies += r.bankrupt;
+        homeSales += r.homeSold;
+        months += r.monthsSimulated - startMonth;
+        fullMonths += r.monthsSimulated;
+    }
+};
+
+forkResult summarize(const std::vector<branchTotals>& totals, int month, const std::string& label,
+                     long long trials, forkResults& results)
+{
+    branchTotals merged;
+    for (const branchTotals& t : totals) {
+        merged.finalNetWorth.merge(t.finalNetWorth);
+        merged.difference.merge(t.difference);
+        merged.bankruptcies += t.bankruptcies;
+        merged.homeSales += t.homeSales;
+        merged.months += t.months;
+        merged.fullMonths += t.fullMonths;
+    }
+    results.monthsSimulated += merged.months;
+    results.rerunMonths += merged.fullMonths;
+
+    forkResult r;
+    r.month = month;
+    r.label = label;
+    r.meanNetWorth = merged.finalNetWorth.moments.mean;
+    r.p50NetWorth = merged.finalNetWorth.quantiles.quantile(0.50);
+    r.bankruptcyRate = (double)merged.bankruptcies / trials;
+    r.homeSaleRate = (double)merged.homeSales / trials;
+    r.meanDifference = merged.difference.mean;
+    r.differenceStdError = merged.difference.stddev() / std::sqrt((double)trials);
+    return r;
+}
+
+}
+
+std::string purchaseFieldChanged(const simulationParams& base, const simulationParams& branch)
+{
+    if (branch.homePrice != base.homePrice)
+        return "homePrice";
+    if (branch.downPayRatio != base.downPayRatio)
+        return "downPayRatio";
+    if (branch.mortgageInterest != base.mortgageInterest)
+        return "mortgageInterest";
+    if (branch.loanLength != base.loanLength)
+        return "loanLength";
+    if (branch.homeOwner != base.homeOwner)
+        return "homeOwner";
+    return "";
+}
+
+forkResults runFork(const simulationParams& base, const std::vector<int>& forkMonths,
+                    const std::vector<forkBranch>& branches, const batchOptions& options)
+{
+    forkResults results = {};
+    const long long trials = options.trials;
+    if (trials <= 0)
+        return results;
+
+    std::unique_ptr<ThreadPool> ownPool;
+    ThreadPool* pool = options.pool;
+    if (pool == nullptr) {
+        ownPool.reset(new ThreadPool(options.threads));
+        pool = ownPool.get();
+    }
+
+    std::vector<int> points = forkMonths;
+    std::sort(points.begin(), points.end());
+    const size_t count = points.size();
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Base run: every trial once, saving its state at each fork point on the way.
+    scenarioSchedule schedule = buildSchedule(base);
+    std::shared_ptr<const EconomicScenarios> economy;
+    if (options.economy.enabled)
+        economy = economicScenarios(options.economy, options.seed, simulatedMonths(base));
+    std::vector<simulationState> checkpoints(trials * count);
+    std::vector<double> baseWorth(trials);
+    std::vector<branchTotals> totals(pool->size());
+
+    pool->parallelFor(trials, options.chunkSize, [&](size_t begin, size_t end, int worker) {
+        withPolicy(options.policy, [&](const auto& policy) {
+            using Policy = std::decay_t<decltype(policy)>;
+            for (size_t trial = begin; trial < end; trial++) {
+                Simulation<Policy> sim(base, schedule, RandomStream(options.seed, trial), policy);
+                if (economy != nullptr)
+                    sim.useEconomy(economy->path(trial));
+                for (size_t k = 0; k < count; k++) {
+                    sim.run(points[k] - sim.month());
+                    checkpoints[trial * count + k] = sim.state();
+                }
+                sim.run();
+                trialResult r = sim.result();
+                baseWorth[trial] = r.finalNetWorth;
+                totals[worker].add(r, r.finalNetWorth, 0);
+            }
+        });
+    });
+    results.branches.push_back(summarize(totals, -1, "base", trials, results));
+
+    for (size_t k = 0; k < count; k++) {
+        for (const forkBranch& branch : branches) {
+            scenarioSchedule branchSchedule = buildSchedule(branch.params);
+            // The same economies as the base run, generated far enough for the branch's horizon.
+            std::shared_ptr<const EconomicScenarios> branchEconomy;
+            if (options.economy.enabled)
+                branchEconomy = economicScenarios(options.economy, options.seed, simulatedMonths(branch.params));
+            totals.assign(pool->size(), branchTotals());
+
+            pool->parallelFor(trials, options.chunkSize, [&](size_t begin, size_t end, int worker) {
+                withPolicy(branch.policy, [&](const auto& policy) {
+                    using Policy = std::decay_t<decltype(policy)>;
+                    for (size_t trial = begin; trial < end; trial++) {
+                        const simulationState& state = checkpoints[trial * count + k];
+                        Simulation<Policy> sim(branch.params, branchSchedule, state, policy);
+                        if (branchEconomy != nullptr)
+                            sim.useEconomy(branchEconomy->path(trial));
+                        sim.run();
+                        totals[worker].add(sim.result(), baseWorth[trial], state.month);
+                    }
+                });
+            });
+
+            results.branches.push_back(summarize(totals, points[k], branch.label, trials, results));
+        }
+    }
+
+    auto stop = std::chrono::steady_clock::now();
+    results.elapsedSeconds = std::chrono::duration<double>(stop - start).count();
+    return results;
+}
+
+void printForkResults(const forkResults& results)
+{
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "--------------------------------" << std::endl;
+    int month = -2;
+    for (const forkResult& r : results.branches) {
+        if (r.month != month) {
+            month = r.month;
+            if (month < 0)
+                std::cout << "Base run:" << std::endl;
+            else
+                std::cout << "Forked at month " << month << " (year " << month / 12.0 << "):" << std::endl;
+        }
+        std::cout << "  " << r.label << ": mean $" << r.meanNetWorth << ", median $" << r.p50NetWorth
+                  << ", bankrupt " << r.bankruptcyRate * 100.0 << "%, home sold " << r.homeSaleRate * 100.0 << "%";
+        if (r.month >= 0)
+            std::cout << ", vs base $" << r.meanDifference << " +/- $" << r.differenceStdError;
+        std::cout << std::endl;
+    }
+    std::cout << "--------------------------------" << std::endl;
+    std::cout << "Months simulated: " << results.monthsSimulated << " (rerunning every branch from month 0: "
+              << results.rerunMonths << ")" << std::endl;
+    std::cout << "Elapsed: " << results.elapsedSeconds << "s" << std::endl;
+    std::cout << "--------------------------------" << std::endl;
+}
@@ -0,0 +1,59 @@
+/*
+    * fork.h
+    * This header file defines forked what-if runs. Every trial of the base scenario is run once,
+    * its full state is saved at the chosen months, and each branch (changed parameters, policy
+    * or horizon) carries on from those checkpoints instead of starting again from month 0.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "batch.h"
+
+// One what-if: the parameters and policy that apply from the fork point on. A longer
+// simulationDuration extends the run past the base horizon.
+struct forkBranch
+{
+    std::string label;
+    simulationParams params;
+    policyOptions policy;
+};
+
+struct forkResult
+{
+    int month; // fork point; -1 for the base run itself
+    std::string label;
+
+    double meanNetWorth;
+    double p50NetWorth;
+    double bankruptcyRate;
+    double homeSaleRate;
+
+    // Mean over trials of branch - base final net worth and its standard error. Branches share
+    // every draw with the base up to the fork and after it, so this is a paired difference.
+    double meanDifference;
+    double differenceStdError;
+};
+
+struct forkResults
+{
+    std::vector<forkResult> branches; // the base run, then every branch at every fork point
+    long long monthsSimulated; // base run plus every branch after its fork point
+    long long rerunMonths;     // what running every branch from month 0 would have cost
+    double elapsedSeconds;
+};
+
+// The first field fixed at purchase (homePrice, downPayRatio, mortgageInterest, loanLength) or
+// homeOwner that branch changes from base, or "" if none does. The checkpoints already hold the
+// loan and the home those settled, so a branch can't change them from the fork on.
+std::string purchaseFieldChanged(const simulationParams& base, const simulationParams& branch);
+
+// Runs options.trials trials of base with options.policy, saving every trial's state at each of
+// forkMonths, then runs every branch from every fork point. Branches keep the base run's
+// economy (options.economy).
+forkResults runFork(const simulationParams& base, const std::vector<int>& forkMonths,
+                    const std::vector<forkBranch>& branches, const batchOptions& options);
+void printForkResults(const forkResults& results);
@@ -0,0 +1,208 @@
+/*
+    * history.cpp
+    * This source file implements reading, summarising and saving historical market series.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "history.h"
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string_view>
+#include "error-func.h"
+
+namespace {
+
+const char MAGIC[8] = "FPHIST1";
+const uint32_t VERSION = 1;
+const uint32_t SERIES = sizeof(historyMonth) / sizeof(double);
+
+// CSV columns, in historyMonth order.
+const char* const COLUMNS[] = {"etfReturn", "homeIndex", "rentIndex", "unemployment"};
+
+bool validMonth(const historyMonth& m)
+{
+    return m.etfGrowth > 0 && m.homeGrowth > 0 && m.rentGrowth > 0 && std::isfinite(m.etfGrowth) &&
+           std::isfinite(m.homeGrowth) && std::isfinite(m.rentGrowth) && m.unemployment >= 0 &&
+           m.unemployment <= 100;
+}
+
+historySummary summarise(const historyMonth* rows, size_t count)
+{
+    double sum[3] = {}, squares[3] = {}, growth[3] = {}, unemployment = 0;
+    for (size_t i = 0; i < count; i++) {
+        double factors[3] = {rows[i].etfGrowth, rows[i].homeGrowth, rows[i].rentGrowth};
+        for (int s = 0; s < 3; s++) {
+            double logGrowth = std::log(factors[s]);
+            sum[s] += logGrowth;
+            squares[s] += logGrowth * logGrowth;
+            growth[s] += factors[s];
+        }
+        unemployment += rows[i].unemployment;
+    }
+
+    double mean[3], volatility[3];
+    for (int s = 0; s < 3; s++) {
+        mean[s] = sum[s] / count;
+        double variance = std::max(0.0, (squares[s] - sum[s] * mean[s]) / (count - 1));
+        volatility[s] = std::sqrt(variance * 12) * 100.0;
+    }
+
+    historySummary summary;
+    summary.etfGrowth = std::exp(mean[0]);
+    summary.homeGrowth = std::exp(mean[1]);
+    summary.rentGrowth = std::exp(mean[2]);
+    summary.etfMeanGrowth = growth[0] / count;
+    summary.homeMeanGrowth = growth[1] / count;
+    summary.rentMeanGrowth = growth[2] / count;
+    summary.unemployment = unemployment / count;
+    summary.etfVolatility = volatility[0];
+    summary.homeVolatility = volatility[1];
+    summary.rentVolatility = volatility[2];
+    return summary;
+}
+
+}
+
+bool HistoricalSeries::open(const std::string& path)
+{
+    if (!file.open(path)) {
+        std::cout << "Could not read " << path << std::endl;
+        return false;
+    }
+
+    historyHeader header;
+    if (file.size() >= sizeof(header) && std::memcmp(file.data(), MAGIC, sizeof(MAGIC)) == 0) {
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (header.version != VERSION || header.series != SERIES ||
+            header.months > (file.size() - sizeof(header)) / sizeof(historyMonth) ||
+            file.size() != sizeof(header) + header.months * sizeof(historyMonth)) {
+            std::cout << path << " is not a complete history file" << std::endl;
+            return false;
+        }
+        rows = reinterpret_cast<const historyMonth*>(file.data() + sizeof(header));
+        count = header.months;
+        for (size_t i = 0; i < count; i++) {
+            if (!validMonth(rows[i])) {
+                std::cout << path << ": month " << i << " has a growth factor that isn't positive or an "
+                          << "unemployment rate outside 0 to 100" << std::endl;
+                return false;
+            }
+        }
+    }
+    else if (!parseCSV(path)) {
+        return false;
+    }
+
+    if (count < 2) {
+        std::cout << path << " needs at least two months of history" << std::endl;
+        return false;
+    }
+    averages = summarise(rows, count);
+    return true;
+}
+
+bool HistoricalSeries::parseCSV(const std::string& path)
+{
+    LineReader lines(file);
+    std::string_view text;
+
+    int columnOf[SERIES];
+    bool headerRead = false;
+    bool first = true;
+    double previous[SERIES] = {};
+
+    while (lines.next(text)) {
+        const long long lineNumber = lines.lineNumber();
+        std::vector<std::string_view> cells = splitCells(text);
+        if (!headerRead) {
+            headerRead = true;
+            for (uint32_t s = 0; s < SERIES; s++) {
+                columnOf[s] = -1;
+                for (size_t c = 0; c < cells.size(); c++) {
+                    if (cells[c] == COLUMNS[s])
+                        columnOf[s] = c;
+                }
+                if (columnOf[s] < 0) {
+                    std::cout << path << ": the header has no " << COLUMNS[s] << " column" << std::endl;
+                    return false;
+                }
+            }
+            continue;
+        }
+
+        double values[SERIES];
+        for (uint32_t s = 0; s < SERIES; s++) {
+            std::string_view cell = (size_t)columnOf[s] < cells.size() ? cells[columnOf[s]] : std::string_view();
+            if (!parse_float(cell.data(), cell.data() + cell.size(), values[s])) {
+                std::cout << path << ":" << lineNumber << ": '" << cell << "' is not a number (" << COLUMNS[s]
+                          << ")" << std::endl;
+                return false;
+            }
+        }
+
+        // Index levels only give a month's growth from the month before.
+        if (!first) {
+            historyMonth m;
+            m.etfGrowth = 1 + values[0] / 100.0;
+            m.homeGrowth = values[1] / previous[1];
+            m.rentGrowth = values[2] / previous[2];
+            m.unemployment = values[3];
+            if (!validMonth(m)) {
+                std::cout << path << ":" << lineNumber << ": a return of -100% or less, an index that "
+                          << "isn't positive or an unemployment rate outside 0 to 100" << std::endl;
+                return false;
+            }
+            parsed.push_back(m);
+        }
+        else if (values[1] <= 0 || values[2] <= 0) {
+            std::cout << path << ":" << lineNumber << ": index levels must be positive" << std::endl;
+            return false;
+        }
+        first = false;
+        std::copy(values, values + SERIES, previous);
+    }
+
+    rows = parsed.data();
+    count = parsed.size();
+    return true;
+}
+
+std::shared_ptr<const HistoricalSeries> loadHistory(const std::string& path)
+{
+    static std::mutex cacheLock;
+    static std::map<std::string, std::shared_ptr<const HistoricalSeries>> cache;
+
+    std::lock_guard<std::mutex> guard(cacheLock);
+    std::shared_ptr<const HistoricalSeries>& entry = cache[path];
+    if (entry == nullptr) {
+        auto history = std::make_shared<HistoricalSeries>();
+        if (!history->open(path))
+            return nullptr;
+        entry = history;
+    }
+    return entry;
+}
+
+bool saveHistory(const std::string& path, const HistoricalSeries& history)
+{
+    historyHeader header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.series = SERIES;
+    header.months = history.months();
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(history.data()), history.months() * sizeof(historyMonth));
+    out.close();
+    if (!out) {
+        std::cout << "Could not write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,90 @@
+/*
+    * history.h
+    * This header file defines historical market series for the block bootstrap economy. A
+    * history is a run of consecutive months, each with the ETF's total return, the growth of a
+    * house price index and of a rent index, and the unemployment rate. It is read from either of
+    * two files:
+    *
+    *   CSV with a header naming the columns etfReturn (monthly, percent), homeIndex, rentIndex
+    *   and unemployment (percent) in any order; other columns, like a date, are ignored. Index
+    *   columns are levels, so the first row only sets the starting level.
+    *
+    *   Binary, written by saveHistory: a historyHeader, then header.months historyMonth rows in
+    *   the writing machine's byte order. The rows are used straight out of the memory-mapped
+    *   file, so loading takes no parsing at all whatever the length.
+    *
+    * Loaded histories are shared: every thread and every run reads the same read-only copy.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mapped-file.h"
+
+struct historyHeader
+{
+    char magic[8];   // "FPHIST1"
+    uint32_t version;
+    uint32_t series; // values per historyMonth, 4
+    uint64_t months;
+};
+
+// One month of history as growth factors, e.g. 1.01 for a 1% rise.
+struct historyMonth
+{
+    double etfGrowth;
+    double homeGrowth;
+    double rentGrowth;
+    double unemployment; // rate in percent
+};
+
+// Averages of a history: geometric and arithmetic means of the growth factors and the plain mean
+// of the unemployment rate, all monthly, plus annualised volatilities of the log growth. The
+// geometric mean is the compounded rate; the arithmetic one is the expected month's growth.
+struct historySummary
+{
+    double etfGrowth;
+    double homeGrowth;
+    double rentGrowth;
+    double etfMeanGrowth;
+    double homeMeanGrowth;
+    double rentMeanGrowth;
+    double unemployment;
+    double etfVolatility;  // percent a year
+    double homeVolatility; // percent a year
+    double rentVolatility; // percent a year
+};
+
+class HistoricalSeries
+{
+public:
+    // Reads a binary history by mapping it, anything else as CSV. Prints why and returns false
+    // if the file can't be read, has a problem or holds fewer than two months.
+    bool open(const std::string& path);
+
+    const historyMonth* data() const { return rows; }
+    size_t months() const { return count; }
+    const historySummary& summary() const { return averages; }
+    bool mapped() const { return rows != parsed.data(); }
+
+private:
+    bool parseCSV(const std::string& path);
+
+    MappedFile file;
+    std::vector<historyMonth> parsed; // rows of a CSV history
+    const historyMonth* rows = nullptr;
+    size_t count = 0;
+    historySummary averages = {};
+};
+
+// The shared history of path, read on first use. Prints why and returns nullptr if it can't
+// be read. Thread safe; histories stay loaded for the rest of the run.
+std::shared_ptr<const HistoricalSeries> loadHistory(const std::string& path);
+
+// Writes history in the binary form. Prints why and returns false on failure.
+bool saveHistory(const std::string& path, const HistoricalSeries& history);
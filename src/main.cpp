@@ -1,16 +1,112 @@
 /*
     * main.cpp
     * This source file contains the main function and user interaction logic for the home ownership simulation.
-    * It includes parameter setup, user input handling, and the simulation execution.
+    * It includes parameter setup, user input handling and the interactive session, which runs the
+    * Simulation engine with InteractivePolicy; everything else is in the library sources.
     *
     * Contributors: Kade Miller, Alex Janigan, Eli Brunner, Camron Smith
 */
 
 
 #include "simulation.h"
+#include <ctime>
+#include <iomanip>
 #include <map>
 #include <string>
+#include <vector>
 #include "error-func.h"
+#include "cli.h"
+#include "policy.h"
+
+void clearConsole() {
+    //G++ platform specific console clear
+#ifdef _WIN32
+    system("cls");
+#else
+    // ANSI clear and cursor home, written straight out instead of starting a shell for clear
+    std::cout << "\x1b[2J\x1b[H" << std::flush;
+#endif
+}
+
+// Runs one interactive simulation, asking every ETF decision on std::cin, then prints the
+// year by year report.
+void simulate(simulationParams params)
+{
+    std::cout << std::fixed << std::setprecision(2); // Set precision for monetary values
+    scenarioSchedule schedule = buildSchedule(params);
+    Simulation<InteractivePolicy> sim(params, schedule, RandomStream(time(0))); // Seed the random number generator
+
+    std::vector<Person> states(sim.months() / 12 + 1); // +1 for initial state
+    states[0] = sim.person();
+
+    while (!sim.finished())
+    {
+        int year = sim.month() / 12;
+        // Event lines aren't flushed one by one; reading the next answer from std::cin flushes them.
+        std::cout << "Year: " << year + 1 << ", Month: " << (sim.month() % 12) + 1 << '\n';
+
+        sim.step();
+        states[year] = sim.person(); // Save state for this month
+
+        if (!sim.finished() && sim.month() % 12 == 0)
+            clearConsole();
+    }
+
+    std::cout << "--- Simulation ended ---" << std::endl;
+
+    // A run that finishes exactly at a year end has its final state at the end of the last year.
+    const Person& p = sim.person();
+    int year = sim.month() % 12 == 0 && sim.month() > 0 ? sim.month() / 12 - 1 : sim.month() / 12;
+    states[year] = p;
+
+    double absoluteIncome = 0;
+    for (int i = 1; i <= year; i++) {
+        states[i].totalIncome = states[i].bankBalance - states[i - 1].bankBalance; // Calculate total income for the year
+        absoluteIncome += states[i].totalIncome;
+    }
+
+    // Print each year's state
+    for (int i = 0; i <= year; i++) {
+        std::cout << "Year " << i + 1 << ":"
+                  << " Bank Balance: $" << states[i].bankBalance << ", "
+                  << " Home Value: $" << states[i].homeValue << ", "
+                  << " Total Equity: $" << states[i].totalEquity << ", "
+                  << " Total Paid on Mortgage: $" << states[i].totalPaidOnMortgage << ", "
+                  << " Pre-Tax Income: $" << states[i].preTaxIncome << ", "
+                  << " Net Income: $" << states[i].totalIncome
+                  << " Net Worth: $" << netWorth(states[i])
+                  << std::endl;
+    }
+
+    std::cout << "Final Assets:" << std::endl;
+    std::cout << "Bank Balance: $" << p.bankBalance << std::endl;
+    std::cout << "ETF Balance: $" << p.etfBalance << std::endl;
+    if (p.homeOwner) {
+        float netWorth = p.bankBalance + p.homeValue - p.mortgageBalance + p.etfBalance;
+        std::cout << "Home Value: $" << p.homeValue << std::endl;
+        std::cout << "Mortgage Balance: $" << p.mortgageBalance << std::endl;
+        std::cout << "Total Equity: $" << p.totalEquity << std::endl;
+        std::cout << "Total Paid on Mortgage: $" << p.totalPaidOnMortgage << std::endl;
+        std::cout << "Net Worth: $" << netWorth << std::endl;
+    }
+    else
+    {
+        float netWorth = p.bankBalance + p.etfBalance;
+        std::cout << "Net Worth: $" << netWorth << std::endl;
+    }
+    std::cout << "Total Income over simulation: $" << absoluteIncome << std::endl;
+    if (sim.bankrupt())
+    {
+        float yearFraction = (float)sim.month() / 12.0f;
+        std::cout << "Simulation Duration: " << yearFraction << "/" << params.simulationDuration << " years" << std::endl;
+    }
+    else
+        std::cout << "Simulation Duration: " << params.simulationDuration << " years" << std::endl;
+
+    std::cout << "--------------------------------" << std::endl;
+    std::cout << "Simulation completed successfully!" << std::endl;
+    std::cout << "--------------------------------" << std::endl;
+}
 
 void prettyParams(std::map<std::string, double*> args)
 {
@@ -57,81 +153,87 @@ void readArgs(simulationParams* params)
     prettyParams(args);
 }
 
-void defaultParams(simulationParams* params)
+// Prints why and returns false if params can't be simulated.
+bool paramsOkay(const simulationParams& params)
 {
-    params->preTaxIncome = 90000;
-    params->homePrice = 600000;
-    params->downPayRatio = 20;
-    params->loanLength = 30;
-    params->mortgageInterest = 5;
-    params->propertyTaxRate = 1.2f;
-    params->hoaAnnual = 3000;
-    params->appreciationRate = 4;
-    params->purchaseSaleTax = 1.5f;
-    params->propertyTaxRate = 9;
-    params->startingRent = 2000;
-    params->rentInflation = 2;
-    params->etfAnnual = 7;
-    params->simulationDuration = 30;
+    std::string problem;
+    if (checkParams(params, problem))
+        return true;
+    std::cout << "Those parameters can't be simulated: " << problem << std::endl;
+    return false;
 }
 
-int main()
+int runInteractive()
 {
-    simulationParams params;
+    while (true)
+    {
+        simulationParams params;
 
-    std::cout << "Do you want to set params, or take default.\n[1] - Default. [2] - Custom" << std::endl;
+        std::cout << "Do you want to set params, or take default.\n[1] - Default. [2] - Custom" << std::endl;
 
-    std::string def = "";
-    std::getline(std::cin, def);
+        std::string def = "";
+        std::getline(std::cin, def);
 
-    if (def == "2")
-    {
-        readArgs(&params);
-        std::cout << "Is this okay?\n[1] - Yes. [2] - No" << std::endl;
-        std::string cont = "";
-        std::getline(std::cin, cont);
-    
-        if (cont == "2")
-            return main();
-    }
-    else
-        defaultParams(&params);
+        if (def == "2")
+        {
+            defaultParams(&params); // for the fields readArgs doesn't ask about
+            readArgs(&params);
+            if (!paramsOkay(params))
+                continue; // start over
+            std::cout << "Is this okay?\n[1] - Yes. [2] - No" << std::endl;
+            std::string cont = "";
+            std::getline(std::cin, cont);
+
+            if (cont == "2")
+                continue; // start over
+        }
+        else
+            defaultParams(&params);
 
-    // Do you want to be a homeowner?
-    std::cout << "Do you want to be a homeowner?\n[1] - Yes. [2] - No" << std::endl;
-    std::string home = "";
-    std::getline(std::cin, home);
-    params.homeOwner = (home == "1");
+        // Do you want to be a homeowner?
+        std::cout << "Do you want to be a homeowner?\n[1] - Yes. [2] - No" << std::endl;
+        std::string home = "";
+        std::getline(std::cin, home);
+        params.homeOwner = (home == "1");
 
-    // Override simulation duration length
-    if (def == "1")
-    {
-        std::cout << "Override simulation duration length (current: " << params.simulationDuration << " years): ";
-        std::string duration;
-        while (duration.length() <= 0)
+        // Override simulation duration length
+        if (def == "1")
         {
-            std::cout << "\nEnter a new duration in years: ";
-            std::getline(std::cin, duration);
-            if (is_float(duration))
-            {
-                params.simulationDuration = std::stof(duration);
-            }
-            else
+            std::cout << "Override simulation duration length (current: " << params.simulationDuration << " years): ";
+            std::string duration;
+            while (duration.length() <= 0)
             {
-                std::cout << "That is not an acceptable input." << std::endl;
-                duration = "";
+                std::cout << "\nEnter a new duration in years: ";
+                std::getline(std::cin, duration);
+                if (is_float(duration))
+                {
+                    params.simulationDuration = std::stof(duration);
+                    if (!paramsOkay(params))
+                        duration = "";
+                }
+                else
+                {
+                    std::cout << "That is not an acceptable input." << std::endl;
+                    duration = "";
+                }
             }
         }
-    }
 
-    simulate(params);
+        simulate(params);
 
-    // Ask if the user wants to run another simulation
-    std::cout << "Do you want to run another simulation?\n[1] - Yes. [2] - No" << std::endl;
-    std::string again = "";
-    std::getline(std::cin, again);
-    if (again == "1")
-        return main();
-
-    return 0;
+        // Ask if the user wants to run another simulation
+        std::cout << "Do you want to run another simulation?\n[1] - Yes. [2] - No" << std::endl;
+        std::string again = "";
+        std::getline(std::cin, again);
+        if (again != "1")
+            return 0;
+    }
 }
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+        return runCommand(argc, argv);
+
+    return runInteractive();
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+/*
+    * mapped-file.cpp
+    * This source file implements the memory-mapped file view.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "mapped-file.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+    if (mapped)
+        munmap(const_cast<unsigned char*>(base), length);
+#endif
+}
+
+bool MappedFile::open(const std::string& path)
+{
+#ifdef _WIN32
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    copy.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    base = copy.data();
+    length = copy.size();
+    return true;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat status;
+    bool ok = fstat(fd, &status) == 0;
+    if (ok && status.st_size > 0) {
+        void* view = mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ok = view != MAP_FAILED;
+        if (ok) {
+            base = static_cast<const unsigned char*>(view);
+            length = status.st_size;
+            mapped = true;
+        }
+    }
+    else if (ok) {
+        base = copy.data(); // mmap refuses empty files
+    }
+    ::close(fd);
+    return ok;
+#endif
+}
+
+bool LineReader::next(std::string_view& text)
+{
+    while (cursor < stop) {
+        const char* newline = static_cast<const char*>(std::memchr(cursor, '\n', stop - cursor));
+        const char* lineEnd = newline != nullptr ? newline : stop;
+        text = trimText(std::string_view(cursor, lineEnd - cursor));
+        cursor = newline != nullptr ? newline + 1 : stop;
+        line++;
+        if (!text.empty() && text.front() != '#')
+            return true;
+    }
+    return false;
+}
+
+std::string_view trimText(std::string_view text)
+{
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+        text.remove_prefix(1);
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r'))
+        text.remove_suffix(1);
+    return text;
+}
+
+std::vector<std::string_view> splitCells(std::string_view text)
+{
+    std::vector<std::string_view> cells;
+    while (true) {
+        size_t comma = text.find(',');
+        cells.push_back(trimText(text.substr(0, comma)));
+        if (comma == std::string_view::npos)
+            return cells;
+        text.remove_prefix(comma + 1);
+    }
+}
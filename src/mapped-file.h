@@ -0,0 +1,63 @@
+/*
+    * mapped-file.h
+    * This header file defines a read-only memory-mapped view of a whole file. Where there is no
+    * mmap the file is read into memory instead, behind the same interface. LineReader and
+    * splitCells walk the lines and CSV cells of a mapped text file without copying them.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Maps path. Returns false if it can't be opened; an empty file maps to size() 0.
+    bool open(const std::string& path);
+
+    const unsigned char* data() const { return base; }
+    size_t size() const { return length; }
+    const char* begin() const { return reinterpret_cast<const char*>(base); }
+    const char* end() const { return begin() + length; }
+
+private:
+    const unsigned char* base = nullptr;
+    size_t length = 0;
+    bool mapped = false;
+    std::vector<unsigned char> copy; // file contents where there is no mmap, or it is empty
+};
+
+// Reads the lines of a mapped text file, trimmed, skipping blank lines and lines starting with #.
+class LineReader
+{
+public:
+    LineReader() = default;
+    explicit LineReader(const MappedFile& file) : cursor(file.begin()), stop(file.end()) {}
+
+    // Points text at the next line with something on it. Returns false at the end of the file.
+    bool next(std::string_view& text);
+
+    // 1-based number of the line next() read last.
+    long long lineNumber() const { return line; }
+
+private:
+    const char* cursor = nullptr;
+    const char* stop = nullptr;
+    long long line = 0;
+};
+
+// text without leading and trailing spaces and tabs, or a trailing carriage return.
+std::string_view trimText(std::string_view text);
+
+// Splits a CSV line into its trimmed cells; there is always at least one.
+std::vector<std::string_view> splitCells(std::string_view text);
@@ -0,0 +1,259 @@
+/*
+    * optimize.cpp
+    * This source file implements the cross-entropy policy search and its report.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "optimize.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include "rng.h"
+
+namespace {
+
+const double MAX_EMERGENCY_MONTHS = 36;
+
+// Candidates of one policy kind and the distribution they are drawn from. Every setting is
+// searched in [0, 1] and scaled to its range by candidateFor.
+struct policyFamily
+{
+    policyKind kind;
+    std::vector<double> mean;
+    std::vector<double> spread;
+    std::vector<std::vector<double>> points; // this generation's candidates
+};
+
+struct searchSpace
+{
+    policyOptions start;
+    bool searchTrigger;
+    double maxTrigger; // a year's pay before tax
+};
+
+double clamp01(double x)
+{
+    return std::min(1.0, std::max(0.0, x));
+}
+
+policyOptions candidateFor(const searchSpace& space, policyKind kind, const std::vector<double>& x)
+{
+    policyOptions policy = space.start;
+    policy.kind = kind;
+    if (kind == POLICY_FIXED_INVEST)
+        policy.investFraction = x[0];
+    else
+        policy.emergencyMonths = x[0] * MAX_EMERGENCY_MONTHS;
+    if (space.searchTrigger)
+        policy.homeSaleTrigger = x[1] * space.maxTrigger;
+    return policy;
+}
+
+policyFamily startFamily(const searchSpace& space, policyKind kind)
+{
+    policyOptions start = space.start;
+    policyFamily family;
+    family.kind = kind;
+    family.mean.push_back(kind == POLICY_FIXED_INVEST ? clamp01(start.investFraction)
+                                                      : clamp01(start.emergencyMonths / MAX_EMERGENCY_MONTHS));
+    if (space.searchTrigger)
+        family.mean.push_back(space.maxTrigger > 0 ? clamp01(start.homeSaleTrigger / space.maxTrigger) : 0);
+    family.spread.assign(family.mean.size(), 0.3);
+    return family;
+}
+
+// Within the bankruptcy limit beats outside it; then the higher median, or outside the limit
+// the lower bankruptcy rate. Medians are exact (exactMedians), and the mean breaks a tie.
+bool better(const batchResults& a, const batchResults& b, double maxBankruptcyRate)
+{
+    bool aFeasible = a.bankruptcyRate <= maxBankruptcyRate;
+    bool bFeasible = b.bankruptcyRate <= maxBankruptcyRate;
+    if (aFeasible != bFeasible)
+        return aFeasible;
+    if (!aFeasible && a.bankruptcyRate != b.bankruptcyRate)
+        return a.bankruptcyRate < b.bankruptcyRate;
+    if (a.p50NetWorth != b.p50NetWorth)
+        return a.p50NetWorth > b.p50NetWorth;
+    return a.meanNetWorth > b.meanNetWorth;
+}
+
+// Runs every policy on the same trials and replaces each quantile sketch median with the exact
+// one. The sketch's buckets are half a percent wide, so close candidates would often share a
+// median and be ranked on the mean instead.
+std::vector<batchResults> runRanked(const simulationParams& params, const std::vector<policyOptions>& policies,
+                                    const batchOptions& options)
+{
+    std::vector<std::vector<double>> finals;
+    std::vector<batchResults> results = runPolicies(params, policies, options, &finals);
+    for (size_t k = 0; k < results.size(); k++) {
+        std::vector<double>& f = finals[k];
+        if (f.empty())
+            continue;
+        auto middle = f.begin() + f.size() / 2;
+        std::nth_element(f.begin(), middle, f.end());
+        double median = *middle;
+        if (f.size() % 2 == 0)
+            median = (median + *std::max_element(f.begin(), middle)) / 2;
+        results[k].p50NetWorth = median;
+    }
+    return results;
+}
+
+}
+
+optimizeResults optimizePolicy(const simulationParams& params, const optimizeOptions& options,
+                               const batchOptions& batch)
+{
+    auto start = std::chrono::steady_clock::now();
+    optimizeResults results = {};
+
+    std::unique_ptr<ThreadPool> ownPool;
+    ThreadPool* pool = batch.pool;
+    if (pool == nullptr) {
+        ownPool.reset(new ThreadPool(batch.threads));
+        pool = ownPool.get();
+    }
+
+    batchOptions search = batch;
+    search.pool = pool;
+    search.yearly = false;
+    search.trajectory = nullptr;
+
+    searchSpace space;
+    space.start = batch.policy;
+    space.searchTrigger = !batch.policy.keepHome && params.homeOwner;
+    space.maxTrigger = std::max(0.0, params.preTaxIncome);
+    if (!params.homeOwner)
+        space.start.homeSaleTrigger = 0; // a renter has no home to sell, so it's neither searched nor shown
+    else if (std::isinf(space.start.homeSaleTrigger))
+        space.start.homeSaleTrigger = space.maxTrigger;
+
+    std::vector<policyFamily> families;
+    if (batch.policy.kind != POLICY_EMERGENCY_FUND)
+        families.push_back(startFamily(space, POLICY_FIXED_INVEST));
+    if (batch.policy.kind != POLICY_FIXED_INVEST)
+        families.push_back(startFamily(space, POLICY_EMERGENCY_FUND));
+
+    const int population = std::max(2, options.population);
+    const int elites = std::max(1, (int)std::ceil(population * options.eliteShare));
+    bool haveBest = false;
+
+    for (int generation = 0; generation < options.generations; generation++) {
+        // The search draws come from a stream of their own, apart from every trial's.
+        RandomStream rng(~batch.seed, generation);
+
+        // The current mean is always a candidate, so a generation never loses the ground won.
+        std::vector<policyOptions> candidates;
+        for (policyFamily& family : families) {
+            family.points.assign(population, family.mean);
+            for (int c = 1; c < population; c++) {
+                for (size_t d = 0; d < family.mean.size(); d += 2) {
+                    double u0 = rng.uniform();
+                    double u1 = rng.uniform();
+                    double z0, z1;
+                    normalPair(u0, u1, z0, z1);
+                    family.points[c][d] = clamp01(family.mean[d] + family.spread[d] * z0);
+                    if (d + 1 < family.mean.size())
+                        family.points[c][d + 1] = clamp01(family.mean[d + 1] + family.spread[d + 1] * z1);
+                }
+            }
+            for (const std::vector<double>& x : family.points)
+                candidates.push_back(candidateFor(space, family.kind, x));
+        }
+
+        std::vector<batchResults> evaluated = runRanked(params, candidates, search);
+        results.totalTrials += search.trials * (long long)candidates.size();
+
+        optimizeGeneration summary = {};
+        summary.generation = generation + 1;
+        summary.candidates = candidates.size();
+        for (size_t k = 0; k < candidates.size(); k++) {
+            if (evaluated[k].bankruptcyRate <= options.maxBankruptcyRate)
+                summary.feasible++;
+            if (k == 0 || better(evaluated[k], summary.best.results, options.maxBankruptcyRate))
+                summary.best = {candidates[k], evaluated[k]};
+        }
+        if (!haveBest || better(summary.best.results, results.best.results, options.maxBankruptcyRate)) {
+            results.best = summary.best;
+            haveBest = true;
+        }
+
+        // Fit each family's next distribution to its own elites.
+        size_t first = 0;
+        for (policyFamily& family : families) {
+            std::vector<int> order(population);
+            for (int c = 0; c < population; c++)
+                order[c] = c;
+            std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+                return better(evaluated[first + a], evaluated[first + b], options.maxBankruptcyRate);
+            });
+
+            for (size_t d = 0; d < family.mean.size(); d++) {
+                double mean = 0, variance = 0;
+                for (int e = 0; e < elites; e++)
+                    mean += family.points[order[e]][d];
+                mean /= elites;
+                for (int e = 0; e < elites; e++)
+                    variance += (family.points[order[e]][d] - mean) * (family.points[order[e]][d] - mean);
+                variance /= elites;
+
+                family.mean[d] = options.smoothing * mean + (1 - options.smoothing) * family.mean[d];
+                family.spread[d] = options.smoothing * std::sqrt(variance) + (1 - options.smoothing) * family.spread[d];
+                summary.spread = std::max(summary.spread, family.spread[d]);
+            }
+            first += population;
+        }
+        results.generations.push_back(summary);
+
+        if (summary.spread < options.minSpread)
+            break;
+    }
+
+    // The best and the starting policy again, on trials the search never saw.
+    batchOptions fresh = search;
+    fresh.firstTrial = batch.firstTrial + batch.trials;
+    std::vector<batchResults> check = runRanked(params, {results.best.policy, batch.policy}, fresh);
+    results.totalTrials += 2 * fresh.trials;
+    results.validation = check[0];
+    results.baseline = check[1];
+    results.feasible = results.validation.bankruptcyRate <= options.maxBankruptcyRate;
+
+    auto stop = std::chrono::steady_clock::now();
+    results.elapsedSeconds = std::chrono::duration<double>(stop - start).count();
+    return results;
+}
+
+void printOptimizeResults(const optimizeResults& results, const optimizeOptions& options)
+{
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "--------------------------------" << std::endl;
+    for (const optimizeGeneration& g : results.generations) {
+        std::cout << "Generation " << std::setw(2) << g.generation << ": median $" << g.best.results.p50NetWorth
+                  << ", bankrupt " << g.best.results.bankruptcyRate * 100.0 << "% ("
+                  << g.feasible << "/" << g.candidates << " within limit): " << describePolicy(g.best.policy)
+                  << std::endl;
+    }
+    std::cout << "--------------------------------" << std::endl;
+    if (!results.feasible) {
+        std::cout << "The best policy went over " << options.maxBankruptcyRate * 100.0
+                  << "% bankruptcies on fresh trials:" << std::endl;
+    }
+    std::cout << "Best policy: " << describePolicy(results.best.policy) << std::endl;
+    std::cout << "Search trials:   median $" << results.best.results.p50NetWorth << ", mean $"
+              << results.best.results.meanNetWorth << ", bankrupt " << results.best.results.bankruptcyRate * 100.0
+              << "%" << std::endl;
+    std::cout << "Fresh trials:    median $" << results.validation.p50NetWorth << ", mean $"
+              << results.validation.meanNetWorth << ", bankrupt " << results.validation.bankruptcyRate * 100.0
+              << "%" << std::endl;
+    std::cout << "Starting policy: median $" << results.baseline.p50NetWorth << ", mean $"
+              << results.baseline.meanNetWorth << ", bankrupt " << results.baseline.bankruptcyRate * 100.0
+              << "% (fresh trials)" << std::endl;
+    std::cout << "--------------------------------" << std::endl;
+    std::cout << "Trials simulated: " << results.totalTrials << std::endl;
+    std::cout << "Elapsed: " << results.elapsedSeconds << "s" << std::endl;
+    std::cout << "--------------------------------" << std::endl;
+}
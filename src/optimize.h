@@ -0,0 +1,65 @@
+/*
+    * optimize.h
+    * This header file defines the policy optimizer. It searches the settings of the built-in
+    * policies (the share of pay invested or the months of outgoings kept in the bank, and the
+    * bank balance at which the home is put up for sale) for the highest median final net worth
+    * whose bankruptcy rate stays within a limit.
+    *
+    * The search is the cross-entropy method: every generation draws a population of candidates
+    * from a normal distribution around the current mean, runs all of them in one batch on the
+    * same trials (runPolicies), and moves the mean and spread towards the best quarter. Common
+    * trials make the ranking within a generation far less noisy than the results themselves,
+    * and candidates are ranked on their exact medians rather than the quantile sketch's. The
+    * winner is then rerun on fresh trials, and judged against the bankruptcy limit there, so the
+    * reported numbers aren't the lucky ones it was picked on.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <vector>
+#include "batch.h"
+
+struct optimizeOptions
+{
+    double maxBankruptcyRate = 0.05; // candidates above this are ranked after every one within it
+    int population = 32;             // candidates per policy family and generation
+    int generations = 15;
+    double eliteShare = 0.25;        // share of the population the next distribution is fitted to
+    double smoothing = 0.7;          // weight of the elites against the previous mean and spread
+    double minSpread = 0.01;         // stop once every spread is below this share of its range
+};
+
+struct policyCandidate
+{
+    policyOptions policy;
+    batchResults results;
+};
+
+struct optimizeGeneration
+{
+    int generation;
+    policyCandidate best; // best candidate of this generation
+    int feasible;         // candidates within the bankruptcy limit
+    int candidates;
+    double spread;        // largest spread left, as a share of its range
+};
+
+struct optimizeResults
+{
+    std::vector<optimizeGeneration> generations;
+    policyCandidate best;     // best candidate of the whole search, on the search trials
+    bool feasible;            // best is within the bankruptcy limit on the fresh trials
+    batchResults validation;  // best on fresh trials
+    batchResults baseline;    // the starting policy on the same fresh trials
+    long long totalTrials;
+    double elapsedSeconds;
+};
+
+// Searches from batch.policy: a fixed invest or emergency fund policy searches its own family
+// starting from its settings, the default searches both. The home sale trigger is searched too
+// for a homeowner, unless batch.policy keeps the home. Every candidate runs batch.trials trials.
+optimizeResults optimizePolicy(const simulationParams& params, const optimizeOptions& options,
+                               const batchOptions& batch);
+void printOptimizeResults(const optimizeResults& results, const optimizeOptions& options);
@@ -0,0 +1,120 @@
+/*
+    * policy.cpp
+    * This source file implements the interactive policy and the parsing of built-in policies.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "policy.h"
+#include <cmath>
+#include <sstream>
+#include "error-func.h"
+
+namespace {
+
+// Asks for an amount on std::cin until the answer is a number.
+double readAmount()
+{
+    std::string amount;
+    while(amount.length() <= 0) {
+        std::getline(std::cin, amount);
+        if (!is_float(amount)) {
+            std::cout << "That is not an acceptable input." << std::endl;
+            amount = "";
+        }
+    }
+    return std::stod(amount);
+}
+
+}
+
+// player choice to invest in EFT
+double InteractivePolicy::invest(const Person& p) const
+{
+    if (p.bankBalance <= 0) {
+        std::cout << "Insufficient funds to invest in ETF." << std::endl;
+        return 0.0;
+    }
+
+    std::cout << "Do you want to invest in ETF? (Current ETF balance: $" << p.etfBalance << ", Current bank balance: $" << p.bankBalance << ")\n"
+              << "Enter amount to invest (or '0' to skip): ";
+    double investAmount = readAmount();
+    if (investAmount > 0 && investAmount <= p.bankBalance) {
+        std::cout << "Invested $" << investAmount << " in ETF. New ETF balance: $" << p.etfBalance + investAmount << std::endl;
+        return investAmount;
+    } else if (investAmount > p.bankBalance) {
+        std::cout << "Insufficient funds to invest that amount." << std::endl;
+    } else {
+        std::cout << "No investment made." << std::endl;
+    }
+    return 0.0;
+}
+
+double InteractivePolicy::sellETF(const Person& p) const
+{
+    // Only offered when the ETF can cover the whole shortfall
+    if (p.etfBalance < -p.bankBalance)
+        return 0.0;
+
+    std::cout << "Do you want to sell ETF? (Current ETF balance: $" << p.etfBalance << ", Current bank balance: $" << p.bankBalance << ")\n"
+              << "Enter amount to sell (or '0' to skip): ";
+    double sellAmount = readAmount();
+    if (sellAmount > 0 && sellAmount <= p.etfBalance) {
+        double transactionFee = sellAmount * ETF_SALE_FEE;
+        std::cout << "Sold $" << sellAmount << " of ETF. New bank balance: $" << p.bankBalance + sellAmount - transactionFee << std::endl;
+        return sellAmount;
+    } else if (sellAmount > p.etfBalance) {
+        std::cout << "Insufficient ETF balance to sell that amount." << std::endl;
+    } else {
+        std::cout << "No sale made." << std::endl;
+    }
+    return 0.0;
+}
+
+bool parsePolicy(const std::string& spec, policyOptions& options)
+{
+    size_t colon = spec.find(':');
+    std::string name = spec.substr(0, colon);
+    std::string value = colon == std::string::npos ? "" : spec.substr(colon + 1);
+
+    if (name == "cover" && value.empty()) {
+        options.kind = POLICY_COVER_SHORTFALL;
+        return true;
+    }
+    if (name == "invest" && is_float(value) && std::stod(value) >= 0 && std::stod(value) <= 100) {
+        options.kind = POLICY_FIXED_INVEST;
+        options.investFraction = std::stod(value) / 100.0;
+        return true;
+    }
+    if (name == "emergency" && is_float(value) && std::stod(value) >= 0) {
+        options.kind = POLICY_EMERGENCY_FUND;
+        options.emergencyMonths = std::stod(value);
+        return true;
+    }
+
+    std::cout << "Expected --policy cover, invest:PERCENT or emergency:MONTHS, got " << spec << std::endl;
+    return false;
+}
+
+std::string describePolicy(const policyOptions& options)
+{
+    std::ostringstream out;
+    switch (options.kind) {
+    case POLICY_FIXED_INVEST:
+        out << "invest " << options.investFraction * 100.0 << "% of take-home pay";
+        break;
+    case POLICY_EMERGENCY_FUND:
+        out << "keep " << options.emergencyMonths << " months of outgoings, invest the rest";
+        break;
+    default:
+        out << "cover shortfalls from the ETF";
+        break;
+    }
+    if (options.keepHome)
+        out << ", never sell the home";
+    else if (std::isinf(options.homeSaleTrigger))
+        out << ", sell the home";
+    else if (options.homeSaleTrigger != 0)
+        out << ", sell the home below $" << options.homeSaleTrigger << " in the bank";
+    return out.str();
+}
@@ -0,0 +1,172 @@
+/*
+    * policy.h
+    * This header file defines the decision policies of the simulation. A policy makes the monthly
+    * choices a person would: how much to invest in the ETF, how much ETF to sell when the bank
+    * runs dry and whether to sell the home. simulateMonth and simulateTrial take the policy as a
+    * template parameter, so the decisions are inlined into the monthly loop.
+    *
+    * A policy is any type with:
+    *   static constexpr bool verbose;            // print the month's events on std::cout
+    *   double invest(const Person& p) const;     // amount to move from the bank into the ETF,
+    *                                             // after the ETF moved and before any cash flows
+    *   double sellETF(const Person& p) const;    // amount of ETF to sell when the bank balance is
+    *                                             // negative after the month's cash flows
+    *   bool sellHome(const Person& p, double u) const; // sell the home this month; u is the
+    *                                             // month's home sale draw (see attemptHomeSale)
+    *
+    * Amounts that are not positive, or more than what is there, are ignored. The built-in
+    * headless policies take a basicPerson<T> of any number type and return amounts of that type,
+    * so they also run on the dual numbers of the sensitivity analysis.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <string>
+#include <type_traits>
+#include "simulation.h"
+
+// Invests nothing, sells just enough ETF to bring the bank balance back to zero when the ETF
+// covers the whole shortfall, and puts the home up for sale whenever the bank is empty.
+// This is the default for headless runs and the behaviour the batch kernel implements.
+struct CoverShortfallPolicy
+{
+    static constexpr bool verbose = false;
+
+    template <class T>
+    T invest(const basicPerson<T>&) const { return 0.0; }
+
+    template <class T>
+    T sellETF(const basicPerson<T>& p) const
+    {
+        if (p.etfBalance < -p.bankBalance)
+            return 0.0;
+        T sellAmount = -p.bankBalance / (1.0 - ETF_SALE_FEE);
+        return sellAmount > p.etfBalance ? p.etfBalance : sellAmount;
+    }
+
+    template <class T>
+    bool sellHome(const basicPerson<T>& p, double u) const
+    {
+        return p.bankBalance <= 0 && attemptHomeSale(u);
+    }
+};
+
+// Invests a fixed share of last month's take-home pay, as long as the bank can pay for it.
+struct FixedInvestPolicy : CoverShortfallPolicy
+{
+    double fraction = 0.2;
+
+    explicit FixedInvestPolicy(double fraction) : fraction(fraction) {}
+
+    template <class T>
+    T invest(const basicPerson<T>& p) const
+    {
+        T amount = p.netIncome * fraction;
+        return amount < p.bankBalance ? amount : p.bankBalance;
+    }
+};
+
+// Keeps `months` months of outgoings in the bank as an emergency fund and invests the rest.
+struct EmergencyFundPolicy : CoverShortfallPolicy
+{
+    double months = 6;
+
+    explicit EmergencyFundPolicy(double months) : months(months) {}
+
+    template <class T>
+    T invest(const basicPerson<T>& p) const
+    {
+        return p.bankBalance - months * monthlyOutgoings(p);
+    }
+};
+
+// Any policy, except the home is never sold.
+template <class Base>
+struct NeverSellHome : Base
+{
+    explicit NeverSellHome(const Base& base) : Base(base) {}
+
+    template <class T>
+    bool sellHome(const basicPerson<T>&, double) const { return false; }
+};
+
+// Any policy, except the home is put up for sale whenever the bank balance is at or below
+// trigger (CoverShortfallPolicy uses 0). An infinite trigger sells at the first chance.
+template <class Base>
+struct SellHomeBelow : Base
+{
+    double trigger;
+
+    SellHomeBelow(const Base& base, double trigger) : Base(base), trigger(trigger) {}
+
+    template <class T>
+    bool sellHome(const basicPerson<T>& p, double u) const
+    {
+        return p.bankBalance <= trigger && attemptHomeSale(u);
+    }
+};
+
+// Asks every ETF decision on std::cin and prints every event; used by the interactive mode.
+// Home sales follow CoverShortfallPolicy.
+struct InteractivePolicy : CoverShortfallPolicy
+{
+    static constexpr bool verbose = true;
+
+    double invest(const Person& p) const;
+    double sellETF(const Person& p) const;
+};
+
+// Runtime choice of one of the built-in policies, for the command line and batch options.
+enum policyKind
+{
+    POLICY_COVER_SHORTFALL,
+    POLICY_FIXED_INVEST,
+    POLICY_EMERGENCY_FUND
+};
+
+struct policyOptions
+{
+    policyKind kind = POLICY_COVER_SHORTFALL;
+    double investFraction = 0.2; // POLICY_FIXED_INVEST: share of take-home pay
+    double emergencyMonths = 6;  // POLICY_EMERGENCY_FUND: months of outgoings kept in the bank
+    bool keepHome = false;       // never sell the home
+    double homeSaleTrigger = 0;  // bank balance at or below which the home is put up for sale
+
+    // True for the plain CoverShortfallPolicy, the only one the batch kernel implements.
+    bool isDefault() const { return kind == POLICY_COVER_SHORTFALL && !keepHome && homeSaleTrigger == 0; }
+};
+
+// Parses "cover", "invest:PERCENT" or "emergency:MONTHS" into options. Returns false and
+// prints why on anything else.
+bool parsePolicy(const std::string& spec, policyOptions& options);
+std::string describePolicy(const policyOptions& options);
+
+// Calls f with the policy options describe. The choice is made once, so everything f runs
+// with the policy is compiled for that policy type.
+template <class F>
+void withPolicy(const policyOptions& options, F&& f)
+{
+    auto homeRule = [&](const auto& policy) {
+        using Base = std::decay_t<decltype(policy)>;
+        if (options.keepHome)
+            f(NeverSellHome<Base>(policy));
+        else if (options.homeSaleTrigger != 0)
+            f(SellHomeBelow<Base>(policy, options.homeSaleTrigger));
+        else
+            f(policy);
+    };
+
+    switch (options.kind) {
+    case POLICY_FIXED_INVEST:
+        homeRule(FixedInvestPolicy(options.investFraction));
+        break;
+    case POLICY_EMERGENCY_FUND:
+        homeRule(EmergencyFundPolicy(options.emergencyMonths));
+        break;
+    default:
+        homeRule(CoverShortfallPolicy());
+        break;
+    }
+}
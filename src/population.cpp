@@ -0,0 +1,430 @@
+/*
+    * population.cpp
+    * This source file implements the population simulation and its report.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "population.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <string_view>
+#include "error-func.h"
+#include "mapped-file.h"
+#include "profile.h"
+#include "stats.h"
+#include "thread-pool.h"
+
+namespace {
+
+// Households and the market draw from their own keys, apart from every batch trial's stream:
+// one for drawing the households, one for their monthly layoffs and rehires, one for the market.
+const uint64_t HOUSEHOLD_KEY = 0x484f555345484f4cull;
+const uint64_t EVENT_KEY = 0x4556454e54533031ull;
+const uint64_t MARKET_KEY = 0x4d41524b45543031ull;
+
+// Uniforms per household and month: the layoff and the rehire draw.
+const int HOUSEHOLD_DRAWS = 2;
+// Households updated per task; also the unit the monthly tallies are kept in.
+const size_t CHUNK = 4096;
+// Months of ownership costs a household keeps in the bank after buying.
+const double BUYING_RESERVE_MONTHS = 6;
+// Lowest a market index can fall in one month, as a share of the last.
+const double MIN_MARKET_STEP = 0.5;
+
+// One household per index, a column per field.
+struct householdColumns
+{
+    std::vector<double> income; // a year, before tax
+    std::vector<double> age;
+    std::vector<double> bank;
+    std::vector<double> etf;
+    std::vector<double> mortgage;   // balance left
+    std::vector<double> payment;    // monthly mortgage payment
+    std::vector<double> ownerCosts; // monthly property tax and HOA
+    std::vector<uint8_t> employed;
+    std::vector<uint8_t> owner;
+    std::vector<uint8_t> bankrupt;
+
+    void resize(size_t n)
+    {
+        for (std::vector<double>* c : {&income, &age, &bank, &etf, &mortgage, &payment, &ownerCosts})
+            c->assign(n, 0);
+        employed.assign(n, 1);
+        owner.assign(n, 0);
+        bankrupt.assign(n, 0);
+    }
+};
+
+struct householdRow
+{
+    double income;
+    double age;
+    double savings;
+};
+
+// What a chunk of households did in a month, added up in chunk order afterwards.
+struct monthTally
+{
+    long long purchases;
+    long long sales;
+    long long owners;
+    long long employed;
+    long long bankrupt;
+    double netWorth;
+};
+
+// The market every household sees in one month.
+struct marketMonth
+{
+    double homePrice;
+    double rent;
+    double etfReturn;
+    double loanPayment; // monthly payment on a new loan for homePrice
+    double ownerCosts;  // property tax and HOA on a home bought at homePrice
+    bool raise;         // the month the yearly raise is paid
+    bool yearEnd;
+};
+
+// Reads the household rows and their weights. Prints why and returns false on a problem.
+bool readDistribution(const std::string& path, std::vector<householdRow>& rows, std::vector<double>& weights)
+{
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cout << "Could not read " << path << std::endl;
+        return false;
+    }
+
+    const char* names[] = {"income", "age", "savings", "weight"};
+    int columnOf[4] = {-1, -1, -1, -1};
+    bool headerRead = false;
+
+    LineReader lines(file);
+    std::string_view text;
+    while (lines.next(text)) {
+        const long long lineNumber = lines.lineNumber();
+        std::vector<std::string_view> cells = splitCells(text);
+
+        if (!headerRead) {
+            headerRead = true;
+            for (int k = 0; k < 4; k++) {
+                for (size_t c = 0; c < cells.size(); c++) {
+                    if (cells[c] == names[k])
+                        columnOf[k] = c;
+                }
+            }
+            if (columnOf[0] < 0 || columnOf[1] < 0) {
+                std::cout << path << ": the header needs income and age columns" << std::endl;
+                return false;
+            }
+            continue;
+        }
+
+        double values[4] = {0, 0, 0, 1};
+        for (int k = 0; k < 4; k++) {
+            if (columnOf[k] < 0)
+                continue;
+            std::string_view cell = (size_t)columnOf[k] < cells.size() ? cells[columnOf[k]] : std::string_view();
+            if (!parse_float(cell.data(), cell.data() + cell.size(), values[k])) {
+                std::cout << path << ":" << lineNumber << ": '" << cell << "' is not a number (" << names[k] << ")"
+                          << std::endl;
+                return false;
+            }
+        }
+        if (values[0] < 0 || values[3] < 0) {
+            std::cout << path << ":" << lineNumber << ": income and weight can't be negative" << std::endl;
+            return false;
+        }
+        rows.push_back({values[0], values[1], values[2]});
+        weights.push_back(values[3]);
+    }
+
+    double total = 0;
+    for (double w : weights)
+        total += w;
+    if (rows.empty() || total <= 0) {
+        std::cout << path << " has no households" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Draws every household from the distribution rows, or from the default distribution.
+void drawHouseholds(const simulationParams& params, const populationOptions& options,
+                    const std::vector<householdRow>& rows, const std::vector<double>& weights,
+                    householdColumns& h, ThreadPool& pool)
+{
+    std::vector<double> cumulative(weights.size());
+    double total = 0;
+    for (size_t r = 0; r < weights.size(); r++)
+        cumulative[r] = total += weights[r];
+
+    pool.parallelFor(h.income.size(), CHUNK, [&](size_t begin, size_t end, int) {
+        double u[4];
+        for (size_t i = begin; i < end; i++) {
+            RandomStream rng(options.seed ^ HOUSEHOLD_KEY, i);
+            rng.fillUniform(u, 4);
+
+            householdRow row;
+            if (!rows.empty()) {
+                size_t r = std::upper_bound(cumulative.begin(), cumulative.end(), u[0] * total) - cumulative.begin();
+                row = rows[std::min(r, rows.size() - 1)];
+            }
+            else {
+                // Lognormal income with params.preTaxIncome as the median, savings of a tenth of
+                // a year's pay for every five working years.
+                double z, unused;
+                normalPair(u[1], u[2], z, unused);
+                row.income = params.preTaxIncome * std::exp(0.6 * z);
+                row.age = 25 + 40 * u[3];
+                row.savings = row.income * 0.1 * (row.age - 22) / 5;
+            }
+            h.income[i] = row.income;
+            h.age[i] = row.age;
+            h.bank[i] = row.savings;
+        }
+    });
+}
+
+// One month of households [begin, end).
+void updateHouseholds(householdColumns& h, size_t begin, size_t end, const simulationParams& params,
+                      const populationOptions& options, const marketMonth& market, int month, monthTally& tally,
+                      QuantileSketch& netWorths)
+{
+    const double loanRate = params.mortgageInterest / 100.0 / 12.0;
+    const double downPayment = market.homePrice * params.downPayRatio / 100.0;
+    const double closingCost = market.homePrice * params.purchaseSaleTax / 100.0;
+    const double newCosts = market.loanPayment + market.ownerCosts;
+
+    long long layoffs = 0, rehires = 0, bankruptcies = 0;
+    double u[HOUSEHOLD_DRAWS];
+    for (size_t i = begin; i < end; i++) {
+        RandomStream rng(options.seed ^ EVENT_KEY, i);
+        rng.seek((uint64_t)month * HOUSEHOLD_DRAWS);
+        rng.fillUniform(u, HOUSEHOLD_DRAWS);
+
+        bool retired = h.age[i] >= options.retirementAge;
+        if (market.raise && !retired)
+            h.income[i] *= 1.05; // the same 5% raise the single-household model pays
+
+        double pay = retired ? h.income[i] * options.pensionShare / 12.0 : h.employed[i] ? h.income[i] / 12.0 : 0;
+        h.etf[i] *= 1 + market.etfReturn;
+        h.bank[i] += pay;
+
+        if (h.owner[i]) {
+            h.bank[i] -= h.payment[i] + h.ownerCosts[i];
+            if (h.mortgage[i] > 0) {
+                h.mortgage[i] -= h.payment[i] - h.mortgage[i] * loanRate;
+                if (h.mortgage[i] < 0.005) {
+                    h.mortgage[i] = 0;
+                    h.payment[i] = 0;
+                }
+            }
+        }
+        else {
+            h.bank[i] -= market.rent;
+        }
+
+        if (!retired) {
+            if (!h.employed[i] && getAJob(u[1])) {
+                h.employed[i] = 1;
+                rehires++;
+            }
+            if (didWeBetItAllOnBlack(u[0])) {
+                h.employed[i] = 0;
+                layoffs++;
+            }
+        }
+
+        // Cover a shortfall from the ETF, then from the home.
+        if (h.bank[i] < 0 && h.etf[i] > 0) {
+            double sell = std::min(h.etf[i], -h.bank[i] / (1.0 - ETF_SALE_FEE));
+            h.etf[i] -= sell;
+            h.bank[i] += sell * (1.0 - ETF_SALE_FEE);
+        }
+        if (h.owner[i] && h.bank[i] < 0) {
+            h.bank[i] += market.homePrice * (1 - params.purchaseSaleTax / 100.0) - h.mortgage[i];
+            h.owner[i] = 0;
+            h.mortgage[i] = 0;
+            h.payment[i] = 0;
+            h.ownerCosts[i] = 0;
+            tally.sales++;
+        }
+        else if (!h.owner[i] && !retired && h.employed[i] && newCosts <= options.maxCostShare * h.income[i] / 12.0 &&
+                 h.bank[i] >= downPayment + closingCost + BUYING_RESERVE_MONTHS * newCosts) {
+            h.bank[i] -= downPayment + closingCost;
+            h.owner[i] = 1;
+            h.mortgage[i] = market.homePrice - downPayment;
+            h.payment[i] = market.loanPayment;
+            h.ownerCosts[i] = market.ownerCosts;
+            tally.purchases++;
+        }
+        if (h.bank[i] < 0 && !h.bankrupt[i]) {
+            h.bankrupt[i] = 1;
+            bankruptcies++;
+        }
+        h.age[i] += 1.0 / 12.0;
+
+        double worth = h.bank[i] + h.etf[i] + (h.owner[i] ? market.homePrice - h.mortgage[i] : 0);
+        tally.owners += h.owner[i];
+        tally.employed += h.employed[i] && !retired;
+        tally.bankrupt += h.bankrupt[i];
+        tally.netWorth += worth;
+        if (market.yearEnd)
+            netWorths.add(worth);
+    }
+
+    profileCount(COUNT_MONTHS, end - begin);
+    profileCount(COUNT_LAYOFFS, layoffs);
+    profileCount(COUNT_REHIRES, rehires);
+    profileCount(COUNT_HOME_SALES, tally.sales);
+    profileCount(COUNT_BANKRUPTCIES, bankruptcies);
+}
+
+}
+
+bool runPopulation(const simulationParams& params, const populationOptions& options, populationResults& results)
+{
+    auto start = std::chrono::steady_clock::now();
+    results = populationResults();
+    results.households = options.households;
+    if (options.households <= 0) {
+        std::cout << "Expected a positive number of households" << std::endl;
+        return false;
+    }
+
+    std::vector<householdRow> rows;
+    std::vector<double> weights;
+    ThreadPool pool(options.threads);
+    const size_t n = options.households;
+    householdColumns h;
+    {
+        ProfilePhase phase(PHASE_SETUP);
+        if (!options.distributionPath.empty() && !readDistribution(options.distributionPath, rows, weights))
+            return false;
+        h.resize(n);
+        drawHouseholds(params, options, rows, weights, h, pool);
+        profileCount(COUNT_TRIALS, n);
+    }
+
+    const int months = simulatedMonths(params);
+    const int loanMonths = (int)(params.loanLength * 12);
+    const double loanRate = params.mortgageInterest / 100.0 / 12.0;
+    RandomStream marketRng(options.seed ^ MARKET_KEY, 0);
+
+    marketMonth market = {};
+    market.homePrice = params.homePrice;
+    market.rent = params.startingRent;
+
+    std::vector<monthTally> tallies((n + CHUNK - 1) / CHUNK);
+    std::vector<QuantileSketch> sketches(pool.size());
+    populationYear year = {};
+    double monthSeconds = 0;
+
+    for (int month = 0; month < months; month++) {
+        auto monthStart = std::chrono::steady_clock::now();
+
+        double u[2];
+        marketRng.fillUniform(u, 2);
+        market.etfReturn = getETFReturn(params.etfAnnual, u[0]);
+        market.loanPayment = amortizedPayment(market.homePrice * (1 - params.downPayRatio / 100.0), loanRate, loanMonths);
+        market.ownerCosts = market.homePrice * params.propertyTaxRate / 12.0 / 100.0 + params.hoaAnnual / 12.0;
+        market.raise = month > 0 && month % 12 == 0;
+        market.yearEnd = month % 12 == 11 || month == months - 1;
+
+        std::fill(tallies.begin(), tallies.end(), monthTally());
+        pool.parallelFor(n, CHUNK, [&](size_t begin, size_t end, int worker) {
+            ProfilePhase phase(PHASE_SIMULATE);
+            updateHouseholds(h, begin, end, params, options, market, month, tallies[begin / CHUNK], sketches[worker]);
+        });
+
+        // Add the chunks up in a fixed order, so the totals don't depend on the threads.
+        ProfilePhase aggregate(PHASE_AGGREGATE);
+        monthTally total = {};
+        for (const monthTally& t : tallies) {
+            total.purchases += t.purchases;
+            total.sales += t.sales;
+            total.owners += t.owners;
+            total.employed += t.employed;
+            total.bankrupt += t.bankrupt;
+            total.netWorth += t.netWorth;
+        }
+        year.purchases += total.purchases;
+        year.sales += total.sales;
+
+        if (market.yearEnd) {
+            QuantileSketch all;
+            for (QuantileSketch& s : sketches) {
+                all.merge(s);
+                s = QuantileSketch();
+            }
+            year.year = month / 12 + 1;
+            year.homePrice = market.homePrice;
+            year.monthlyRent = market.rent;
+            year.ownerShare = (double)total.owners / n;
+            year.employedShare = (double)total.employed / n;
+            year.bankruptShare = (double)total.bankrupt / n;
+            year.meanNetWorth = total.netWorth / n;
+            year.p5NetWorth = all.quantile(0.05);
+            year.p50NetWorth = all.quantile(0.50);
+            year.p95NetWorth = all.quantile(0.95);
+            results.years.push_back(year);
+            year = populationYear();
+        }
+
+        // Net buying this month sets next month's prices.
+        double netBuyers = (double)(total.purchases - total.sales) / n;
+        market.homePrice *= std::max(MIN_MARKET_STEP, 1 + params.appreciationRate / 100.0 / 12.0 +
+                                                          marketFluctuation(u[1]) + options.priceImpact * netBuyers);
+        market.rent *= std::max(MIN_MARKET_STEP, 1 + params.rentInflation / 100.0 / 12.0 -
+                                                     options.rentImpact * netBuyers);
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - monthStart).count();
+        monthSeconds += seconds;
+        results.maxMonthSeconds = std::max(results.maxMonthSeconds, seconds);
+    }
+
+    results.meanMonthSeconds = months > 0 ? monthSeconds / months : 0;
+    results.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+void printPopulationResults(const populationResults& results)
+{
+    ProfilePhase phase(PHASE_OUTPUT);
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "--------------------------------" << std::endl;
+    std::cout << "Households: " << results.households << std::endl;
+    std::cout << "Year: home price / rent / owners / bought / sold / bankrupt / net worth p50 (p5 / p95)" << std::endl;
+    for (const populationYear& y : results.years) {
+        std::cout << "Year " << y.year << ": $" << y.homePrice << " / $" << y.monthlyRent << " / "
+                  << y.ownerShare * 100.0 << "% / " << y.purchases << " / " << y.sales << " / "
+                  << y.bankruptShare * 100.0 << "% / $" << y.p50NetWorth << " ($" << y.p5NetWorth << " / $"
+                  << y.p95NetWorth << ")" << std::endl;
+    }
+    std::cout << "--------------------------------" << std::endl;
+    double householdMonths = results.meanMonthSeconds > 0 ? results.households / results.meanMonthSeconds : 0;
+    std::cout << "Month wall time: " << results.meanMonthSeconds * 1000.0 << "ms mean, "
+              << results.maxMonthSeconds * 1000.0 << "ms max (" << householdMonths << " household-months/sec)"
+              << std::endl;
+    std::cout << "Elapsed: " << results.elapsedSeconds << "s" << std::endl;
+    std::cout << "--------------------------------" << std::endl;
+}
+
+bool writePopulationCSV(const populationResults& results, const std::string& path)
+{
+    ProfilePhase phase(PHASE_OUTPUT);
+    std::ofstream out(path);
+    out << "year,homePrice,monthlyRent,ownerShare,employedShare,bankruptShare,purchases,sales,"
+        << "meanNetWorth,p5NetWorth,p50NetWorth,p95NetWorth" << std::endl;
+    out << std::setprecision(10);
+    for (const populationYear& y : results.years) {
+        out << y.year << "," << y.homePrice << "," << y.monthlyRent << "," << y.ownerShare << ","
+            << y.employedShare << "," << y.bankruptShare << "," << y.purchases << "," << y.sales << ","
+            << y.meanNetWorth << "," << y.p5NetWorth << "," << y.p50NetWorth << "," << y.p95NetWorth << std::endl;
+    }
+    return (bool)out;
+}
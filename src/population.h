@@ -0,0 +1,79 @@
+/*
+    * population.h
+    * This header file defines the population simulation: many households of different incomes,
+    * ages and savings living in one housing market, where what they do together moves the prices
+    * they all face. Every month each household is updated on its own (pay, rent or mortgage, ETF
+    * growth, layoffs, and the decision to buy or to sell), then the month's purchases and sales
+    * are added up and set the next month's home price and rent:
+    *
+    *   home price *= 1 + appreciationRate / 12 + market move + priceImpact * net buyers / households
+    *   rent       *= 1 + rentInflation / 12 - rentImpact * net buyers / households
+    *
+    * so a wave of buying lifts prices and empties rentals, and forced sales do the opposite. The
+    * ETF and the home market move the same way for everyone; layoffs are drawn household by
+    * household, each from its own random stream, so results don't depend on the thread count.
+    *
+    * Households are drawn from a distribution file, a CSV with a header naming the columns
+    * income (a year, before tax), age, and optionally savings (in the bank at the start) and
+    * weight (how common the row is, default 1); each household copies a row picked by weight.
+    * Without a file incomes are lognormal around params.preTaxIncome, ages uniform from 25 to 65
+    * and savings grow with age.
+    *
+    * Households are stored column by column (one array per field), so the monthly update streams
+    * through memory and the columns a pass doesn't touch stay out of the cache.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "simulation.h"
+
+struct populationOptions
+{
+    long long households = 100000;
+    std::string distributionPath; // households to draw from; empty for the default
+    double priceImpact = 2;       // home price change per net buyer, as a share of households
+    double rentImpact = 1;        // rent change per net buyer, as a share of households
+    double retirementAge = 67;    // households stop working here and live on a pension
+    double pensionShare = 0.4;    // pension as a share of the last pay
+    double maxCostShare = 0.4;    // most of its pay a household spends on owning a home
+    int threads = 0;
+    unsigned long long seed = 1;
+};
+
+// The market and the population at the end of a year.
+struct populationYear
+{
+    int year;
+    double homePrice;
+    double monthlyRent;
+    double ownerShare;
+    double employedShare;
+    double bankruptShare; // households that have run out of money at least once
+    long long purchases;  // during the year
+    long long sales;      // during the year
+    double meanNetWorth;
+    double p5NetWorth;
+    double p50NetWorth;
+    double p95NetWorth;
+};
+
+struct populationResults
+{
+    long long households;
+    std::vector<populationYear> years;
+    double meanMonthSeconds; // wall time of one simulated month
+    double maxMonthSeconds;
+    double elapsedSeconds;
+};
+
+// Runs options.households households for params.simulationDuration years. Every household
+// starts renting; params gives the home, the loan, the rent and the rates. Prints why and
+// returns false if the distribution file can't be read.
+bool runPopulation(const simulationParams& params, const populationOptions& options, populationResults& results);
+
+void printPopulationResults(const populationResults& results);
+bool writePopulationCSV(const populationResults& results, const std::string& path);
@@ -0,0 +1,52 @@
+/*
+    * precision.h
+    * This header file defines the precision-targeted batch mode. Instead of a fixed trial count it
+    * adds trials in rounds until the confidence interval on the target metric is narrower than a
+    * given tolerance, using antithetic pairs and control variates to get there in fewer trials.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include "batch.h"
+
+enum precisionTarget
+{
+    TARGET_NET_WORTH,  // mean final net worth
+    TARGET_BANKRUPTCY  // bankruptcy rate
+};
+
+struct precisionOptions
+{
+    precisionTarget target = TARGET_NET_WORTH;
+    double tolerance = 1000;     // confidence interval half width to stop at, in the target's units
+    double confidence = 0.95;
+    bool antithetic = true;      // run trials in mirrored pairs
+    bool controlVariates = true; // regress out ETF growth, home growth and layoffs (precision.cpp)
+    long long roundTrials = 16384; // trials added between checks
+    long long maxTrials = 10000000;
+};
+
+struct precisionResults
+{
+    double estimate;
+    double halfWidth; // confidence interval is estimate +/- halfWidth
+    double stdError;
+    bool converged;   // halfWidth reached the tolerance before maxTrials
+    long long trials;
+    int rounds;
+
+    // Plain Monte Carlo on the same trials, for comparison.
+    double plainEstimate;
+    double plainStdError;
+    double plainHalfWidth;
+    // Trials plain Monte Carlo would need for the same interval, per trial actually run.
+    double speedup;
+
+    double elapsedSeconds;
+};
+
+precisionResults runToPrecision(const simulationParams& params, const precisionOptions& options,
+                                const batchOptions& batch);
+void printPrecisionResults(const precisionResults& results, const precisionOptions& options);
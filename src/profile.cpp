@@ -0,0 +1,256 @@
+/*
+    * profile.cpp
+    * This source file implements the per-thread profiler blocks, merging them and the report.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "profile.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace {
+
+const char* const COUNTER_NAMES[PROFILE_COUNTERS] = {
+    "trials", "months", "draws", "layoffs", "rehires", "homeSales", "bankruptcies"};
+const char* const PHASE_NAMES[PROFILE_PHASES] = {"setup", "draws", "simulate", "aggregate", "output"};
+
+uint64_t readTicks()
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// One thread's counters. Only the owning thread writes them; the atomics let collectProfile read
+// them from another thread, and are plain loads and stores on the owner's side.
+struct alignas(64) profileThread
+{
+    std::atomic<uint64_t> counts[PROFILE_COUNTERS];
+    std::atomic<uint64_t> ticks[PROFILE_PHASES];
+    std::atomic<uint64_t> entries[PROFILE_PHASES];
+    std::atomic<bool> used{false};
+
+    // Owner only: the phase the clock is running for and when it was last read.
+    int current = -1;
+    uint64_t mark = 0;
+
+    profileThread();
+    ~profileThread();
+
+    void clear()
+    {
+        for (auto& c : counts)
+            c.store(0, std::memory_order_relaxed);
+        for (int phase = 0; phase < PROFILE_PHASES; phase++) {
+            ticks[phase].store(0, std::memory_order_relaxed);
+            entries[phase].store(0, std::memory_order_relaxed);
+        }
+        used.store(false, std::memory_order_relaxed);
+    }
+};
+
+void bump(std::atomic<uint64_t>& value, uint64_t n)
+{
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// Live threads, and the totals of the ones that have exited since startProfile.
+struct profileRegistry
+{
+    std::mutex lock;
+    std::vector<profileThread*> threads;
+    profileReport retired = {};
+    uint64_t retiredTicks[PROFILE_PHASES] = {};
+
+    uint64_t startTicks = 0;
+    std::chrono::steady_clock::time_point start;
+};
+
+profileRegistry& registry()
+{
+    static profileRegistry* r = new profileRegistry(); // outlives the threads that exit at shutdown
+    return *r;
+}
+
+profileThread::profileThread()
+{
+    clear();
+    profileRegistry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.threads.push_back(this);
+}
+
+profileThread::~profileThread()
+{
+    profileRegistry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    for (int c = 0; c < PROFILE_COUNTERS; c++)
+        r.retired.counts[c] += counts[c].load(std::memory_order_relaxed);
+    for (int phase = 0; phase < PROFILE_PHASES; phase++) {
+        r.retiredTicks[phase] += ticks[phase].load(std::memory_order_relaxed);
+        r.retired.phaseEntries[phase] += entries[phase].load(std::memory_order_relaxed);
+    }
+    r.retired.threads += used.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < r.threads.size(); i++) {
+        if (r.threads[i] == this) {
+            r.threads.erase(r.threads.begin() + i);
+            break;
+        }
+    }
+}
+
+profileThread& localThread()
+{
+    thread_local profileThread local;
+    return local;
+}
+
+}
+
+void addProfileCount(profileCounter counter, uint64_t n)
+{
+    profileThread& t = localThread();
+    bump(t.counts[counter], n);
+    t.used.store(true, std::memory_order_relaxed);
+}
+
+int enterProfilePhase(profilePhase phase)
+{
+    profileThread& t = localThread();
+    uint64_t now = readTicks();
+    if (t.current >= 0)
+        bump(t.ticks[t.current], now - t.mark);
+    bump(t.entries[phase], 1);
+    t.used.store(true, std::memory_order_relaxed);
+
+    int previous = t.current;
+    t.current = phase;
+    t.mark = now;
+    return previous;
+}
+
+void leaveProfilePhase(int previous)
+{
+    profileThread& t = localThread();
+    uint64_t now = readTicks();
+    if (t.current >= 0)
+        bump(t.ticks[t.current], now - t.mark);
+    t.current = previous;
+    t.mark = now;
+}
+
+void startProfile()
+{
+    if constexpr (!PROFILING)
+        return;
+
+    profileRegistry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    for (profileThread* t : r.threads)
+        t->clear();
+    r.retired = profileReport();
+    std::fill(r.retiredTicks, r.retiredTicks + PROFILE_PHASES, 0);
+    r.start = std::chrono::steady_clock::now();
+    r.startTicks = readTicks();
+    profileRecording.store(true);
+}
+
+profileReport collectProfile()
+{
+    profileReport report = {};
+    if constexpr (!PROFILING)
+        return report;
+
+    profileRecording.store(false);
+    profileRegistry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - r.start).count();
+    uint64_t elapsedTicks = readTicks() - r.startTicks;
+    double secondsPerTick = elapsedTicks > 0 ? elapsed / elapsedTicks : 0;
+
+    report = r.retired;
+    uint64_t ticks[PROFILE_PHASES];
+    std::copy(r.retiredTicks, r.retiredTicks + PROFILE_PHASES, ticks);
+    for (const profileThread* t : r.threads) {
+        for (int c = 0; c < PROFILE_COUNTERS; c++)
+            report.counts[c] += t->counts[c].load(std::memory_order_relaxed);
+        for (int phase = 0; phase < PROFILE_PHASES; phase++) {
+            ticks[phase] += t->ticks[phase].load(std::memory_order_relaxed);
+            report.phaseEntries[phase] += t->entries[phase].load(std::memory_order_relaxed);
+        }
+        report.threads += t->used.load(std::memory_order_relaxed);
+    }
+    for (int phase = 0; phase < PROFILE_PHASES; phase++)
+        report.phaseSeconds[phase] = ticks[phase] * secondsPerTick;
+    report.elapsedSeconds = elapsed;
+    return report;
+}
+
+void printProfile(const profileReport& report)
+{
+    if (!PROFILING) {
+        std::cout << "Profiling was compiled out of this build (FP_PROFILE=0)" << std::endl;
+        return;
+    }
+
+    double busy = 0;
+    for (double seconds : report.phaseSeconds)
+        busy += seconds;
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "--------------------------------" << std::endl;
+    std::cout << "Profile: " << report.threads << " threads, " << report.elapsedSeconds << "s wall" << std::endl;
+    for (int c = 0; c < PROFILE_COUNTERS; c++)
+        std::cout << std::setw(14) << COUNTER_NAMES[c] << ": " << report.counts[c] << std::endl;
+    double simulate = report.phaseSeconds[PHASE_SIMULATE] + report.phaseSeconds[PHASE_DRAWS];
+    if (simulate > 0)
+        std::cout << "Months per thread-second stepping: " << report.counts[COUNT_MONTHS] / simulate << std::endl;
+    std::cout << "Phase: thread-seconds (share of timed), entries" << std::endl;
+    for (int phase = 0; phase < PROFILE_PHASES; phase++) {
+        std::cout << std::setw(14) << PHASE_NAMES[phase] << ": " << std::setprecision(4) << report.phaseSeconds[phase]
+                  << "s (" << std::setprecision(1) << (busy > 0 ? report.phaseSeconds[phase] * 100.0 / busy : 0)
+                  << "%), " << report.phaseEntries[phase] << std::endl;
+    }
+    std::cout << std::setprecision(2);
+    std::cout << "--------------------------------" << std::endl;
+}
+
+bool writeProfileJSON(const profileReport& report, const std::string& path)
+{
+    std::ofstream out(path);
+    if (!out)
+        return false;
+
+    out << std::setprecision(9);
+    out << "{" << std::endl;
+    out << "  \"compiled\": " << (PROFILING ? "true" : "false") << "," << std::endl;
+    out << "  \"threads\": " << report.threads << "," << std::endl;
+    out << "  \"elapsedSeconds\": " << report.elapsedSeconds << "," << std::endl;
+    out << "  \"counters\": {";
+    for (int c = 0; c < PROFILE_COUNTERS; c++)
+        out << (c > 0 ? ", " : "") << "\"" << COUNTER_NAMES[c] << "\": " << report.counts[c];
+    out << "}," << std::endl;
+    out << "  \"phases\": {" << std::endl;
+    for (int phase = 0; phase < PROFILE_PHASES; phase++) {
+        out << "    \"" << PHASE_NAMES[phase] << "\": {\"seconds\": " << report.phaseSeconds[phase]
+            << ", \"entries\": " << report.phaseEntries[phase] << "}" << (phase + 1 < PROFILE_PHASES ? "," : "")
+            << std::endl;
+    }
+    out << "  }" << std::endl;
+    out << "}" << std::endl;
+    return (bool)out;
+}
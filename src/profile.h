@@ -0,0 +1,128 @@
+/*
+    * profile.h
+    * This header file defines the built-in profiler: per-thread counters of the work a run does
+    * (months stepped, random draws, layoffs, rehires, home sales, bankruptcies) and timers of the
+    * phases it spends its time in, merged across threads and reported at the end of the run.
+    *
+    * Every thread counts into its own block, so counting never contends. Phase time is exclusive:
+    * entering a phase stops the clock of the one it interrupts, so nested phases add up to the
+    * wall time their threads were busy. Timers read the time stamp counter where there is one and
+    * steady_clock elsewhere; ticks are converted to seconds against steady_clock at the end.
+    *
+    * The profiler only records between startProfile() and collectProfile(), and every hook is
+    * under `if constexpr (PROFILING)`: building with -DFP_PROFILE=0 compiles all of it out.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#ifndef FP_PROFILE
+#define FP_PROFILE 1
+#endif
+
+constexpr bool PROFILING = FP_PROFILE != 0;
+
+enum profileCounter
+{
+    COUNT_TRIALS = 0,
+    COUNT_MONTHS, // months simulated, over every trial or household
+    COUNT_DRAWS,  // uniforms drawn
+    COUNT_LAYOFFS,
+    COUNT_REHIRES,
+    COUNT_HOME_SALES,
+    COUNT_BANKRUPTCIES,
+    PROFILE_COUNTERS
+};
+
+enum profilePhase
+{
+    PHASE_SETUP = 0, // schedules, kernel tables, economies and households
+    PHASE_DRAWS,     // filling the batched kernel's draws
+    PHASE_SIMULATE,  // stepping months
+    PHASE_AGGREGATE, // adding results to the statistics, merging and summarising them
+    PHASE_OUTPUT,    // writing trajectories, files and reports
+    PROFILE_PHASES
+};
+
+// Set while a profile is being recorded.
+inline std::atomic<bool> profileRecording{false};
+
+inline bool profiling()
+{
+    if constexpr (PROFILING)
+        return profileRecording.load(std::memory_order_relaxed);
+    else
+        return false;
+}
+
+// Adds n to counter on the calling thread.
+void addProfileCount(profileCounter counter, uint64_t n);
+
+inline void profileCount(profileCounter counter, uint64_t n = 1)
+{
+    if constexpr (PROFILING) {
+        if (profiling())
+            addProfileCount(counter, n);
+    }
+}
+
+// Enters phase on the calling thread and returns the phase it interrupted (-1 for none).
+int enterProfilePhase(profilePhase phase);
+// Leaves the current phase for `previous`, the value enterProfilePhase returned.
+void leaveProfilePhase(int previous);
+
+// Times its scope as phase.
+class ProfilePhase
+{
+public:
+    explicit ProfilePhase(profilePhase phase)
+    {
+        if constexpr (PROFILING) {
+            if (profiling()) {
+                previous = enterProfilePhase(phase);
+                entered = true;
+            }
+        }
+    }
+
+    ~ProfilePhase()
+    {
+        if constexpr (PROFILING) {
+            if (entered)
+                leaveProfilePhase(previous);
+        }
+    }
+
+    ProfilePhase(const ProfilePhase&) = delete;
+    ProfilePhase& operator=(const ProfilePhase&) = delete;
+
+private:
+    int previous = -1;
+    bool entered = false;
+};
+
+struct profileReport
+{
+    uint64_t counts[PROFILE_COUNTERS];
+    double phaseSeconds[PROFILE_PHASES]; // summed over threads
+    uint64_t phaseEntries[PROFILE_PHASES];
+    int threads;                         // threads that recorded anything
+    double elapsedSeconds;               // wall time from startProfile to collectProfile
+};
+
+// Clears every thread's counters and starts recording.
+void startProfile();
+
+// Stops recording and merges every thread's counters, including threads that have exited since.
+// Call it once the work is done: phases still open on other threads aren't counted.
+profileReport collectProfile();
+
+void printProfile(const profileReport& report);
+
+// Writes the report as one JSON object. Returns false if the file can't be written.
+bool writeProfileJSON(const profileReport& report, const std::string& path);
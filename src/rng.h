@@ -0,0 +1,160 @@
+/*
+    * rng.h
+    * This header file defines the random number layer used by the simulation.
+    *
+    * RandomStream is a Philox4x32-10 counter-based generator. The key comes from the run seed and
+    * the counter is (stream id, position), so every trial owns a separate stream that can be
+    * recreated from (seed, trial) alone, jumped to any position in O(1), and filled in blocks.
+    * Nothing is shared between streams, so threads never contend on generator state.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include "profile.h"
+
+// Two independent standard normals from two uniforms in [0, 1) (Box-Muller).
+inline void normalPair(double u0, double u1, double& z0, double& z1)
+{
+    const double TWO_PI = 6.283185307179586;
+    double r = std::sqrt(-2.0 * std::log(1.0 - u0));
+    z0 = r * std::cos(TWO_PI * u1);
+    z1 = r * std::sin(TWO_PI * u1);
+}
+
+class RandomStream
+{
+public:
+    RandomStream(uint64_t seed = 0, uint64_t stream = 0)
+        : key0((uint32_t)seed), key1((uint32_t)(seed >> 32)), streamId(stream) {}
+
+    // Number of uniforms drawn so far.
+    uint64_t position() const { return pos; }
+
+    // Jumps to an absolute position / skips ahead n draws. Both are O(1).
+    void seek(uint64_t position) { pos = position; }
+    void skip(uint64_t n) { pos += n; }
+
+    uint64_t stream() const { return streamId; }
+
+    // An antithetic stream returns 1 - u - 2^-53 in place of every u of the plain stream (all
+    // 64 bits flipped), which stays inside [0, 1) and mirrors every uniform draw exactly.
+    void setAntithetic(bool on) { flipMask = on ? ~0ull : 0; }
+    bool antithetic() const { return flipMask != 0; }
+
+    // Stream for trial `trial` of a run. With antithetic pairs, trials 2k and 2k + 1 share
+    // stream k and the odd one is mirrored.
+    static RandomStream forTrial(uint64_t seed, uint64_t trial, bool antitheticPairs)
+    {
+        if (!antitheticPairs)
+            return RandomStream(seed, trial);
+        RandomStream rng(seed, trial >> 1);
+        rng.setAntithetic(trial & 1);
+        return rng;
+    }
+
+    // Next 64 random bits.
+    uint64_t next()
+    {
+        uint64_t block = pos >> 1;
+        if (block != cachedBlock) {
+            generateBlock(block, cached);
+            cachedBlock = block;
+        }
+        return cached[pos++ & 1] ^ flipMask;
+    }
+
+    // Uniform double in [0, 1).
+    double uniform()
+    {
+        uint64_t word = next();
+        return toUniform((uint32_t)(word >> 32), (uint32_t)word);
+    }
+
+    // Fills out[0..n) with the next n uniforms, the same values n calls to uniform() would give.
+    void fillUniform(double* out, size_t n)
+    {
+        profileCount(COUNT_DRAWS, n);
+        size_t i = 0;
+        while (i < n && (pos & 1)) // finish a half used block
+            out[i++] = uniform();
+
+        uint64_t words[2];
+        for (; i + 1 < n; i += 2) {
+            generateBlock(pos >> 1, words);
+            words[0] ^= flipMask;
+            words[1] ^= flipMask;
+            out[i] = toUniform((uint32_t)(words[0] >> 32), (uint32_t)words[0]);
+            out[i + 1] = toUniform((uint32_t)(words[1] >> 32), (uint32_t)words[1]);
+            pos += 2;
+        }
+
+        if (i < n)
+            out[i] = uniform();
+    }
+
+    // Philox4x32-10 round constants
+    static const uint32_t PHILOX_M0 = 0xD2511F53u;
+    static const uint32_t PHILOX_M1 = 0xCD9E8D57u;
+    static const uint32_t PHILOX_W0 = 0x9E3779B9u;
+    static const uint32_t PHILOX_W1 = 0xBB67AE85u;
+    static const int PHILOX_ROUNDS = 10;
+
+    // Top 53 bits of the 64 bit word (hi, lo) as a double in [0, 1). Only uses signed 32 bit
+    // conversions so the same arithmetic also vectorizes on plain SSE2/AVX2.
+    static double toUniform(uint32_t hi, uint32_t lo)
+    {
+        uint32_t top = hi >> 11;                 // 21 bits
+        uint32_t bottom = (hi << 21) | (lo >> 11); // 32 bits
+        double low = (double)(int32_t)(bottom ^ 0x80000000u) + 2147483648.0;
+        return ((double)(int32_t)top * 4294967296.0 + low) * (1.0 / 9007199254740992.0);
+    }
+
+private:
+    static void mulhilo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo)
+    {
+        uint64_t product = (uint64_t)a * b;
+        hi = (uint32_t)(product >> 32);
+        lo = (uint32_t)product;
+    }
+
+    // One Philox4x32-10 evaluation: counter (block, stream) under key (k0, k1) -> 128 random bits.
+    static void philox(uint32_t k0, uint32_t k1, uint64_t block, uint64_t stream, uint64_t out[2])
+    {
+        uint32_t c0 = (uint32_t)block, c1 = (uint32_t)(block >> 32);
+        uint32_t c2 = (uint32_t)stream, c3 = (uint32_t)(stream >> 32);
+
+        for (int round = 0; round < PHILOX_ROUNDS; round++) {
+            uint32_t hi0, lo0, hi1, lo1;
+            mulhilo(PHILOX_M0, c0, hi0, lo0);
+            mulhilo(PHILOX_M1, c2, hi1, lo1);
+            c0 = hi1 ^ c1 ^ k0;
+            c1 = lo1;
+            c2 = hi0 ^ c3 ^ k1;
+            c3 = lo0;
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+
+        out[0] = ((uint64_t)c1 << 32) | c0;
+        out[1] = ((uint64_t)c3 << 32) | c2;
+    }
+
+    void generateBlock(uint64_t block, uint64_t out[2]) const
+    {
+        philox(key0, key1, block, streamId, out);
+    }
+
+    uint32_t key0;
+    uint32_t key1;
+    uint64_t streamId;
+    uint64_t pos = 0;
+    uint64_t flipMask = 0;
+
+    uint64_t cachedBlock = ~0ull;
+    uint64_t cached[2] = {0, 0};
+};
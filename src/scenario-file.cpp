@@ -0,0 +1,245 @@
+/*
+    * scenario-file.cpp
+    * This source file implements scenario file parsing and the scenario batch run.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "scenario-file.h"
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include "error-func.h"
+#include "sweep.h"
+
+namespace {
+
+// Scenarios parsed and run per runBatches call, so the whole file never has to be in memory.
+const size_t SCENARIO_GROUP = 256;
+
+// A number, or true / false for 1 / 0.
+bool parseValue(std::string_view text, double& value)
+{
+    if (text == "true" || text == "false") {
+        value = text == "true";
+        return true;
+    }
+    return parse_float(text.data(), text.data() + text.size(), value);
+}
+
+}
+
+bool ScenarioReader::open(const std::string& path)
+{
+    this->path = path;
+    if (!file.open(path)) {
+        std::cout << "Could not read " << path << std::endl;
+        return false;
+    }
+    lines = LineReader(file);
+    return true;
+}
+
+void ScenarioReader::report(const std::string& message)
+{
+    std::cout << path << ":" << lines.lineNumber() << ": " << message << std::endl;
+    errors++;
+}
+
+bool ScenarioReader::next(const simulationParams& base, simulationParams& params, long long& line)
+{
+    std::string_view text;
+    while (lines.next(text)) {
+        params = base;
+        bool ok;
+        if (text.front() == '{')
+            ok = parseJSON(text, params);
+        else if (!headerRead) {
+            headerRead = true;
+            parseHeader(text);
+            continue;
+        }
+        else if (columns.empty()) {
+            errors++; // the header was bad and already reported
+            continue;
+        }
+        else
+            ok = parseCSV(text, params);
+
+        std::string problem;
+        if (ok && !checkParams(params, problem)) {
+            report(problem);
+            ok = false;
+        }
+        if (ok) {
+            line = lines.lineNumber();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ScenarioReader::parseHeader(std::string_view text)
+{
+    simulationParams probe = {};
+    for (std::string_view name : splitCells(text)) {
+        if (!setParam(probe, name, 0)) {
+            // Rows can't be matched up with a bad header, so none of them will be read.
+            report("unknown field '" + std::string(name) + "' in the CSV header");
+            columns.clear();
+            return false;
+        }
+        columns.push_back(name);
+    }
+    return true;
+}
+
+bool ScenarioReader::parseCSV(std::string_view text, simulationParams& params)
+{
+    std::vector<std::string_view> cells = splitCells(text);
+    if (cells.size() != columns.size()) {
+        report("expected " + std::to_string(columns.size()) + " values, got " + std::to_string(cells.size()));
+        return false;
+    }
+
+    for (size_t column = 0; column < cells.size(); column++) {
+        if (cells[column].empty())
+            continue;
+        double value;
+        if (!parseValue(cells[column], value)) {
+            report("'" + std::string(cells[column]) + "' is not a number (" + std::string(columns[column]) + ")");
+            return false;
+        }
+        setParam(params, columns[column], value);
+    }
+    return true;
+}
+
+bool ScenarioReader::parseJSON(std::string_view text, simulationParams& params)
+{
+    // A flat object of "field": number pairs; true and false stand for 1 and 0.
+    size_t at = 1;
+    auto skipSpace = [&]() {
+        while (at < text.size() && (text[at] == ' ' || text[at] == '\t'))
+            at++;
+    };
+    auto expect = [&](char c) {
+        skipSpace();
+        if (at >= text.size() || text[at] != c) {
+            report(std::string("expected '") + c + "' at column " + std::to_string(at + 1));
+            return false;
+        }
+        at++;
+        return true;
+    };
+
+    skipSpace();
+    bool empty = at < text.size() && text[at] == '}';
+    while (!empty) {
+        if (!expect('"'))
+            return false;
+        size_t close = text.find('"', at);
+        if (close == std::string_view::npos) {
+            report("unterminated field name");
+            return false;
+        }
+        std::string_view name = text.substr(at, close - at);
+        at = close + 1;
+        if (!expect(':'))
+            return false;
+
+        skipSpace();
+        size_t valueEnd = text.find_first_of(",} \t", at);
+        if (valueEnd == std::string_view::npos)
+            valueEnd = text.size();
+        std::string_view valueText = text.substr(at, valueEnd - at);
+        double value;
+        if (!parseValue(valueText, value)) {
+            report("'" + std::string(valueText) + "' is not a number (" + std::string(name) + ")");
+            return false;
+        }
+        if (!setParam(params, name, value)) {
+            report("unknown field '" + std::string(name) + "'");
+            return false;
+        }
+        at = valueEnd;
+
+        skipSpace();
+        if (at < text.size() && text[at] == ',') {
+            at++;
+            skipSpace();
+            continue;
+        }
+        break;
+    }
+
+    if (!expect('}'))
+        return false;
+    if (at != text.size()) {
+        report("unexpected text after the object");
+        return false;
+    }
+    return true;
+}
+
+bool runScenarioFile(const std::string& path, const simulationParams& base, const batchOptions& options,
+                     std::ostream& out, scenarioFileSummary& summary)
+{
+    summary = {};
+    ScenarioReader reader;
+    if (!reader.open(path))
+        return false;
+
+    // One pool for every group instead of a new one per runBatches call.
+    batchOptions groupOptions = options;
+    groupOptions.yearly = false;
+    std::unique_ptr<ThreadPool> ownPool;
+    if (groupOptions.pool == nullptr) {
+        ownPool.reset(new ThreadPool(options.threads));
+        groupOptions.pool = ownPool.get();
+    }
+
+    const std::vector<std::string> names = paramNames();
+    out << std::fixed << std::setprecision(2);
+    out << "line,";
+    for (const std::string& name : names)
+        out << name << ",";
+    out << "trials,meanNetWorth,p5NetWorth,p50NetWorth,p95NetWorth,bankruptcyRate,homeSaleRate" << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<simulationParams> scenarios;
+    std::vector<long long> lines;
+    simulationParams params;
+    long long line;
+    bool more = true;
+    while (more) {
+        scenarios.clear();
+        lines.clear();
+        while (scenarios.size() < SCENARIO_GROUP && (more = reader.next(base, params, line))) {
+            scenarios.push_back(params);
+            lines.push_back(line);
+        }
+        if (scenarios.empty())
+            break;
+
+        std::vector<batchResults> results = runBatches(scenarios, groupOptions);
+        for (size_t k = 0; k < scenarios.size(); k++) {
+            out << lines[k] << ",";
+            for (const std::string& name : names) {
+                double value;
+                getParam(scenarios[k], name, value);
+                out << value << ",";
+            }
+            const batchResults& b = results[k];
+            out << b.trials << "," << b.meanNetWorth << "," << b.p5NetWorth << "," << b.p50NetWorth << ","
+                << b.p95NetWorth << "," << std::setprecision(4) << b.bankruptcyRate << "," << b.homeSaleRate
+                << std::setprecision(2) << std::endl;
+        }
+        summary.scenarios += scenarios.size();
+    }
+
+    auto stop = std::chrono::steady_clock::now();
+    summary.badLines = reader.badLines();
+    summary.elapsedSeconds = std::chrono::duration<double>(stop - start).count();
+    return true;
+}
@@ -0,0 +1,64 @@
+/*
+    * scenario-file.h
+    * This header file defines scenario files: many simulationParams, one per line, run through
+    * the batch engine in one go. A line is either a CSV row or a JSON object:
+    *
+    *   homePrice,mortgageInterest,homeOwner      {"homePrice": 4.5e5, "homeOwner": true}
+    *   450000,5.5,1                              {"startingRent": 1900, "rentInflation": -0.5}
+    *
+    * The first CSV line is the header naming a simulationParams field per column; JSON lines
+    * name their own fields and can be mixed in. Fields a line doesn't set (or leaves as an empty
+    * CSV cell) keep their base value. Blank lines and lines starting with # are skipped.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "batch.h"
+#include "mapped-file.h"
+
+// Streams the scenarios out of a memory-mapped scenario file. Values are parsed straight out of
+// the mapping without copying lines; a line with a problem is reported and skipped.
+class ScenarioReader
+{
+public:
+    // Prints why and returns false if path can't be read.
+    bool open(const std::string& path);
+
+    // Reads the next good scenario as changes to base into params and its 1-based line number
+    // into line. Returns false at the end of the file.
+    bool next(const simulationParams& base, simulationParams& params, long long& line);
+
+    long long badLines() const { return errors; }
+
+private:
+    bool parseHeader(std::string_view text);
+    bool parseCSV(std::string_view text, simulationParams& params);
+    bool parseJSON(std::string_view text, simulationParams& params);
+    void report(const std::string& message);
+
+    std::string path;
+    MappedFile file;
+    LineReader lines;
+    long long errors = 0;
+    bool headerRead = false;
+    std::vector<std::string_view> columns; // CSV header fields, pointing into the mapping; empty if it was bad
+};
+
+struct scenarioFileSummary
+{
+    long long scenarios;
+    long long badLines;
+    double elapsedSeconds;
+};
+
+// Runs options.trials trials of every scenario in path, group by group, and writes one CSV row
+// per scenario to out: its line number, every simulationParams field, then the batch outcomes.
+// All scenarios use the same random streams. Returns false if the file can't be read.
+bool runScenarioFile(const std::string& path, const simulationParams& base, const batchOptions& options,
+                     std::ostream& out, scenarioFileSummary& summary);
@@ -0,0 +1,120 @@
+/*
+    * schedule.cpp
+    * This source file implements the scenario payment schedules and the amortization table cache.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "schedule.h"
+#include <cmath>
+#include <list>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include "sensitivity.h"
+#include "simulation.h"
+
+namespace {
+
+// The default scenario (defaultParams) borrows $480000 at 5% over 30 years; its table is
+// built by the compiler and seeds the cache.
+const int DEFAULT_TERM_MONTHS = 30 * 12;
+constexpr std::array<amortizationRow, DEFAULT_TERM_MONTHS> DEFAULT_AMORTIZATION =
+    makeAmortization<DEFAULT_TERM_MONTHS>(480000.0, 5.0);
+
+typedef std::tuple<double, double, int> amortizationKey;
+
+// Tables kept besides the default one; a sweep or a server sees a new loan for nearly every
+// scenario, so the least recently used ones go. Schedules still using a table keep it alive.
+const size_t TABLE_CACHE_SIZE = 256;
+
+typedef std::pair<amortizationKey, std::shared_ptr<const amortizationTable>> cacheEntry;
+
+std::mutex cacheLock;
+std::list<cacheEntry> recentTables; // most recently used first
+std::map<amortizationKey, std::list<cacheEntry>::iterator> cache;
+
+template <class T>
+std::shared_ptr<basicAmortizationTable<T>> buildTable(const T& principal, const T& annualRate, int termYears)
+{
+    auto table = std::make_shared<basicAmortizationTable<T>>();
+    table->principal = principal;
+    table->annualRate = annualRate;
+    table->termYears = termYears;
+    table->months = termYears > 0 ? termYears * 12 : 0;
+    table->storage.resize(table->months);
+    fillAmortization(table->storage.data(), table->months, principal, annualRate);
+    table->rows = table->storage.data();
+    return table;
+}
+
+template <class T>
+std::shared_ptr<const basicAmortizationTable<T>> loanTable(const T& principal, const T& annualRate, int termYears)
+{
+    return buildTable(principal, annualRate, termYears);
+}
+
+std::shared_ptr<const amortizationTable> loanTable(const double& principal, const double& annualRate, int termYears)
+{
+    return amortizationSchedule(principal, annualRate, termYears);
+}
+
+std::shared_ptr<const amortizationTable> defaultTable()
+{
+    auto table = std::make_shared<amortizationTable>();
+    table->principal = 480000.0;
+    table->annualRate = 5.0;
+    table->termYears = 30;
+    table->rows = DEFAULT_AMORTIZATION.data();
+    table->months = DEFAULT_TERM_MONTHS;
+    return table;
+}
+
+}
+
+std::shared_ptr<const amortizationTable> amortizationSchedule(double principal, double annualRate, int termYears)
+{
+    static const std::shared_ptr<const amortizationTable> pinned = defaultTable();
+    amortizationKey key(principal, annualRate, termYears);
+    if (key == amortizationKey(pinned->principal, pinned->annualRate, pinned->termYears))
+        return pinned;
+
+    std::lock_guard<std::mutex> guard(cacheLock);
+    auto found = cache.find(key);
+    if (found != cache.end()) {
+        recentTables.splice(recentTables.begin(), recentTables, found->second);
+        return found->second->second;
+    }
+
+    std::shared_ptr<const amortizationTable> table = buildTable(principal, annualRate, termYears);
+    recentTables.emplace_front(key, table);
+    cache[key] = recentTables.begin();
+    if (recentTables.size() > TABLE_CACHE_SIZE) {
+        cache.erase(recentTables.back().first);
+        recentTables.pop_back();
+    }
+    return table;
+}
+
+template <class T>
+basicSchedule<T> buildSchedule(const basicParams<T>& params)
+{
+    basicSchedule<T> s;
+
+    T principal = params.homePrice - params.homePrice * (params.downPayRatio / 100.0);
+    s.mortgage = loanTable(principal, params.mortgageInterest, (int)valueOf(params.loanLength));
+
+    s.etfMonthlyGrowth = pow(1 + params.etfAnnual / 100.0, 1.0 / 12.0);
+    s.homeMonthlyGrowth = pow(1 + params.appreciationRate / 100.0, 1.0 / 12.0);
+
+    int years = simulatedMonths(params) / 12 + 1;
+    for (int year = 0; year < years; year++) {
+        s.monthlyRent.push_back(params.startingRent * pow(1 + params.rentInflation / 100.0, year));
+        s.monthlyPropertyTax.push_back(params.homePrice * (params.propertyTaxRate / 12.0f / 100.0));
+        s.monthlyHOA.push_back(params.hoaAnnual / 12.0);
+    }
+    return s;
+}
+
+template basicSchedule<double> buildSchedule(const basicParams<double>& params);
+template basicSchedule<sensitivityDual> buildSchedule(const basicParams<sensitivityDual>& params);
@@ -0,0 +1,133 @@
+/*
+    * schedule.h
+    * This header file defines the payment schedules of a scenario: the mortgage amortization table
+    * (interest/principal split and remaining balance for every payment) and the monthly rent,
+    * property tax and HOA for every simulated year. They only depend on the scenario, so they are
+    * built once and every trial just looks them up.
+    *
+    * Like the rest of the monthly math they are templates on the number type; the plain double
+    * versions are amortizationRow, amortizationTable and scenarioSchedule.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+
+template <class T>
+struct basicParams;
+
+template <class T>
+struct basicAmortizationRow
+{
+    T payment;
+    T interest;
+    T principal;
+    T balance; // remaining after this payment
+};
+
+typedef basicAmortizationRow<double> amortizationRow;
+
+// (1 + rate)^periods by repeated squaring, so it can run at compile time unlike pow.
+template <class T>
+constexpr T compoundFactor(const T& rate, int periods)
+{
+    T result = 1.0;
+    T base = 1.0 + rate;
+    while (periods > 0) {
+        if (periods & 1)
+            result *= base;
+        base *= base;
+        periods >>= 1;
+    }
+    return result;
+}
+
+template <class T>
+constexpr T amortizedPayment(const T& principal, const T& monthlyRate, int months)
+{
+    if (months <= 0)
+        return 0.0;
+    if (monthlyRate == 0)
+        return principal / months;
+    T factor = compoundFactor(monthlyRate, months);
+    return principal * monthlyRate * factor / (factor - 1);
+}
+
+// Writes the `months` rows of a fixed rate loan to rows. annualRate is in percent.
+template <class T>
+constexpr void fillAmortization(basicAmortizationRow<T>* rows, int months, const T& principal, const T& annualRate)
+{
+    T monthlyRate = annualRate / 12.0 / 100.0;
+    T payment = amortizedPayment(principal, monthlyRate, months);
+    T balance = principal;
+    for (int month = 0; month < months; month++) {
+        basicAmortizationRow<T> row = {};
+        row.payment = payment;
+        row.interest = balance * monthlyRate;
+        row.principal = payment - row.interest;
+        balance -= row.principal;
+        row.balance = balance;
+        rows[month] = row;
+    }
+}
+
+template <int Months>
+constexpr std::array<amortizationRow, Months> makeAmortization(double principal, double annualRate)
+{
+    std::array<amortizationRow, Months> rows = {};
+    fillAmortization(rows.data(), Months, principal, annualRate);
+    return rows;
+}
+
+template <class T>
+struct basicAmortizationTable
+{
+    T principal;
+    T annualRate; // percent
+    int termYears;
+
+    const basicAmortizationRow<T>* rows; // termYears * 12 rows, either storage or a compile time table
+    int months;
+    std::vector<basicAmortizationRow<T>> storage;
+};
+
+typedef basicAmortizationTable<double> amortizationTable;
+
+// Returns the shared table for (principal, annualRate, termYears), building it on first use.
+// Thread safe. The default scenario's table is built at compile time and always kept; the last
+// few hundred others are cached, and a table lives on while any schedule holds it.
+std::shared_ptr<const amortizationTable> amortizationSchedule(double principal, double annualRate, int termYears);
+
+template <class T>
+struct basicSchedule
+{
+    std::shared_ptr<const basicAmortizationTable<T>> mortgage;
+
+    // One entry per simulated year, simulatedMonths(params) / 12 + 1 in all
+    std::vector<T> monthlyRent;
+    std::vector<T> monthlyPropertyTax;
+    std::vector<T> monthlyHOA;
+
+    // Expected monthly growth factors, (1 + annual rate)^(1/12), that a generated economy's
+    // monthly factors multiply.
+    T etfMonthlyGrowth;
+    T homeMonthlyGrowth;
+
+    // Payment due in month `month` of the loan; all zeros once it is paid off.
+    const basicAmortizationRow<T>& payment(int month) const
+    {
+        static const basicAmortizationRow<T> paidOff = {};
+        return month < mortgage->months ? mortgage->rows[month] : paidOff;
+    }
+};
+
+typedef basicSchedule<double> scenarioSchedule;
+
+// Plain schedules share their amortization table through amortizationSchedule. Schedules in
+// other number types carry the derivatives of one scenario, so they get a table of their own.
+template <class T>
+basicSchedule<T> buildSchedule(const basicParams<T>& params);
@@ -0,0 +1,179 @@
+/*
+    * sensitivity.cpp
+    * This source file implements the sensitivity analysis and its tornado report.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "sensitivity.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <memory>
+#include "economy.h"
+#include "policy.h"
+#include "stats.h"
+
+namespace {
+
+typedef basicParams<sensitivityDual> dualParams;
+
+struct sensitivityField
+{
+    const char* name;
+    double simulationParams::*value;
+    sensitivityDual dualParams::*dual;
+    bool percent; // changes are compared per percentage point rather than per 10% of the value
+};
+
+// Derivative direction i is field FIELDS[i].
+const sensitivityField FIELDS[SENSITIVITY_FIELDS] = {
+    {"preTaxIncome", &simulationParams::preTaxIncome, &dualParams::preTaxIncome, false},
+    {"homePrice", &simulationParams::homePrice, &dualParams::homePrice, false},
+    {"hoaAnnual", &simulationParams::hoaAnnual, &dualParams::hoaAnnual, false},
+    {"startingRent", &simulationParams::startingRent, &dualParams::startingRent, false},
+    {"downPayRatio", &simulationParams::downPayRatio, &dualParams::downPayRatio, true},
+    {"mortgageInterest", &simulationParams::mortgageInterest, &dualParams::mortgageInterest, true},
+    {"propertyTaxRate", &simulationParams::propertyTaxRate, &dualParams::propertyTaxRate, true},
+    {"appreciationRate", &simulationParams::appreciationRate, &dualParams::appreciationRate, true},
+    {"rentInflation", &simulationParams::rentInflation, &dualParams::rentInflation, true},
+    {"etfAnnual", &simulationParams::etfAnnual, &dualParams::etfAnnual, true}
+};
+
+// The scenario with every differentiated field as an input of its own.
+dualParams seedParams(const simulationParams& params)
+{
+    dualParams d;
+    d.preTaxIncome = params.preTaxIncome;
+    d.homePrice = params.homePrice;
+    d.loanLength = params.loanLength;
+    d.hoaAnnual = params.hoaAnnual;
+    d.startingRent = params.startingRent;
+    d.downPayRatio = params.downPayRatio;
+    d.mortgageInterest = params.mortgageInterest;
+    d.propertyTaxRate = params.propertyTaxRate;
+    d.purchaseSaleTax = params.purchaseSaleTax;
+    d.appreciationRate = params.appreciationRate;
+    d.rentInflation = params.rentInflation;
+    d.etfAnnual = params.etfAnnual;
+    d.simulationDuration = params.simulationDuration;
+    d.homeOwner = params.homeOwner;
+
+    for (int i = 0; i < SENSITIVITY_FIELDS; i++)
+        d.*FIELDS[i].dual = sensitivityDual::variable(params.*FIELDS[i].value, i);
+    return d;
+}
+
+// Per-worker accumulators, padded so neighbouring workers don't share a cache line.
+struct alignas(64) sensitivityTotals
+{
+    runningStats netWorth;
+    runningStats derivative[SENSITIVITY_FIELDS];
+};
+
+}
+
+sensitivityResults runSensitivity(const simulationParams& params, const batchOptions& options)
+{
+    sensitivityResults results = {};
+
+    std::unique_ptr<ThreadPool> ownPool;
+    ThreadPool* pool = options.pool;
+    if (pool == nullptr) {
+        ownPool.reset(new ThreadPool(options.threads));
+        pool = ownPool.get();
+    }
+
+    const dualParams seeded = seedParams(params);
+    const basicSchedule<sensitivityDual> schedule = buildSchedule(seeded);
+    std::shared_ptr<const EconomicScenarios> economy;
+    if (options.economy.enabled)
+        economy = economicScenarios(options.economy, options.seed, simulatedMonths(params));
+
+    std::vector<sensitivityTotals> totals(pool->size());
+
+    auto start = std::chrono::steady_clock::now();
+
+    withPolicy(options.policy, [&](const auto& policy) {
+        using Policy = std::decay_t<decltype(policy)>;
+        pool->parallelFor(options.trials, options.chunkSize, [&](size_t begin, size_t end, int worker) {
+            sensitivityTotals& local = totals[worker];
+            for (size_t trial = begin; trial < end; trial++) {
+                Simulation<Policy, sensitivityDual> sim(seeded, schedule, RandomStream(options.seed, trial), policy);
+                if (economy != nullptr)
+                    sim.useEconomy(economy->path(trial));
+                sim.run();
+
+                sensitivityDual worth = netWorth(sim.person());
+                local.netWorth.add(worth.value);
+                for (int i = 0; i < SENSITIVITY_FIELDS; i++)
+                    local.derivative[i].add(worth.d[i]);
+            }
+        });
+    });
+
+    auto stop = std::chrono::steady_clock::now();
+
+    sensitivityTotals merged;
+    for (const sensitivityTotals& t : totals) {
+        merged.netWorth.merge(t.netWorth);
+        for (int i = 0; i < SENSITIVITY_FIELDS; i++)
+            merged.derivative[i].merge(t.derivative[i]);
+    }
+
+    results.trials = merged.netWorth.count;
+    results.meanNetWorth = merged.netWorth.mean;
+    for (int i = 0; i < SENSITIVITY_FIELDS; i++) {
+        const runningStats& d = merged.derivative[i];
+        parameterSensitivity s;
+        s.field = FIELDS[i].name;
+        s.value = params.*FIELDS[i].value;
+        s.derivative = d.mean;
+        s.stdError = d.count > 0 ? d.stddev() / std::sqrt((double)d.count) : 0;
+        s.percent = FIELDS[i].percent;
+        s.change = s.percent ? 1.0 : std::fabs(s.value) * 0.1;
+        s.impact = s.derivative * s.change;
+        results.fields.push_back(s);
+    }
+    std::stable_sort(results.fields.begin(), results.fields.end(),
+                     [](const parameterSensitivity& a, const parameterSensitivity& b) {
+                         return std::fabs(a.impact) > std::fabs(b.impact);
+                     });
+
+    results.elapsedSeconds = std::chrono::duration<double>(stop - start).count();
+    results.trialsPerSecond = results.elapsedSeconds > 0 ? results.trials / results.elapsedSeconds : 0;
+    return results;
+}
+
+void printSensitivityResults(const sensitivityResults& results)
+{
+    const int halfWidth = 20; // characters on each side of the tornado's axis
+
+    double largest = 0;
+    for (const parameterSensitivity& s : results.fields)
+        largest = std::max(largest, std::fabs(s.impact));
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "--------------------------------" << std::endl;
+    std::cout << "Mean Net Worth: $" << results.meanNetWorth << " over " << results.trials << " trials" << std::endl;
+    std::cout << "Change in mean final net worth per unit, and for a change of one percentage point" << std::endl;
+    std::cout << "(rates) or 10% of the value (amounts):" << std::endl;
+    for (const parameterSensitivity& s : results.fields) {
+        int bar = largest > 0 ? (int)std::lround(std::fabs(s.impact) / largest * halfWidth) : 0;
+        std::string negative(halfWidth, ' '), positive(halfWidth, ' ');
+        if (s.impact < 0)
+            negative.replace(halfWidth - bar, bar, bar, '#');
+        else
+            positive.replace(0, bar, bar, '#');
+
+        std::cout << "  " << std::left << std::setw(17) << s.field << std::right
+                  << " $" << std::setw(13) << s.derivative << " +/- $" << std::setw(10) << 1.96 * s.stdError
+                  << "   " << (s.percent ? "+1 pt   " : "+10%    ") << " $" << std::setw(12) << s.impact
+                  << "  " << negative << "|" << positive << std::endl;
+    }
+    std::cout << "--------------------------------" << std::endl;
+    std::cout << "Elapsed: " << results.elapsedSeconds << "s ("
+              << results.trialsPerSecond << " trials/sec)" << std::endl;
+    std::cout << "--------------------------------" << std::endl;
+}
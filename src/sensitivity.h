@@ -0,0 +1,58 @@
+/*
+    * sensitivity.h
+    * This header file defines the sensitivity analysis: the derivatives of final net worth with
+    * respect to the continuous scenario parameters, averaged over a batch. Every trial runs once
+    * on dual numbers (dual.h) that carry the derivatives along every parameter at the same time,
+    * instead of bumping each parameter up and down and rerunning the whole batch.
+    *
+    * The derivatives are pathwise: each trial keeps its draws and its discrete events (layoffs,
+    * ETF and home sales, bankruptcy) fixed and differentiates the amounts. A small change of a
+    * parameter can also move one of those events to another month, say an earlier bankruptcy;
+    * that jump is not part of the derivative, so it describes how the amounts scale rather than
+    * how the odds of the events shift.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "batch.h"
+#include "dual.h"
+
+// The simulationParams fields differentiated: preTaxIncome, homePrice, hoaAnnual, startingRent,
+// downPayRatio, mortgageInterest, propertyTaxRate, appreciationRate, rentInflation, etfAnnual.
+// loanLength and simulationDuration are whole numbers of years and purchaseSaleTax is unused.
+const int SENSITIVITY_FIELDS = 10;
+
+typedef Dual<SENSITIVITY_FIELDS> sensitivityDual;
+
+struct parameterSensitivity
+{
+    std::string field;
+    double value;      // the field's value in the scenario
+    double derivative; // mean over trials of d(final net worth) / d(field)
+    double stdError;   // standard error of derivative
+    bool percent;      // the field is a rate in percent
+    double change;     // change the ranking is based on: one point for rates, 10% of value otherwise
+    double impact;     // derivative * change
+};
+
+struct sensitivityResults
+{
+    long long trials;
+    double meanNetWorth;
+
+    std::vector<parameterSensitivity> fields; // largest |impact| first
+
+    double elapsedSeconds;
+    double trialsPerSecond;
+};
+
+// Runs options.trials trials of the scenario on dual numbers, on the same streams as runBatch,
+// with options.policy and options.economy. Always uses the scalar engine.
+sensitivityResults runSensitivity(const simulationParams& params, const batchOptions& options);
+
+// Prints the fields ranked by impact with a tornado chart of the impact of the change.
+void printSensitivityResults(const sensitivityResults& results);
@@ -0,0 +1,249 @@
+/*
+    * server.cpp
+    * This source file implements the query server and its result cache.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "server.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include "sweep.h"
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+const char* const SHUTDOWN_RESPONSE = "{\"ok\": true, \"shutdown\": true}";
+
+namespace {
+
+// FNV-1a over the bit patterns of the key values.
+size_t hashValues(const std::vector<double>& values)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (double value : values) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        for (int byte = 0; byte < 8; byte++) {
+            hash ^= (bits >> (byte * 8)) & 0xff;
+            hash *= 1099511628211ull;
+        }
+    }
+    return (size_t)hash;
+}
+
+std::string jsonEscape(const std::string& text)
+{
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (c == '\n')
+            escaped += "\\n";
+        else if ((unsigned char)c < 0x20) {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", (unsigned char)c);
+            escaped += code;
+        }
+        else
+            escaped += c;
+    }
+    return escaped;
+}
+
+}
+
+queryKey makeQueryKey(const simulationParams& params, const batchOptions& options)
+{
+    static const std::vector<std::string> names = paramNames();
+
+    queryKey key;
+    key.values.reserve(names.size() + 21);
+    for (const std::string& name : names) {
+        double value;
+        getParam(params, name, value);
+        key.values.push_back(value);
+    }
+    const policyOptions& policy = options.policy;
+    key.values.push_back((double)options.seed);
+    key.values.push_back((double)options.trials);
+    key.values.push_back(policy.kind);
+    key.values.push_back(policy.investFraction);
+    key.values.push_back(policy.emergencyMonths);
+    key.values.push_back(policy.keepHome);
+    key.values.push_back(policy.homeSaleTrigger);
+
+    const economyOptions& economy = options.economy;
+    key.values.push_back(economy.enabled);
+    if (economy.enabled) {
+        for (double value : {(double)economy.paths, economy.etfVolatility, economy.homeVolatility,
+                             economy.layoffVolatility, economy.etfHomeCorrelation, economy.etfLayoffCorrelation,
+                             economy.homeLayoffCorrelation, (double)economy.recessions, economy.recessionStart,
+                             economy.recessionEnd, economy.recessionEtfReturn, economy.recessionHomeReturn,
+                             economy.recessionLayoffFactor, economy.blockMonths,
+                             (double)std::hash<std::string>()(economy.history)})
+            key.values.push_back(value);
+    }
+
+    // -0 and 0 ask the same question but hash differently; adding 0 turns -0 into 0.
+    for (double& value : key.values)
+        value += 0.0;
+    key.hash = hashValues(key.values);
+    return key;
+}
+
+const batchResults* ResultCache::find(const queryKey& key)
+{
+    auto found = index.find(key);
+    if (found == index.end()) {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+    entries.splice(entries.begin(), entries, found->second);
+    return &found->second->second;
+}
+
+void ResultCache::insert(const queryKey& key, const batchResults& results)
+{
+    if (capacity == 0)
+        return;
+
+    auto found = index.find(key);
+    if (found != index.end()) {
+        found->second->second = results;
+        entries.splice(entries.begin(), entries, found->second);
+        return;
+    }
+
+    if (entries.size() >= capacity) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+    entries.emplace_front(key, results);
+    index[key] = entries.begin();
+}
+
+batchResults QueryServer::run(const simulationParams& params, const batchOptions& options, bool& cached)
+{
+    queryKey key = makeQueryKey(params, options);
+    const batchResults* hit = cache.find(key);
+    cached = hit != nullptr;
+    if (cached)
+        return *hit;
+
+    batchOptions queryOptions = options;
+    queryOptions.pool = &pool;
+    queryOptions.yearly = false;
+    queryOptions.trajectory = nullptr;
+    batchResults results = runBatch(params, queryOptions);
+    cache.insert(key, results);
+    return results;
+}
+
+std::string formatQueryResponse(const batchResults& results, bool cached, double seconds)
+{
+    std::ostringstream out;
+    out.precision(10);
+    out << "{\"ok\": true, \"cached\": " << (cached ? "true" : "false") << ", \"seconds\": " << seconds
+        << ", \"trials\": " << results.trials << ", \"meanNetWorth\": " << results.meanNetWorth
+        << ", \"p5NetWorth\": " << results.p5NetWorth << ", \"p50NetWorth\": " << results.p50NetWorth
+        << ", \"p95NetWorth\": " << results.p95NetWorth << ", \"bankruptcyRate\": " << results.bankruptcyRate
+        << ", \"homeSaleRate\": " << results.homeSaleRate << "}";
+    return out.str();
+}
+
+std::string formatQueryError(const std::string& message)
+{
+    return "{\"ok\": false, \"error\": \"" + jsonEscape(message) + "\"}";
+}
+
+void serveStream(std::istream& in, std::ostream& out, const queryHandler& handler)
+{
+    std::string line;
+    while (std::getline(in, line)) {
+        std::string response = handler(line);
+        if (response.empty())
+            return;
+        out << response << std::endl; // flushed so a client waiting on the pipe sees it
+        if (response == SHUTDOWN_RESPONSE)
+            return;
+    }
+}
+
+bool serveSocket(const std::string& path, const queryHandler& handler)
+{
+#ifdef _WIN32
+    std::cout << "--socket needs a POSIX system; use stdin/stdout instead" << std::endl;
+    return false;
+#else
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cout << "Socket path " << path << " is too long" << std::endl;
+        return false;
+    }
+    std::strcpy(address.sun_path, path.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path.c_str()); // left behind by an earlier server
+    if (listener < 0 || bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 16) != 0) {
+        std::cout << "Could not listen on " << path << ": " << std::strerror(errno) << std::endl;
+        if (listener >= 0)
+            close(listener);
+        return false;
+    }
+    std::cout << "Listening on " << path << std::endl;
+
+    bool running = true;
+    while (running) {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0)
+            continue;
+
+        // Split what arrives into lines and answer each as soon as it is complete.
+        std::string pending;
+        char buffer[4096];
+        bool open = true;
+        while (open && running) {
+            ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+            if (received <= 0)
+                break;
+            pending.append(buffer, received);
+
+            size_t newline;
+            while (open && running && (newline = pending.find('\n')) != std::string::npos) {
+                std::string line = pending.substr(0, newline);
+                pending.erase(0, newline + 1);
+                std::string response = handler(line);
+                if (response.empty()) {
+                    open = false;
+                    break;
+                }
+                response += '\n';
+                for (size_t sent = 0; sent < response.size();) {
+                    ssize_t n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+                    if (n <= 0) {
+                        open = false;
+                        break;
+                    }
+                    sent += n;
+                }
+                running = response.compare(0, response.size() - 1, SHUTDOWN_RESPONSE) != 0;
+            }
+        }
+        close(client);
+    }
+
+    close(listener);
+    unlink(path.c_str());
+    return true;
+#endif
+}
@@ -0,0 +1,99 @@
+/*
+    * server.h
+    * This header file defines the query server: a long-running process that answers batch
+    * queries one line at a time over stdin/stdout or a Unix socket. The thread pool and the
+    * shared amortization tables stay alive between queries, and finished results are kept in an
+    * LRU cache keyed by everything that decides them, so asking again costs a hash lookup.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <functional>
+#include <iostream>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "batch.h"
+
+// Everything that decides a batchResults: every simulationParams field, the seed, the trial
+// count, the policy and the economy. Threads, kernel and chunk size only change how fast it runs.
+struct queryKey
+{
+    std::vector<double> values;
+    size_t hash;
+
+    bool operator==(const queryKey& other) const { return values == other.values; }
+};
+
+struct queryKeyHash
+{
+    size_t operator()(const queryKey& key) const { return key.hash; }
+};
+
+queryKey makeQueryKey(const simulationParams& params, const batchOptions& options);
+
+// Least recently used cache of batch results.
+class ResultCache
+{
+public:
+    explicit ResultCache(size_t capacity) : capacity(capacity) {}
+
+    // The cached results for key, now the most recently used, or nullptr.
+    const batchResults* find(const queryKey& key);
+    // Adds results for key, dropping the least recently used entry when full.
+    void insert(const queryKey& key, const batchResults& results);
+
+    size_t size() const { return entries.size(); }
+    long long hits = 0;
+    long long misses = 0;
+
+private:
+    using entry = std::pair<queryKey, batchResults>;
+
+    size_t capacity;
+    std::list<entry> entries; // most recently used first
+    std::unordered_map<queryKey, std::list<entry>::iterator, queryKeyHash> index;
+};
+
+// Runs batches on one persistent thread pool, answering repeats out of the cache.
+class QueryServer
+{
+public:
+    QueryServer(int threads, size_t cacheEntries) : pool(threads), cache(cacheEntries) {}
+
+    // The results of runBatch(params, options) without the per-year summaries; cached says
+    // whether they came out of the cache.
+    batchResults run(const simulationParams& params, const batchOptions& options, bool& cached);
+
+    const ResultCache& results() const { return cache; }
+
+private:
+    ThreadPool pool;
+    ResultCache cache;
+};
+
+// Turns one request line into one response line; empty means close the connection.
+using queryHandler = std::function<std::string(const std::string&)>;
+
+// Answers the lines of in on out until it ends or the handler says to stop.
+void serveStream(std::istream& in, std::ostream& out, const queryHandler& handler);
+
+// Listens on a Unix socket at path and serves one connection at a time, until a handler
+// response asks to shut down (see SHUTDOWN_RESPONSE). Prints why and returns false if the socket
+// can't be set up.
+bool serveSocket(const std::string& path, const queryHandler& handler);
+
+// Sent back for a shutdown request; serveSocket stops listening after sending it.
+extern const char* const SHUTDOWN_RESPONSE;
+
+// {"ok": true, "cached": ..., "seconds": ..., "trials": ..., "meanNetWorth": ..., ...}
+std::string formatQueryResponse(const batchResults& results, bool cached, double seconds);
+// {"ok": false, "error": "..."}
+std::string formatQueryError(const std::string& message);
+
+// Most simulated months (trials x months per trial) one query may ask for, so a single query
+// can't hold the server up for long: a million trials of 80 years, or 2.7 million of 30.
+const double MAX_QUERY_MONTHS = 1e9;
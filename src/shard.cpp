@@ -0,0 +1,348 @@
+/*
+    * shard.cpp
+    * This source file implements sharded batch runs: shard files and the local coordinator.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "shard.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include "server.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char MAGIC[8] = "FPSHRD1";
+const uint32_t VERSION = 1;
+
+// Run keys and year counts larger than these are taken for a corrupt file.
+const uint64_t MAX_KEY_VALUES = 1024;
+const uint32_t MAX_YEARS = 1000;
+
+// Times a worker is started before the coordinator gives up on its shard.
+const int MAX_ATTEMPTS = 2;
+
+std::string shardName(const std::string& directory, shardSpec shard, const char* extension)
+{
+    return directory + "/shard-" + std::to_string(shard.index) + "-of-" + std::to_string(shard.count) + extension;
+}
+
+std::string describeShard(const shardHeader& header)
+{
+    return std::to_string(header.shardIndex) + "/" + std::to_string(header.shardCount);
+}
+
+void writeTotals(std::ostream& out, const batchTotals& totals)
+{
+    totals.finalNetWorth.write(out);
+    out.write(reinterpret_cast<const char*>(&totals.bankruptcies), sizeof(totals.bankruptcies));
+    out.write(reinterpret_cast<const char*>(&totals.homeSales), sizeof(totals.homeSales));
+    for (const yearlyMetrics& y : totals.years) {
+        y.netWorth.write(out);
+        y.equity.write(out);
+        y.bankBalance.write(out);
+        y.etfBalance.write(out);
+    }
+}
+
+bool readTotals(std::istream& in, batchTotals& totals)
+{
+    if (!totals.finalNetWorth.read(in) ||
+        !in.read(reinterpret_cast<char*>(&totals.bankruptcies), sizeof(totals.bankruptcies)) ||
+        !in.read(reinterpret_cast<char*>(&totals.homeSales), sizeof(totals.homeSales)))
+        return false;
+    for (yearlyMetrics& y : totals.years) {
+        if (!y.netWorth.read(in) || !y.equity.read(in) || !y.bankBalance.read(in) || !y.etfBalance.read(in))
+            return false;
+    }
+    return true;
+}
+
+#ifndef _WIN32
+// Starts one worker with its output going to logPath. Returns its pid, or -1.
+pid_t startWorker(const std::vector<std::string>& args, const std::string& logPath)
+{
+    // everything the child needs is built before the fork
+    std::vector<char*> argv;
+    for (const std::string& arg : args)
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        int log = open(logPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (log >= 0) {
+            dup2(log, STDOUT_FILENO);
+            dup2(log, STDERR_FILENO);
+            close(log);
+        }
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    return pid;
+}
+
+// The running executable, so workers are the same build as the coordinator.
+std::string selfPath(const std::string& program)
+{
+    char path[4096];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length <= 0)
+        return program;
+    path[length] = '\0';
+    return path;
+}
+#endif
+
+}
+
+bool parseShard(const std::string& text, shardSpec& shard)
+{
+    size_t slash = text.find('/');
+    std::string index = text.substr(0, slash);
+    std::string count = slash == std::string::npos ? "" : text.substr(slash + 1);
+    auto digits = [](const std::string& s) {
+        return !s.empty() && s.size() < 10 &&
+               std::all_of(s.begin(), s.end(), [](char c) { return c >= '0' && c <= '9'; });
+    };
+    if (!digits(index) || !digits(count) || std::stoi(index) >= std::stoi(count)) {
+        std::cout << "Expected --shard I/N with 0 <= I < N, got " << text << std::endl;
+        return false;
+    }
+    shard.index = std::stoi(index);
+    shard.count = std::stoi(count);
+    return true;
+}
+
+batchOptions shardOptions(const batchOptions& options, shardSpec shard)
+{
+    long long begin = options.trials * shard.index / shard.count;
+    long long end = options.trials * (shard.index + 1) / shard.count;
+
+    batchOptions narrowed = options;
+    narrowed.firstTrial = options.firstTrial + begin;
+    narrowed.trials = end - begin;
+    return narrowed;
+}
+
+bool writeShardFile(const std::string& path, const simulationParams& params, const batchOptions& wholeOptions,
+                    shardSpec shard, const batchTotals& totals)
+{
+    std::vector<double> key = makeQueryKey(params, wholeOptions).values;
+
+    shardHeader header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.shardIndex = shard.index;
+    header.shardCount = shard.count;
+    header.years = totals.years.size();
+    header.batchTrials = wholeOptions.trials;
+    header.firstTrial = shardOptions(wholeOptions, shard).firstTrial;
+    header.trials = totals.trials;
+    header.keyValues = key.size();
+
+    // Written next to the destination and renamed into place, so a worker that dies halfway
+    // never leaves a file that looks complete.
+    std::string partial = path + ".part";
+    {
+        std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(key.data()), key.size() * sizeof(double));
+        writeTotals(out, totals);
+        out.close();
+        if (!out) {
+            std::cout << "Could not write " << partial << std::endl;
+            return false;
+        }
+    }
+    if (std::rename(partial.c_str(), path.c_str()) != 0) {
+        std::cout << "Could not write " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool readShardFile(const std::string& path, shardFile& shard)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cout << "Could not open " << path << std::endl;
+        return false;
+    }
+
+    shardHeader& header = shard.header;
+    bool valid = in.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+                 std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == VERSION &&
+                 header.shardIndex < header.shardCount && header.keyValues <= MAX_KEY_VALUES &&
+                 header.years <= MAX_YEARS &&
+                 header.firstTrial + header.trials <= header.batchTrials;
+    if (valid) {
+        shard.key.resize(header.keyValues);
+        shard.totals = batchTotals();
+        shard.totals.trials = header.trials;
+        shard.totals.years.resize(header.years);
+        valid = in.read(reinterpret_cast<char*>(shard.key.data()), shard.key.size() * sizeof(double)) &&
+                readTotals(in, shard.totals) && in.peek() == std::char_traits<char>::eof() &&
+                shard.totals.finalNetWorth.quantiles.count() == (long long)header.trials;
+    }
+    if (!valid) {
+        std::cout << path << " is not a complete shard file" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool mergeShards(const std::vector<shardFile>& shards, batchTotals& merged)
+{
+    if (shards.empty()) {
+        std::cout << "No shard files to merge" << std::endl;
+        return false;
+    }
+
+    const shardFile& first = shards[0];
+    for (const shardFile& s : shards) {
+        if (s.key != first.key || s.header.batchTrials != first.header.batchTrials ||
+            s.header.years != first.header.years) {
+            std::cout << "Shard " << describeShard(s.header) << " is from a different run than shard "
+                      << describeShard(first.header) << std::endl;
+            return false;
+        }
+    }
+
+    // Lay the shards out by their first trial and check they tile the batch.
+    std::vector<const shardFile*> ordered;
+    for (const shardFile& s : shards)
+        ordered.push_back(&s);
+    std::stable_sort(ordered.begin(), ordered.end(), [](const shardFile* a, const shardFile* b) {
+        return a->header.firstTrial < b->header.firstTrial;
+    });
+
+    merged = batchTotals();
+    merged.years.resize(first.header.years);
+    uint64_t next = 0;
+    for (const shardFile* s : ordered) {
+        if (s->header.firstTrial < next) {
+            std::cout << "Shard " << describeShard(s->header) << " repeats trials from trial "
+                      << s->header.firstTrial << " on" << std::endl;
+            return false;
+        }
+        if (s->header.firstTrial > next) {
+            std::cout << "Trials " << next << " to " << s->header.firstTrial - 1 << " are in no shard" << std::endl;
+            return false;
+        }
+        merged.merge(s->totals);
+        next += s->header.trials;
+    }
+    if (next != first.header.batchTrials) {
+        std::cout << "Trials " << next << " to " << first.header.batchTrials - 1 << " are in no shard" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool runShardWorkers(const std::string& program, const std::vector<std::string>& batchArgs, int workers,
+                     const std::string& directory, std::vector<std::string>& files)
+{
+#ifdef _WIN32
+    (void)program;
+    (void)batchArgs;
+    (void)workers;
+    (void)directory;
+    (void)files;
+    std::cout << "shards needs fork and exec; run batch --shard I/N in separate processes and merge instead"
+              << std::endl;
+    return false;
+#else
+    if (workers <= 0) {
+        std::cout << "Expected --workers N with N > 0" << std::endl;
+        return false;
+    }
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cout << "Could not create " << directory << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // An equal share of the cores each; a later --threads in batchArgs takes precedence.
+    int threads = std::max(1, (int)std::thread::hardware_concurrency() / workers);
+    std::string executable = selfPath(program);
+
+    std::vector<std::vector<std::string>> args(workers);
+    std::vector<pid_t> pids(workers, -1);
+    std::vector<int> attempts(workers, 0);
+    files.clear();
+    for (int i = 0; i < workers; i++) {
+        shardSpec shard = {i, workers};
+        files.push_back(shardName(directory, shard, ".bin"));
+        args[i] = {executable, "batch", "--threads", std::to_string(threads)};
+        args[i].insert(args[i].end(), batchArgs.begin(), batchArgs.end());
+        args[i].insert(args[i].end(), {"--shard", std::to_string(i) + "/" + std::to_string(workers),
+                                       "--partial", files[i]});
+    }
+
+    auto launch = [&](int i) {
+        attempts[i]++;
+        pids[i] = startWorker(args[i], shardName(directory, {i, workers}, ".log"));
+        if (pids[i] < 0)
+            std::cout << "Could not start shard " << i << "/" << workers << ": " << std::strerror(errno) << std::endl;
+        return pids[i] >= 0;
+    };
+
+    int running = 0;
+    bool failed = false;
+    for (int i = 0; i < workers; i++) {
+        if (launch(i))
+            running++;
+        else
+            failed = true;
+    }
+
+    while (running > 0) {
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        int i = std::find(pids.begin(), pids.end(), pid) - pids.begin();
+        if (i == workers)
+            continue;
+        pids[i] = -1;
+        running--;
+
+        std::string name = std::to_string(i) + "/" + std::to_string(workers);
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            std::cout << "Shard " << name << " finished" << std::endl;
+            continue;
+        }
+
+        std::string reason = WIFSIGNALED(status) ? "signal " + std::to_string(WTERMSIG(status))
+                                                 : "exit code " + std::to_string(WEXITSTATUS(status));
+        std::string log = shardName(directory, {i, workers}, ".log");
+        if (attempts[i] < MAX_ATTEMPTS) {
+            std::cout << "Shard " << name << " failed (" << reason << "), starting it again" << std::endl;
+            if (launch(i))
+                running++;
+            else
+                failed = true;
+        }
+        else {
+            std::cout << "Shard " << name << " failed (" << reason << "), see " << log << std::endl;
+            failed = true;
+        }
+    }
+    return !failed;
+#endif
+}
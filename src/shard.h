@@ -0,0 +1,75 @@
+/*
+    * shard.h
+    * This header file defines sharded batch runs. A batch of T trials is split into N shards,
+    * shard i running the trials (and so the random streams) [T * i / N, T * (i + 1) / N). Each
+    * shard runs in a process of its own, possibly on another machine, and saves its unsummarised
+    * totals to a shard file; merging the files of every shard gives the results the whole batch
+    * would have given in one process. Quantiles, counts and rates come out identical, the mean
+    * and standard deviation agree to rounding, as they do between runs with different thread
+    * counts.
+    *
+    * Layout: a shardHeader, then header.keyValues doubles identifying the run (makeQueryKey of
+    * the whole batch), then the totals: final net worth, bankruptcies, home sales and
+    * header.years yearly metrics. All numbers are in the writing machine's byte order.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "batch.h"
+
+struct shardSpec
+{
+    int index = 0;
+    int count = 1;
+};
+
+// Parses "i/N" with 0 <= i < N. Prints why and returns false otherwise.
+bool parseShard(const std::string& text, shardSpec& shard);
+
+// options narrowed to the trials of shard.
+batchOptions shardOptions(const batchOptions& options, shardSpec shard);
+
+struct shardHeader
+{
+    char magic[8];        // "FPSHRD1"
+    uint32_t version;
+    uint32_t shardIndex;
+    uint32_t shardCount;
+    uint32_t years;       // yearly metrics stored, 0 when yearly summaries were off
+    uint64_t batchTrials; // trials of the whole batch
+    uint64_t firstTrial;  // the shard holds trials [firstTrial, firstTrial + trials)
+    uint64_t trials;
+    uint64_t keyValues;   // doubles in the run key that follows the header
+};
+
+struct shardFile
+{
+    shardHeader header;
+    std::vector<double> key; // identifies the whole run: scenario, seed, trials, policy, economy
+    batchTotals totals;
+};
+
+// Saves the totals of one shard of a batch of params with wholeOptions. Prints why and returns
+// false if the file can't be written.
+bool writeShardFile(const std::string& path, const simulationParams& params, const batchOptions& wholeOptions,
+                    shardSpec shard, const batchTotals& totals);
+
+// Prints why and returns false if path isn't a complete shard file.
+bool readShardFile(const std::string& path, shardFile& shard);
+
+// Merges shards of one batch into merged. Prints why and returns false unless they all come
+// from the same run and cover every one of its trials exactly once. The order doesn't matter.
+bool mergeShards(const std::vector<shardFile>& shards, batchTotals& merged);
+
+// Runs a batch as `workers` local worker processes, each one `program batch batchArgs --shard
+// i/N --partial DIRECTORY/shard-i-of-N.bin` with its output in shard-i-of-N.log. Workers get an
+// equal share of the hardware threads unless batchArgs sets --threads. A worker that fails is
+// started once more before giving up. Returns the shard files, or prints why and returns false.
+// Needs fork and exec, so POSIX only.
+bool runShardWorkers(const std::string& program, const std::vector<std::string>& batchArgs, int workers,
+                     const std::string& directory, std::vector<std::string>& files);
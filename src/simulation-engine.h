@@ -0,0 +1,310 @@
+/*
+    * simulation-engine.h
+    * This header file implements the simulation engine: the monthly step, the Simulation class
+    * that runs it a month at a time, and the trial loop declared in simulation.h. They are
+    * templates on the decision policy (policy.h) so every policy gets its own copy of the loop
+    * with the decisions inlined, and on the number type of the amounts (double, or the dual
+    * numbers of sensitivity.h); simulation.h includes this file at the end.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include "profile.h"
+#include "simulation.h"
+
+template <class Policy, class T>
+int simulateMonth(basicPerson<T>& p, const basicParams<T>& params, const basicSchedule<T>& schedule, int month,
+                  const monthDraws& draws, const Policy& policy)
+{
+    int events = EVENT_NONE;
+    int year = month / 12;
+
+    const basicAmortizationRow<T>& payment = schedule.payment(month);
+    p.monthlyMortgage = payment.payment;
+    p.monthlyPropertyTax = schedule.monthlyPropertyTax[year];
+    p.monthlyHOA = schedule.monthlyHOA[year];
+    p.monthlyRent = p.homeOwner ? 0 : schedule.monthlyRent[year]; // No rent if homeowner
+    if (draws.economy != nullptr)
+        p.monthlyRent *= draws.economy->rentLevel;
+
+    if (draws.economy != nullptr)
+        growETFBalance(p.etfBalance, schedule.etfMonthlyGrowth * draws.economy->etfFactor - 1.0, Policy::verbose);
+    else
+        updateETFBalance(p.etfBalance, params.etfAnnual, draws.u[DRAW_ETF], Policy::verbose);
+
+    T investAmount = policy.invest(p);
+    if (investAmount > 0 && investAmount <= p.bankBalance) {
+        p.bankBalance -= investAmount;
+        p.etfBalance += investAmount;
+    }
+
+    // If not a homeowner, update bank balance with rent
+    if (!p.homeOwner)
+        p.bankBalance -= p.monthlyRent;
+
+    // Calculate monthly income
+    p.netIncome = calculateMonthlyIncome(p.preTaxIncome, year, p.employed);
+    if (p.employed) {
+        p.bankBalance += p.netIncome;
+    } else {
+        // If unemployed, we lose money
+        p.bankBalance -= p.monthlyMortgage + p.monthlyPropertyTax + p.monthlyHOA;
+    }
+
+    // Update home value based on appreciation
+    if (draws.economy != nullptr) {
+        p.homeValue *= schedule.homeMonthlyGrowth * draws.economy->homeFactor;
+    } else {
+        float fluctuation = marketFluctuation(draws.u[DRAW_HOME]); // -2% to +2%
+        p.homeValue *= (1 + params.appreciationRate / 100.0 / 12.0 + fluctuation);
+    }
+
+    // If homeowner, pay mortgage and property tax
+    if (p.homeOwner) {
+        p.bankBalance -= p.monthlyMortgage + p.monthlyPropertyTax + p.monthlyHOA;
+
+        p.mortgageBalance -= payment.principal;
+        p.totalPaidOnMortgage += payment.principal + p.monthlyPropertyTax + p.monthlyHOA;
+
+        p.totalEquity = p.homeValue - p.mortgageBalance;
+    } else {
+        // If not a homeowner, update bank balance with rent
+        p.bankBalance -= p.monthlyRent;
+    }
+
+    // If unemployed, try to get a job
+    if (!p.employed) {
+        if (getAJob(draws.u[DRAW_REHIRE])) {
+            if (Policy::verbose)
+                std::cout << "Got a job!\n";
+            p.employed = true;
+            events |= EVENT_REHIRED;
+        }
+    }
+
+    // Check for unemployment; a generated economy sets the odds month by month
+    bool laidOff = draws.economy != nullptr ? draws.u[DRAW_UNEMPLOYMENT] < draws.economy->layoffChance
+                                            : didWeBetItAllOnBlack(draws.u[DRAW_UNEMPLOYMENT]);
+    if (laidOff) {
+        if (Policy::verbose)
+            std::cout << "Unemployment occurred!\n";
+        p.employed = false;
+        events |= EVENT_UNEMPLOYED;
+    }
+
+    // Sell ETF if bank balance is low
+    if (p.bankBalance < 0) {
+        T sellAmount = policy.sellETF(p);
+        if (sellAmount > 0 && sellAmount <= p.etfBalance) {
+            T transactionFee = sellAmount * ETF_SALE_FEE;
+            p.etfBalance -= sellAmount;
+            p.bankBalance += sellAmount - transactionFee;
+        }
+    }
+
+    // Check if we want to sell the home
+    if (p.homeOwner && policy.sellHome(p, draws.u[DRAW_HOME_SALE])) {
+        T salePrice = p.homeValue;
+        T tax = calculateCapitalGainsTax(p.homeValue, salePrice);
+        p.bankBalance += (salePrice - tax);
+        p.homeValue = 0;
+        p.mortgageBalance = 0;
+        p.totalEquity = 0;
+        p.totalPaidOnMortgage = 0;
+        if (Policy::verbose)
+            std::cout << "Home sold for $" << salePrice << " with $" << tax << " in taxes.\n";
+        events |= EVENT_HOME_SOLD;
+    }
+
+    if (!p.homeOwner) {
+        // No equity or mortgage calculations for renters
+        p.mortgageBalance = 0;
+        p.totalEquity = 0;
+        p.totalPaidOnMortgage = 0;
+    }
+
+    // Check for bankruptcy
+    if (p.bankBalance < 0 && !p.employed) {
+        if (Policy::verbose)
+            std::cout << "Bankruptcy occurred!\n";
+        events |= EVENT_BANKRUPT;
+    }
+
+    return events;
+}
+
+// Everything a Simulation needs to carry on from the end of month `month`.
+struct simulationState
+{
+    Person person;
+    RandomStream rng;
+    int month;
+    bool bankrupt;
+    bool homeSold;
+};
+
+// One run of the simulation, a month at a time. All of its state lives in the object itself;
+// the schedule is shared, read only, and must outlive it. Nothing is allocated and nothing
+// global is touched (the profiler, when recording, counts into the calling thread's own block),
+// so any number of runs can go on side by side on any threads.
+// T is the number type of every amount; checkpoints and results are only kept for double runs.
+template <class Policy, class T = double>
+class Simulation
+{
+public:
+    // schedule must come from buildSchedule(params). The run draws from rng, starting wherever
+    // it is positioned.
+    Simulation(const basicParams<T>& params, const basicSchedule<T>& schedule, const RandomStream& rng,
+               const Policy& policy = Policy())
+        : params(params), schedule(&schedule), rng(rng), policy(policy), p(initialPerson(params)),
+          totalMonths(simulatedMonths(params)) {}
+
+    // Carries on from a saved state. params, schedule and policy may differ from the run that
+    // saved it; they apply from the next month on, and the run now ends at
+    // simulatedMonths(params), so a longer simulationDuration extends the horizon. The draws pick
+    // up where the state left them, so branches forked from one state share their randomness and
+    // a resumed run matches one that never stopped.
+    Simulation(const simulationParams& params, const scenarioSchedule& schedule, const simulationState& state,
+               const Policy& policy = Policy())
+        : params(params), schedule(&schedule), rng(state.rng), policy(policy), p(state.person),
+          currentMonth(state.month), totalMonths(simulatedMonths(params)), broke(state.bankrupt),
+          sold(state.homeSold) {}
+
+    // Runs the rest of the simulation in a generated economy: path[month] for every month from
+    // now until months(). A resumed run has to be given its economy again.
+    void useEconomy(const economyMonth* path) { economy = path; }
+
+    // Snapshot of the run between two months, for resuming or forking it later.
+    simulationState state() const
+    {
+        simulationState s;
+        s.person = p;
+        s.rng = rng;
+        s.month = currentMonth;
+        s.bankrupt = broke;
+        s.homeSold = sold;
+        return s;
+    }
+
+    // Simulates the next month and returns its monthEvent flags. Does nothing once finished.
+    int step()
+    {
+        if (finished())
+            return EVENT_NONE;
+
+        monthDraws draws;
+        fillMonthDraws(rng, draws);
+        return step(draws);
+    }
+
+    // Simulates the next month on draws someone else made, leaving this run's own stream where
+    // it is; several runs can step on one fillMonthDraws this way. draws.economy is replaced by
+    // this run's economy.
+    int step(const monthDraws& shared)
+    {
+        if (finished())
+            return EVENT_NONE;
+
+        if (currentMonth > 0 && currentMonth % 12 == 0)
+            p.preTaxIncome *= 1.05; // Assume a 5% salary increase each year
+
+        monthDraws draws = shared;
+        draws.economy = economy != nullptr ? &economy[currentMonth] : nullptr;
+        int events = simulateMonth(p, params, *schedule, currentMonth, draws, policy);
+        if (profiling())
+            countMonth(events);
+        currentMonth++;
+        if (events & EVENT_HOME_SOLD)
+            sold = true;
+        if (events & EVENT_BANKRUPT)
+            broke = true;
+        return events;
+    }
+
+    // Steps up to `months` months, stopping early if the run finishes. Returns the months simulated.
+    int run(int months)
+    {
+        int start = currentMonth;
+        while (currentMonth - start < months && !finished())
+            step();
+        return currentMonth - start;
+    }
+
+    // Runs to the end.
+    int run() { return run(totalMonths); }
+
+    bool finished() const { return broke || currentMonth >= totalMonths; }
+    bool bankrupt() const { return broke; }
+    bool homeSold() const { return sold; }
+
+    // Months simulated so far; person() is the state at the end of the last one.
+    int month() const { return currentMonth; }
+    int months() const { return totalMonths; }
+    const basicPerson<T>& person() const { return p; }
+    const RandomStream& stream() const { return rng; }
+
+    trialResult result() const
+    {
+        trialResult r;
+        r.finalState = p;
+        r.finalNetWorth = netWorth(p);
+        r.monthsSimulated = currentMonth;
+        r.bankrupt = broke;
+        r.homeSold = sold;
+        return r;
+    }
+
+private:
+    static void countMonth(int events)
+    {
+        profileCount(COUNT_MONTHS);
+        if (events & EVENT_UNEMPLOYED)
+            profileCount(COUNT_LAYOFFS);
+        if (events & EVENT_REHIRED)
+            profileCount(COUNT_REHIRES);
+        if (events & EVENT_HOME_SOLD)
+            profileCount(COUNT_HOME_SALES);
+        if (events & EVENT_BANKRUPT)
+            profileCount(COUNT_BANKRUPTCIES);
+    }
+
+    basicParams<T> params;
+    const basicSchedule<T>* schedule;
+    RandomStream rng;
+    Policy policy;
+    const economyMonth* economy = nullptr;
+
+    basicPerson<T> p;
+    int currentMonth = 0;
+    int totalMonths;
+    bool broke = false;
+    bool sold = false;
+};
+
+template <class Policy>
+trialResult simulateTrial(const simulationParams& params, const scenarioSchedule& schedule, RandomStream& rng,
+                          const Policy& policy, Person* snapshots, int interval, const economyMonth* economy)
+{
+    Simulation<Policy> sim(params, schedule, rng, policy);
+    sim.useEconomy(economy);
+    int steps = sim.months() / interval;
+    if (snapshots != nullptr)
+        snapshots[0] = sim.person();
+
+    while (!sim.finished()) {
+        sim.step();
+        if (snapshots != nullptr && !sim.bankrupt() && sim.month() % interval == 0)
+            snapshots[sim.month() / interval] = sim.person();
+    }
+
+    if (snapshots != nullptr && sim.bankrupt()) {
+        // the bankrupt month's snapshot and every later one never got recorded
+        for (int step = (sim.month() - 1) / interval + 1; step <= steps; step++)
+            snapshots[step] = sim.person();
+    }
+
+    rng = sim.stream();
+    return sim.result();
+}
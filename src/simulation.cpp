@@ -1,158 +1,132 @@
 /*
     * simulation.cpp
     * This source file implements the functions and logic for the home ownership simulation.
-    * It includes the simulation loop, financial calculations, and user interactions.
-    * 
+    * It includes the financial calculations and the pieces of the monthly step that aren't
+    * templates; the interactive session lives in main.cpp. The monthly math is instantiated at
+    * the end of the file for every number type the simulation runs on.
+    *
     * Contributors: Kade Miller, Eli Brunner
 */
 
 #include "simulation.h"
 #include <cmath>
-#include <iomanip>
-#include "error-func.h"
-
-void clearConsole() {
-    //G++ platform specific console clear
-#ifdef _WIN32
-    system("cls");
-#else
-    // POSIX compliant console clear
-    system("clear");
-#endif
-}
+#include "policy.h"
+#include "sensitivity.h"
 
-double calculateMonthlyIncome(double annualIncome, int currentYear, bool isEmployed) {
+template <class T>
+T calculateMonthlyIncome(const T& annualIncome, int currentYear, bool isEmployed) {
     if (!isEmployed) return 0.0;
     return annualIncome / 12.0;
 }
 
-double calculateMonthlyMortgage(double principal, double rate, int termYears) {
-    double monthlyRate = rate / 12.0 / 100.0;
+template <class T>
+T calculateMonthlyMortgage(const T& principal, const T& rate, int termYears) {
+    T monthlyRate = rate / 12.0 / 100.0;
     int termMonths = termYears * 12.0;
-    return principal * monthlyRate * pow(1 + monthlyRate, termMonths) / 
-           (pow(1 + monthlyRate, termMonths) - 1);
+    return amortizedPayment(principal, monthlyRate, termMonths);
+}
+
+double calculateMonthlyMortgage(double principal, double rate, int termYears) {
+    return calculateMonthlyMortgage<double>(principal, rate, termYears);
+}
+
+void fillMonthDraws(RandomStream& rng, monthDraws& draws)
+{
+    rng.fillUniform(draws.u, DRAWS_PER_MONTH);
+}
+
+int fluctuationStep(double u)
+{
+    return (int)(u * FLUCTUATION_STEPS);
+}
+
+// Maps a uniform draw onto the 400 evenly spaced steps between -2% and +2%
+double marketFluctuation(double u)
+{
+    return (fluctuationStep(u) - 200) / 10000.0;
 }
 
 // random unemployment chance
-bool didWeBetItAllOnBlack()
+bool didWeBetItAllOnBlack(double u)
 {
     // 10% chance of unemployment
-    return (rand() % 100) < 10;
+    return u < LAYOFF_CHANCE;
 }
 
-bool getAJob()
+bool getAJob(double u)
 {
-    // 1d6 every week (so 4 times a month)
-    for (int i = 0; i < 4; i++) {
-        if ((rand() % 6) + 1 >= 6) { // 4,5,6 succeeds
-            return true;
-        }
-    }
-    return false;
+    // 1d6 every week (so 4 times a month), a 6 gets the job.
+    // Same odds as rolling four times: 1 - (5/6)^4
+    return u < 1.0 - (5.0 / 6.0) * (5.0 / 6.0) * (5.0 / 6.0) * (5.0 / 6.0);
 }
 
-double getETFReturn(double annualReturn) {
-    double fluctuation = (rand() % 400 - 200) / 10000.0; // -2% to +2%
-    double monthlyRate = pow(1.0 + (annualReturn/100.0 + fluctuation), 1.0/12.0) - 1.0;
+template <class T>
+T getETFReturn(const T& annualReturn, double u) {
+    double fluctuation = marketFluctuation(u); // -2% to +2%
+    T monthlyRate = pow(1.0 + (annualReturn/100.0 + fluctuation), 1.0/12.0) - 1.0;
     return monthlyRate;
 }
 
-void updateETFBalance(double& etfBalance) {
-    double previousBalance = etfBalance;
-    double growthRate = getETFReturn(7.0); // 7% base annual return
-    etfBalance *= (1.0 + growthRate);
-    
-    double difference = etfBalance - previousBalance;
-    if (difference > 0) {
-        std::cout << "ETF balance increased by $" << difference << std::endl;
-    } else if (difference < 0) {
-        std::cout << "ETF balance decreased by $" << -difference << std::endl;
-    }
+template <class T>
+void updateETFBalance(T& etfBalance, const T& annualReturn, double u, bool verbose) {
+    growETFBalance(etfBalance, getETFReturn(annualReturn, u), verbose);
 }
 
-// player choice to invest in EFT
-void investInETF(double& bankBalance, double& etfBalance) {
-    std::string amount;
-    std::cout << "Do you want to invest in ETF? (Current ETF balance: $" << etfBalance << ", Current bank balance: $" << bankBalance << ")\n"
-              << "Enter amount to invest (or '0' to skip): ";
-    while(amount.length() <= 0) {
-        std::getline(std::cin, amount);
-        if (!is_float(amount)) {
-            std::cout << "That is not an acceptable input." << std::endl;
-            amount = "";
-        }
-    }
+template <class T>
+void growETFBalance(T& etfBalance, const T& monthlyReturn, bool verbose) {
+    T previousBalance = etfBalance;
+    etfBalance *= (1.0 + monthlyReturn);
 
-    double investAmount = std::stod(amount);
-    if (investAmount > 0 && investAmount <= bankBalance) {
-        bankBalance -= investAmount;
-        etfBalance += investAmount;
-        std::cout << "Invested $" << investAmount << " in ETF. New ETF balance: $" << etfBalance << std::endl;
-    } else if (investAmount > bankBalance) {
-        std::cout << "Insufficient funds to invest that amount." << std::endl;
-    } else {
-        std::cout << "No investment made." << std::endl;
-    }
-}
+    if (!verbose)
+        return;
 
-void sellETF(double& bankBalance, double& etfBalance) {
-    std::string amount;
-    std::cout << "Do you want to sell ETF? (Current ETF balance: $" << etfBalance << ", Current bank balance: $" << bankBalance << ")\n"
-              << "Enter amount to sell (or '0' to skip): ";
-    while(amount.length() <= 0) {
-        std::getline(std::cin, amount);
-        if (!is_float(amount)) {
-            std::cout << "That is not an acceptable input." << std::endl;
-            amount = "";
-        }
-    }
-
-    double sellAmount = std::stod(amount);
-    if (sellAmount > 0 && sellAmount <= etfBalance) {
-        // Transaction fee of 0.5% on the sell amount
-        double transactionFee = sellAmount * 0.005;
-        etfBalance -= sellAmount;
-        bankBalance += sellAmount - transactionFee;
-        std::cout << "Sold $" << sellAmount << " of ETF. New bank balance: $" << bankBalance << std::endl;
-    } else if (sellAmount > etfBalance) {
-        std::cout << "Insufficient ETF balance to sell that amount." << std::endl;
-    } else {
-        std::cout << "No sale made." << std::endl;
+    T difference = etfBalance - previousBalance;
+    if (difference > 0) {
+        std::cout << "ETF balance increased by $" << difference << '\n';
+    } else if (difference < 0) {
+        std::cout << "ETF balance decreased by $" << -difference << '\n';
     }
 }
 
-bool attemptHomeSale() {
-    return (rand() % 6) + 1 > 3; // 4,5,6 succeeds
+bool attemptHomeSale(double u) {
+    return u >= 0.5; // 1d6, 4,5,6 succeeds
 }
 
-double calculateCapitalGainsTax(double purchasePrice, double salePrice) {
-    double gain = salePrice - purchasePrice;
+template <class T>
+T calculateCapitalGainsTax(const T& purchasePrice, const T& salePrice) {
+    T gain = salePrice - purchasePrice;
     if (gain > 250000) {
         return gain * 0.09; // 9% tax
     }
     return 0.0;
 }
 
-void simulate(simulationParams params)
+template <class T>
+T netWorth(const basicPerson<T>& p)
 {
-    int year = 0;
-    int month = 0;
-
-    Person states[(int)params.simulationDuration + 1]; // +1 for initial state
+    T worth = p.bankBalance - p.mortgageBalance + p.etfBalance;
+    if (p.homeOwner) {
+        worth += p.homeValue;
+    }
+    return worth;
+}
 
-    Person p;
+template <class T>
+basicPerson<T> initialPerson(const basicParams<T>& params)
+{
+    basicPerson<T> p;
     p.bankBalance = 0;
     p.employed = true;
 
-    double price = params.homePrice;
-    double downpayment = price * (params.downPayRatio / 100.0);
-    double principal = price - downpayment;
-    double term = params.loanLength;
+    T price = params.homePrice;
+    T downpayment = price * (params.downPayRatio / 100.0);
+    T principal = price - downpayment;
+    double term = valueOf(params.loanLength);
 
-    double monthlyPropertyTax = price * (params.propertyTaxRate / 12.0f / 100.0);
-    double monthlyHOA = params.hoaAnnual / 12.0;
+    T monthlyPropertyTax = price * (params.propertyTaxRate / 12.0f / 100.0);
+    T monthlyHOA = params.hoaAnnual / 12.0;
 
-    double mortgagePayment = calculateMonthlyMortgage(principal, params.mortgageInterest / 100.0f, term);
+    T mortgagePayment = calculateMonthlyMortgage(principal, params.mortgageInterest, term);
 
     p.homeValue = price;
     p.mortgageBalance = price - downpayment;
@@ -168,171 +142,108 @@ void simulate(simulationParams params)
     p.netIncome = 0; // set later for post tax
     p.capitalGainsTax = 0; // set later if home is sold
 
-    std::cout << std::fixed << std::setprecision(2); // Set precision for monetary values
-    srand(time(0)); // Seed the random number generator
     p.etfBalance = 0; // Initial ETF balance
+    p.totalIncome = 0;
     p.homeOwner = params.homeOwner;
+    return p;
+}
 
-    while(month < params.simulationDuration*12)
-    {
-        std::cout << "Year: " << year + 1 << ", Month: " << (month % 12) + 1 << std::endl;
-
-        updateETFBalance(p.etfBalance);
-        if (p.bankBalance > 0) {
-            investInETF(p.bankBalance, p.etfBalance);
-        }
-        else {
-            std::cout << "Insufficient funds to invest in ETF." << std::endl;
-        }
-
-        // If not a homeowner, calculate rent and update bank balance
-        if (!p.homeOwner) {
-            p.monthlyRent = params.startingRent * pow(1 + params.rentInflation / 100.0, year);
-            p.bankBalance -= p.monthlyRent;
-        } else {
-            p.monthlyRent = 0; // No rent if homeowner
-        }
-
-        // Calculate monthly income
-        p.netIncome = calculateMonthlyIncome(p.preTaxIncome, year, p.employed);
-        if (p.employed) {
-            p.bankBalance += p.netIncome;
-        } else {
-            // If unemployed, we lose money
-            p.bankBalance -= p.monthlyMortgage + p.monthlyPropertyTax + p.monthlyHOA;
-        }
-
-        // Update home value based on appreciation
-        float fluctuation = (rand() % 400 - 200) / 10000.0; // -5% to +5%
-        p.homeValue *= (1 + params.appreciationRate / 100.0 / 12.0 + fluctuation);
-
-        // If homeowner, pay mortgage and property tax
-        if (p.homeOwner) {
-            p.bankBalance -= p.monthlyMortgage + p.monthlyPropertyTax + p.monthlyHOA;
-
-            double interest = p.mortgageBalance * (params.mortgageInterest / 100.0);
-            double principalPayment = p.monthlyMortgage - interest;
-            p.mortgageBalance -= principalPayment;
-            p.totalPaidOnMortgage += principalPayment + p.monthlyPropertyTax + p.monthlyHOA;
-
-            p.totalEquity = p.homeValue - p.mortgageBalance;
-        } else {
-            // If not a homeowner, update bank balance with rent
-            p.bankBalance -= p.monthlyRent;
-        }
-
-        // If unemployed, try to get a job
-        if (!p.employed) {
-            if (getAJob()) {
-                std::cout << "Got a job!" << std::endl;
-                p.employed = true;
-            }
-        }
-
-        // Check for unemployment
-        if (didWeBetItAllOnBlack()) {
-            std::cout << "Unemployment occurred!" << std::endl;
-            p.employed = false;
-        }
-
-        // Sell ETF if bank balance is low
-        if (p.bankBalance < 0 && p.etfBalance >= -p.bankBalance) {
-            sellETF(p.bankBalance, p.etfBalance);
-        }
+template <class T>
+T monthlyOutgoings(const basicPerson<T>& p)
+{
+    if (p.homeOwner)
+        return p.monthlyMortgage + p.monthlyPropertyTax + p.monthlyHOA;
+    return 2 * p.monthlyRent; // simulateMonth charges the rent twice
+}
 
-        // Check if we want to sell the home
-        if (p.homeOwner && p.bankBalance <= 0) {
-            if (attemptHomeSale()) {
-                double salePrice = p.homeValue;
-                double tax = calculateCapitalGainsTax(p.homeValue, salePrice);
-                p.bankBalance += (salePrice - tax);
-                p.homeValue = 0;
-                p.mortgageBalance = 0;
-                p.totalEquity = 0;
-                p.totalPaidOnMortgage = 0;
-                std::cout << "Home sold for $" << salePrice << " with $" << tax << " in taxes." << std::endl;
-            }
-        }
+template <class T>
+int simulatedMonths(const basicParams<T>& params)
+{
+    return (int)std::ceil(valueOf(params.simulationDuration) * 12);
+}
 
-        if (!p.homeOwner) {
-            // No equity or mortgage calculations for renters
-            p.mortgageBalance = 0;
-            p.totalEquity = 0;
-            p.totalPaidOnMortgage = 0;
-        }
-        states[year] = p; // Save state for this month
+trialResult simulateTrial(const simulationParams& params, const scenarioSchedule& schedule, RandomStream& rng,
+                          Person* snapshots, int interval)
+{
+    return simulateTrial(params, schedule, rng, CoverShortfallPolicy(), snapshots, interval);
+}
 
-        // Check for bankruptcy
-        if (p.bankBalance < 0 && !p.employed) {
-            std::cout << "Bankruptcy occurred!" << std::endl;
-            break;
-        }
-        if (year > 0) {
-            p.totalIncome = (p.bankBalance - states[year -1].bankBalance); // Calculate total income for the year
-        }
+void defaultParams(simulationParams* params)
+{
+    params->preTaxIncome = 90000;
+    params->homePrice = 600000;
+    params->downPayRatio = 20;
+    params->loanLength = 30;
+    params->mortgageInterest = 5;
+    params->propertyTaxRate = 1.2f;
+    params->hoaAnnual = 3000;
+    params->appreciationRate = 4;
+    params->purchaseSaleTax = 1.5f;
+    params->propertyTaxRate = 9;
+    params->startingRent = 2000;
+    params->rentInflation = 2;
+    params->etfAnnual = 7;
+    params->simulationDuration = 30;
+}
 
-        // Increment month and check if we need to move to the next year
-        month++;
-        if (month % 12 == 0) {
-            clearConsole();
-            year++;
-            p.preTaxIncome *= 1.05; // Assume a 5% salary increase each year
+bool checkParams(const simulationParams& params, std::string& problem)
+{
+    // Amounts can't be negative; rates and the duration are checked on their own below.
+    const std::pair<const char*, double> amounts[] = {
+        {"preTaxIncome", params.preTaxIncome}, {"homePrice", params.homePrice},
+        {"loanLength", params.loanLength},     {"hoaAnnual", params.hoaAnnual},
+        {"startingRent", params.startingRent}, {"propertyTaxRate", params.propertyTaxRate},
+        {"purchaseSaleTax", params.purchaseSaleTax},
+    };
+    const std::pair<const char*, double> others[] = {
+        {"downPayRatio", params.downPayRatio},         {"mortgageInterest", params.mortgageInterest},
+        {"appreciationRate", params.appreciationRate}, {"rentInflation", params.rentInflation},
+        {"etfAnnual", params.etfAnnual},               {"simulationDuration", params.simulationDuration},
+    };
+    for (const auto& [name, value] : amounts) {
+        if (!std::isfinite(value) || value < 0) {
+            problem = std::string(name) + " must be a number of 0 or more";
+            return false;
         }
     }
-
-    std::cout << "--- Simulation ended ---" << std::endl;
-
-    // Final state after simulation
-    states[year] = p;
-
-    double absoluteIncome = 0;
-    for (int i = 0; i <= year; i++) {
-        absoluteIncome += states[i].totalIncome;
-    }
-
-    // Print each year's state
-    for (int i = 0; i <= year; i++) {
-        double netWorth = states[i].bankBalance - states[i].mortgageBalance + states[i].etfBalance;
-        if (states[i].homeOwner) {
-            netWorth += states[i].homeValue;
+    for (const auto& [name, value] : others) {
+        if (!std::isfinite(value)) {
+            problem = std::string(name) + " must be a finite number";
+            return false;
         }
-        std::cout << "Year " << i + 1 << ":"
-                  << " Bank Balance: $" << states[i].bankBalance << ", "
-                  << " Home Value: $" << states[i].homeValue << ", "
-                  << " Total Equity: $" << states[i].totalEquity << ", "
-                  << " Total Paid on Mortgage: $" << states[i].totalPaidOnMortgage << ", "
-                  << " Pre-Tax Income: $" << states[i].preTaxIncome << ", "
-                  << " Net Income: $" << states[i].totalIncome
-                  << " Net Worth: $" << netWorth
-                  << std::endl;
     }
 
-    std::cout << "Final Assets:" << std::endl;
-    std::cout << "Bank Balance: $" << p.bankBalance << std::endl;
-    std::cout << "ETF Balance: $" << p.etfBalance << std::endl;
-    if (p.homeOwner) {
-        float netWorth = p.bankBalance + p.homeValue - p.mortgageBalance + p.etfBalance;
-        std::cout << "Home Value: $" << p.homeValue << std::endl;
-        std::cout << "Mortgage Balance: $" << p.mortgageBalance << std::endl;
-        std::cout << "Total Equity: $" << p.totalEquity << std::endl;
-        std::cout << "Total Paid on Mortgage: $" << p.totalPaidOnMortgage << std::endl;
-        std::cout << "Net Worth: $" << netWorth << std::endl;
+    if (params.simulationDuration <= 0 || params.simulationDuration > MAX_SIMULATION_YEARS) {
+        problem = "simulationDuration must be more than 0 and at most " +
+                  std::to_string((int)MAX_SIMULATION_YEARS) + " years";
+        return false;
     }
-    else
-    {
-        float netWorth = p.bankBalance + p.etfBalance;
-        std::cout << "Net Worth: $" << netWorth << std::endl;
+    if (params.loanLength > MAX_SIMULATION_YEARS) {
+        problem = "loanLength must be at most " + std::to_string((int)MAX_SIMULATION_YEARS) + " years";
+        return false;
     }
-    std::cout << "Total Income over simulation: $" << absoluteIncome << std::endl;
-    if (year < params.simulationDuration)
-    {
-        float yearFraction = (float)(month % 12) / 12.0f;
-        std::cout << "Simulation Duration: " << yearFraction << "/" << params.simulationDuration << " years" << std::endl;
+    if (params.downPayRatio < 0 || params.downPayRatio > 100) {
+        problem = "downPayRatio must be between 0 and 100";
+        return false;
     }
-    else
-        std::cout << "Simulation Duration: " << params.simulationDuration << " years" << std::endl;
-
-    std::cout << "--------------------------------" << std::endl;
-    std::cout << "Simulation completed successfully!" << std::endl;
-    std::cout << "--------------------------------" << std::endl;
+    if (params.mortgageInterest <= -100) {
+        problem = "mortgageInterest must be more than -100";
+        return false;
+    }
+    return true;
 }
+
+#define INSTANTIATE_MONTHLY_MATH(T) \
+    template T calculateMonthlyIncome(const T& annualIncome, int currentYear, bool isEmployed); \
+    template T calculateMonthlyMortgage(const T& principal, const T& rate, int termYears); \
+    template T getETFReturn(const T& annualReturn, double u); \
+    template void updateETFBalance(T& etfBalance, const T& annualReturn, double u, bool verbose); \
+    template void growETFBalance(T& etfBalance, const T& monthlyReturn, bool verbose); \
+    template T calculateCapitalGainsTax(const T& purchasePrice, const T& salePrice); \
+    template T netWorth(const basicPerson<T>& p); \
+    template basicPerson<T> initialPerson(const basicParams<T>& params); \
+    template T monthlyOutgoings(const basicPerson<T>& p); \
+    template int simulatedMonths(const basicParams<T>& params);
+
+INSTANTIATE_MONTHLY_MATH(double)
+INSTANTIATE_MONTHLY_MATH(sensitivityDual)
@@ -3,56 +3,199 @@
     * This header file defines the structures and function prototypes for the home ownership simulation.
     * It includes the Person structure to represent an individual's financial state and the simulationParams
     * structure to hold parameters for the simulation.
+    *
+    * Both are templates on their number type, as is the monthly math, so the same simulation can
+    * run on dual numbers (dual.h) and carry derivatives along; Person and simulationParams are
+    * the plain double versions everything else uses.
     * 
     * Contributors: Kade Miller
 */
 
+#pragma once
+
 #include <iostream>
+#include <string>
+#include "rng.h"
+#include "schedule.h"
 
-struct simulationParams
+template <class T>
+struct basicParams
 {
-    double preTaxIncome;
-    double homePrice;
-    double loanLength;
-    double hoaAnnual;
-    double startingRent;
-
-    double downPayRatio;
-    double mortgageInterest;
-    double propertyTaxRate;
-    double purchaseSaleTax;
-    double appreciationRate;
-    double rentInflation;
-    double etfAnnual;
-
-    double simulationDuration;
+    T preTaxIncome;
+    T homePrice;
+    T loanLength;
+    T hoaAnnual;
+    T startingRent;
+
+    T downPayRatio;
+    T mortgageInterest;
+    T propertyTaxRate;
+    T purchaseSaleTax;
+    T appreciationRate;
+    T rentInflation;
+    T etfAnnual;
+
+    T simulationDuration;
 
     bool homeOwner;
 
 };
 
-struct Person {
-    double bankBalance;
-    double homeValue;
-    double mortgageBalance;
-    double totalEquity;
-    double totalPaidOnMortgage;
+typedef basicParams<double> simulationParams;
+
+template <class T>
+struct basicPerson {
+    T bankBalance;
+    T homeValue;
+    T mortgageBalance;
+    T totalEquity;
+    T totalPaidOnMortgage;
 
-    double monthlyRent;
-    double monthlyMortgage;
-    double monthlyPropertyTax;
-    double monthlyHOA;
+    T monthlyRent;
+    T monthlyMortgage;
+    T monthlyPropertyTax;
+    T monthlyHOA;
 
-    double preTaxIncome;
-    double netIncome;
-    double capitalGainsTax;
+    T preTaxIncome;
+    T netIncome;
+    T capitalGainsTax;
 
-    double etfBalance;
+    T etfBalance;
 
-    double totalIncome;
+    T totalIncome;
 
     bool employed;
     bool homeOwner;
 };
 
-void simulate(simulationParams params);
\ No newline at end of file
+typedef basicPerson<double> Person;
+
+// Uniform draws consumed by one simulated month. Every month uses exactly DRAWS_PER_MONTH
+// draws whether or not an event needs them, so month m of a trial always starts at
+// stream position m * DRAWS_PER_MONTH.
+enum drawIndex {
+    DRAW_ETF = 0,
+    DRAW_HOME,
+    DRAW_REHIRE,
+    DRAW_UNEMPLOYMENT,
+    DRAW_HOME_SALE,
+    DRAWS_PER_MONTH
+};
+
+// Market and job conditions of one month of a generated economy (see economy.h).
+struct economyMonth {
+    double etfFactor;    // multiplies the expected monthly ETF growth
+    double homeFactor;   // multiplies the expected monthly home appreciation
+    double layoffChance; // chance of losing the job this month
+    double rentLevel;    // multiplies the scheduled rent
+};
+
+struct monthDraws {
+    double u[DRAWS_PER_MONTH];
+    // This month of the trial's economy, or nullptr for the plain model: independent uniform
+    // market moves and a fixed layoff chance.
+    const economyMonth* economy = nullptr;
+};
+
+// Flags returned by simulateMonth for the events that happened that month.
+enum monthEvent {
+    EVENT_NONE = 0,
+    EVENT_UNEMPLOYED = 1,
+    EVENT_REHIRED = 2,
+    EVENT_HOME_SOLD = 4,
+    EVENT_BANKRUPT = 8
+};
+
+// Outcome of one headless run of the simulation.
+struct trialResult {
+    Person finalState;
+    double finalNetWorth;
+    int monthsSimulated;
+    bool bankrupt;
+    bool homeSold;
+};
+
+void fillMonthDraws(RandomStream& rng, monthDraws& draws);
+
+// Market moves are drawn from FLUCTUATION_STEPS evenly spaced values; fluctuationStep maps a
+// uniform draw to its step so batched code can look the move up in a table.
+const int FLUCTUATION_STEPS = 400;
+int fluctuationStep(double u);
+double marketFluctuation(double u);
+template <class T>
+T getETFReturn(const T& annualReturn, double u);
+bool getAJob(double u);
+
+// Share of every ETF sale lost to the transaction fee.
+const double ETF_SALE_FEE = 0.005;
+
+// The monthly math below is instantiated for double and for the dual numbers of the sensitivity
+// analysis (sensitivity.h).
+template <class T>
+T calculateMonthlyIncome(const T& annualIncome, int currentYear, bool isEmployed);
+template <class T>
+T calculateMonthlyMortgage(const T& principal, const T& rate, int termYears);
+double calculateMonthlyMortgage(double principal, double rate, int termYears);
+template <class T>
+void updateETFBalance(T& etfBalance, const T& annualReturn, double u, bool verbose);
+template <class T>
+void growETFBalance(T& etfBalance, const T& monthlyReturn, bool verbose);
+
+// Chance of losing the job in any month of the plain model.
+const double LAYOFF_CHANCE = 0.10;
+bool didWeBetItAllOnBlack(double u);
+bool attemptHomeSale(double u);
+template <class T>
+T calculateCapitalGainsTax(const T& purchasePrice, const T& salePrice);
+template <class T>
+T netWorth(const basicPerson<T>& p);
+template <class T>
+basicPerson<T> initialPerson(const basicParams<T>& params);
+
+// What simulateMonth takes out of the bank this month while employed. p's monthly costs must
+// already be loaded for the month (simulateMonth does that before asking the policy to invest).
+template <class T>
+T monthlyOutgoings(const basicPerson<T>& p);
+
+// Advances p through month `month` of the run (0 based). Mortgage, rent, property tax and HOA
+// come from schedule. The month's decisions (how much to invest, when to sell ETF and the home)
+// come from policy; see policy.h for the interface and the built-in policies. Events are only
+// printed when Policy::verbose is set, so headless policies never touch std::cout.
+template <class Policy, class T>
+int simulateMonth(basicPerson<T>& p, const basicParams<T>& params, const basicSchedule<T>& schedule, int month,
+                  const monthDraws& draws, const Policy& policy);
+
+// Number of months a full run simulates; the run covers simulatedMonths / 12 complete years.
+template <class T>
+int simulatedMonths(const basicParams<T>& params);
+
+// Runs a full simulation with the given policy and returns the final state. The same stream
+// (seed, trial id) always reproduces the same result.
+// If snapshots is set it receives simulatedMonths(params) / interval + 1 states: the starting
+// state and the state after every `interval` months (every complete year by default). States
+// after a bankruptcy repeat the bankrupt state.
+// schedule must come from buildSchedule(params); it is shared by every trial of the scenario.
+// economy, if set, is the trial's generated economy and must cover every simulated month.
+template <class Policy>
+trialResult simulateTrial(const simulationParams& params, const scenarioSchedule& schedule, RandomStream& rng,
+                          const Policy& policy, Person* snapshots = nullptr, int interval = 12,
+                          const economyMonth* economy = nullptr);
+
+// simulateTrial with the default CoverShortfallPolicy, without any input or output. This is
+// what the batch kernel reproduces.
+trialResult simulateTrial(const simulationParams& params, const scenarioSchedule& schedule, RandomStream& rng,
+                          Person* snapshots = nullptr, int interval = 12);
+
+void defaultParams(simulationParams* params);
+
+// Longest simulationDuration and loanLength accepted, in years.
+const double MAX_SIMULATION_YEARS = 100;
+
+// Every way of setting parameters (the command line, scenario files, server queries and the
+// interactive prompts) checks them here before anything runs. Returns false and sets problem
+// if params can't be simulated: a duration outside (0, MAX_SIMULATION_YEARS], a negative loan
+// length, price, rent, income or fee, a down payment outside 0 to 100%, or a value that isn't
+// finite.
+bool checkParams(const simulationParams& params, std::string& problem);
+
+#include "simulation-engine.h"
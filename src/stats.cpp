@@ -0,0 +1,291 @@
+/*
+    * stats.cpp
+    * This source file implements the streaming accumulators used to summarise batch runs.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "stats.h"
+#include <algorithm>
+#include <cmath>
+#include <istream>
+#include <ostream>
+
+namespace {
+
+// Magnitudes below a cent are counted as zero rather than getting buckets of their own.
+const double MIN_INDEXABLE = 0.01;
+
+// Bucket stores wider than this are taken for a corrupt file rather than allocated.
+const long long MAX_STORED_BUCKETS = 1 << 20;
+
+template <class T>
+void writeValue(std::ostream& out, const T& value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <class T>
+bool readValue(std::istream& in, T& value)
+{
+    return (bool)in.read(reinterpret_cast<char*>(&value), sizeof(value));
+}
+
+}
+
+void runningStats::add(double value)
+{
+    count++;
+    double delta = value - mean;
+    mean += delta / count;
+    m2 += delta * (value - mean);
+}
+
+void runningStats::merge(const runningStats& other)
+{
+    if (other.count == 0)
+        return;
+    if (count == 0) {
+        *this = other;
+        return;
+    }
+
+    long long combined = count + other.count;
+    double delta = other.mean - mean;
+    mean += delta * other.count / combined;
+    m2 += other.m2 + delta * delta * ((double)count * other.count / combined);
+    count = combined;
+}
+
+void runningStats::write(std::ostream& out) const
+{
+    writeValue(out, count);
+    writeValue(out, mean);
+    writeValue(out, m2);
+}
+
+bool runningStats::read(std::istream& in)
+{
+    return readValue(in, count) && readValue(in, mean) && readValue(in, m2);
+}
+
+double runningStats::variance() const
+{
+    return count > 1 ? m2 / (count - 1) : 0.0;
+}
+
+double runningStats::stddev() const
+{
+    return std::sqrt(variance());
+}
+
+regressionMoments::regressionMoments(int controlCount)
+    : controls(std::min(controlCount, MAX_CONTROLS))
+{
+    meanC.assign(controls, 0.0);
+    scy.assign(controls, 0.0);
+    scc.assign(controls * controls, 0.0);
+}
+
+void regressionMoments::add(double y, const double* c)
+{
+    count++;
+    double dy = y - meanY;
+    meanY += dy / count;
+    syy += dy * (y - meanY);
+
+    // deviations from the old means times deviations from the updated ones, as in runningStats
+    double before[MAX_CONTROLS];
+    for (int j = 0; j < controls; j++) {
+        before[j] = c[j] - meanC[j];
+        meanC[j] += before[j] / count;
+    }
+    for (int j = 0; j < controls; j++) {
+        scy[j] += before[j] * (y - meanY);
+        for (int l = 0; l < controls; l++)
+            scc[j * controls + l] += before[j] * (c[l] - meanC[l]);
+    }
+}
+
+void regressionMoments::merge(const regressionMoments& other)
+{
+    if (other.count == 0)
+        return;
+    if (count == 0) {
+        *this = other;
+        return;
+    }
+
+    long long combined = count + other.count;
+    double weight = (double)count * other.count / combined;
+    double dy = other.meanY - meanY;
+    std::vector<double> dc(controls);
+    for (int j = 0; j < controls; j++)
+        dc[j] = other.meanC[j] - meanC[j];
+
+    syy += other.syy + dy * dy * weight;
+    for (int j = 0; j < controls; j++) {
+        scy[j] += other.scy[j] + dc[j] * dy * weight;
+        for (int l = 0; l < controls; l++)
+            scc[j * controls + l] += other.scc[j * controls + l] + dc[j] * dc[l] * weight;
+    }
+
+    meanY += dy * other.count / combined;
+    for (int j = 0; j < controls; j++)
+        meanC[j] += dc[j] * other.count / combined;
+    count = combined;
+}
+
+QuantileSketch::QuantileSketch(double relativeAccuracy)
+{
+    gamma = (1 + relativeAccuracy) / (1 - relativeAccuracy);
+    logGamma = std::log(gamma);
+}
+
+void QuantileSketch::bucketStore::add(int index, long long n)
+{
+    if (counts.empty()) {
+        offset = index;
+        counts.assign(1, 0);
+    }
+    else if (index < offset) {
+        counts.insert(counts.begin(), offset - index, 0);
+        offset = index;
+    }
+    else if (index >= offset + (int)counts.size()) {
+        counts.resize(index - offset + 1, 0);
+    }
+    counts[index - offset] += n;
+}
+
+// Offset, bucket count, then the counts.
+void QuantileSketch::bucketStore::write(std::ostream& out) const
+{
+    writeValue(out, offset);
+    writeValue(out, (long long)counts.size());
+    out.write(reinterpret_cast<const char*>(counts.data()), counts.size() * sizeof(long long));
+}
+
+bool QuantileSketch::bucketStore::read(std::istream& in)
+{
+    long long size = 0;
+    if (!readValue(in, offset) || !readValue(in, size) || size < 0 || size > MAX_STORED_BUCKETS)
+        return false;
+    counts.resize(size);
+    return (bool)in.read(reinterpret_cast<char*>(counts.data()), size * sizeof(long long));
+}
+
+// The accuracy is stored as gamma, so a sketch reads back with the buckets it was written with.
+void QuantileSketch::write(std::ostream& out) const
+{
+    writeValue(out, gamma);
+    positive.write(out);
+    negative.write(out);
+    writeValue(out, zeroCount);
+    writeValue(out, total);
+    writeValue(out, minValue);
+    writeValue(out, maxValue);
+}
+
+bool QuantileSketch::read(std::istream& in)
+{
+    if (!readValue(in, gamma) || !(gamma > 1) || !positive.read(in) || !negative.read(in))
+        return false;
+    logGamma = std::log(gamma);
+    return readValue(in, zeroCount) && readValue(in, total) && readValue(in, minValue) && readValue(in, maxValue);
+}
+
+int QuantileSketch::bucketIndex(double magnitude) const
+{
+    return (int)std::ceil(std::log(magnitude) / logGamma);
+}
+
+double QuantileSketch::bucketValue(int index) const
+{
+    // Midpoint (in relative terms) of (gamma^(index-1), gamma^index]
+    return 2.0 * std::pow(gamma, index) / (gamma + 1);
+}
+
+void QuantileSketch::add(double value)
+{
+    if (!std::isfinite(value)) // would need an unbounded number of buckets
+        return;
+
+    if (total == 0) {
+        minValue = value;
+        maxValue = value;
+    }
+    else {
+        minValue = std::min(minValue, value);
+        maxValue = std::max(maxValue, value);
+    }
+    total++;
+
+    if (value >= MIN_INDEXABLE)
+        positive.add(bucketIndex(value), 1);
+    else if (value <= -MIN_INDEXABLE)
+        negative.add(bucketIndex(-value), 1);
+    else
+        zeroCount++;
+}
+
+void QuantileSketch::merge(const QuantileSketch& other)
+{
+    if (other.total == 0)
+        return;
+
+    if (total == 0) {
+        minValue = other.minValue;
+        maxValue = other.maxValue;
+    }
+    else {
+        minValue = std::min(minValue, other.minValue);
+        maxValue = std::max(maxValue, other.maxValue);
+    }
+    total += other.total;
+    zeroCount += other.zeroCount;
+
+    for (size_t i = 0; i < other.positive.counts.size(); i++)
+        if (other.positive.counts[i] != 0)
+            positive.add(other.positive.offset + (int)i, other.positive.counts[i]);
+    for (size_t i = 0; i < other.negative.counts.size(); i++)
+        if (other.negative.counts[i] != 0)
+            negative.add(other.negative.offset + (int)i, other.negative.counts[i]);
+}
+
+double QuantileSketch::quantile(double q) const
+{
+    if (total == 0)
+        return 0.0;
+    q = std::min(std::max(q, 0.0), 1.0);
+
+    // Walk the buckets from the most negative value up until we pass the requested rank.
+    long long rank = (long long)(q * (total - 1));
+    long long seen = 0;
+    double value = 0.0;
+    bool found = false;
+
+    for (int i = (int)negative.counts.size() - 1; i >= 0 && !found; i--) {
+        seen += negative.counts[i];
+        if (seen > rank) {
+            value = -bucketValue(negative.offset + i);
+            found = true;
+        }
+    }
+
+    if (!found) {
+        seen += zeroCount;
+        if (seen > rank)
+            found = true; // value stays 0
+    }
+
+    for (size_t i = 0; i < positive.counts.size() && !found; i++) {
+        seen += positive.counts[i];
+        if (seen > rank) {
+            value = bucketValue(positive.offset + (int)i);
+            found = true;
+        }
+    }
+
+    return std::min(std::max(value, minValue), maxValue);
+}
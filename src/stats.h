@@ -0,0 +1,125 @@
+/*
+    * stats.h
+    * This header file defines the streaming accumulators used to summarise batch runs. Each one
+    * uses a fixed amount of memory no matter how many values it sees, and two accumulators can be
+    * merged, so every worker thread keeps its own and they are combined once at the end.
+    *
+    * write and read save an accumulator in a compact binary form (native byte order) and load it
+    * back exactly, so partial results of other processes can be merged too (shard.h).
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <iosfwd>
+#include <vector>
+
+// Count, mean and variance using Welford's update; merge uses Chan's pairwise formula.
+struct runningStats
+{
+    long long count = 0;
+    double mean = 0;
+    double m2 = 0; // sum of squared differences from the mean
+
+    void add(double value);
+    void merge(const runningStats& other);
+
+    void write(std::ostream& out) const;
+    bool read(std::istream& in);
+
+    double variance() const;
+    double stddev() const;
+};
+
+// Joint mean and co-moments of a response y and a fixed number of control values, for control
+// variate regression. Same single-pass update and pairwise merge as runningStats.
+struct regressionMoments
+{
+    static constexpr int MAX_CONTROLS = 8;
+
+    explicit regressionMoments(int controlCount = 0);
+
+    void add(double y, const double* c); // c holds `controls` values
+    void merge(const regressionMoments& other);
+
+    int controls;
+    long long count = 0;
+    double meanY = 0;
+    double syy = 0;                 // sum of squared y deviations
+    std::vector<double> meanC;      // [controls]
+    std::vector<double> scy;        // [controls] sum of c_j, y co-deviations
+    std::vector<double> scc;        // [controls * controls] sum of c_j, c_l co-deviations
+};
+
+// Log-bucketed quantile sketch. Values are counted in buckets whose bounds grow by a constant
+// factor, so any quantile comes back within relativeAccuracy of a value that was actually seen.
+// Merging just adds bucket counts, which makes the result independent of how the values were
+// split between threads.
+class QuantileSketch
+{
+public:
+    explicit QuantileSketch(double relativeAccuracy = 0.005);
+
+    void add(double value);
+    void merge(const QuantileSketch& other);
+
+    void write(std::ostream& out) const;
+    bool read(std::istream& in);
+
+    // q in [0, 1]. Returns 0 for an empty sketch.
+    double quantile(double q) const;
+    long long count() const { return total; }
+
+private:
+    // Bucket counts for one sign, indexed from offset.
+    struct bucketStore
+    {
+        int offset = 0;
+        std::vector<long long> counts;
+
+        void add(int index, long long n);
+        void write(std::ostream& out) const;
+        bool read(std::istream& in);
+    };
+
+    int bucketIndex(double magnitude) const;
+    double bucketValue(int index) const;
+
+    double gamma;
+    double logGamma;
+
+    bucketStore positive;
+    bucketStore negative; // indexed by magnitude
+    long long zeroCount = 0;
+    long long total = 0;
+    double minValue = 0;
+    double maxValue = 0;
+};
+
+// Moments and quantiles of one quantity.
+struct metricStats
+{
+    runningStats moments;
+    QuantileSketch quantiles;
+
+    void add(double value)
+    {
+        moments.add(value);
+        quantiles.add(value);
+    }
+
+    void merge(const metricStats& other)
+    {
+        moments.merge(other.moments);
+        quantiles.merge(other.quantiles);
+    }
+
+    void write(std::ostream& out) const
+    {
+        moments.write(out);
+        quantiles.write(out);
+    }
+
+    bool read(std::istream& in) { return moments.read(in) && quantiles.read(in); }
+};
@@ -0,0 +1,217 @@
+/*
+    * sweep.cpp
+    * This source file implements the parameter sweep mode.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "sweep.h"
+#include <cmath>
+#include <iomanip>
+#include "error-func.h"
+
+namespace {
+
+struct paramField
+{
+    const char* name;
+    double simulationParams::* member;
+};
+
+const paramField PARAM_FIELDS[] = {
+    {"preTaxIncome", &simulationParams::preTaxIncome},
+    {"homePrice", &simulationParams::homePrice},
+    {"loanLength", &simulationParams::loanLength},
+    {"hoaAnnual", &simulationParams::hoaAnnual},
+    {"startingRent", &simulationParams::startingRent},
+    {"downPayRatio", &simulationParams::downPayRatio},
+    {"mortgageInterest", &simulationParams::mortgageInterest},
+    {"propertyTaxRate", &simulationParams::propertyTaxRate},
+    {"purchaseSaleTax", &simulationParams::purchaseSaleTax},
+    {"appreciationRate", &simulationParams::appreciationRate},
+    {"rentInflation", &simulationParams::rentInflation},
+    {"etfAnnual", &simulationParams::etfAnnual},
+    {"simulationDuration", &simulationParams::simulationDuration},
+};
+
+const paramField* findField(std::string_view name)
+{
+    for (const paramField& f : PARAM_FIELDS) {
+        if (name == f.name)
+            return &f;
+    }
+    return nullptr;
+}
+
+bool readValue(const std::string& text, const std::string& spec, double& out)
+{
+    if (!is_float(text)) {
+        std::cout << "'" << text << "' in " << spec << " is not a number" << std::endl;
+        return false;
+    }
+    out = std::stod(text);
+    return true;
+}
+
+}
+
+bool setParam(simulationParams& params, std::string_view name, double value)
+{
+    if (name == "homeOwner") {
+        params.homeOwner = value != 0;
+        return true;
+    }
+
+    const paramField* field = findField(name);
+    if (field == nullptr)
+        return false;
+    params.*(field->member) = value;
+    return true;
+}
+
+bool getParam(const simulationParams& params, std::string_view name, double& value)
+{
+    if (name == "homeOwner") {
+        value = params.homeOwner ? 1 : 0;
+        return true;
+    }
+
+    const paramField* field = findField(name);
+    if (field == nullptr)
+        return false;
+    value = params.*(field->member);
+    return true;
+}
+
+std::vector<std::string> paramNames()
+{
+    std::vector<std::string> names;
+    for (const paramField& f : PARAM_FIELDS)
+        names.push_back(f.name);
+    names.push_back("homeOwner");
+    return names;
+}
+
+bool parseSweepAxis(const std::string& spec, sweepAxis& axis)
+{
+    size_t equals = spec.find('=');
+    if (equals == std::string::npos) {
+        std::cout << "Expected field=values, got " << spec << std::endl;
+        return false;
+    }
+
+    axis.field = spec.substr(0, equals);
+    axis.values.clear();
+    simulationParams probe = {};
+    if (!setParam(probe, axis.field, 0)) {
+        std::cout << "Unknown parameter " << axis.field << std::endl;
+        return false;
+    }
+
+    std::string values = spec.substr(equals + 1);
+    if (values.find(':') != std::string::npos) {
+        // start:stop:step
+        size_t first = values.find(':');
+        size_t second = values.find(':', first + 1);
+        if (second == std::string::npos) {
+            std::cout << "Expected start:stop:step in " << spec << std::endl;
+            return false;
+        }
+
+        double start, stop, step;
+        if (!readValue(values.substr(0, first), spec, start) ||
+            !readValue(values.substr(first + 1, second - first - 1), spec, stop) ||
+            !readValue(values.substr(second + 1), spec, step))
+            return false;
+        if (step <= 0 || stop < start) {
+            std::cout << "Range " << spec << " is empty" << std::endl;
+            return false;
+        }
+
+        // Counted in double, which can't overflow, and checked before anything is allocated.
+        double count = std::floor((stop - start) / step + 1e-9) + 1;
+        if (!(count <= MAX_AXIS_VALUES)) {
+            std::cout << "Range " << spec << " has more than " << (long long)MAX_AXIS_VALUES << " values" << std::endl;
+            return false;
+        }
+
+        // computed from the index so rounding doesn't accumulate or drop the last value
+        for (long long i = 0; i < (long long)count; i++)
+            axis.values.push_back(start + i * step);
+    }
+    else {
+        size_t begin = 0;
+        while (begin <= values.size()) {
+            size_t comma = values.find(',', begin);
+            if (comma == std::string::npos)
+                comma = values.size();
+            double value;
+            if (!readValue(values.substr(begin, comma - begin), spec, value))
+                return false;
+            axis.values.push_back(value);
+            begin = comma + 1;
+        }
+    }
+    return true;
+}
+
+size_t sweepPoints(const std::vector<sweepAxis>& axes)
+{
+    size_t points = 1;
+    for (const sweepAxis& axis : axes)
+        points *= axis.values.size();
+    return points;
+}
+
+simulationParams sweepPoint(const simulationParams& base, const std::vector<sweepAxis>& axes, size_t n,
+                            std::vector<double>& point)
+{
+    // decode n as a mixed radix number, last axis fastest
+    simulationParams params = base;
+    point.resize(axes.size());
+    size_t rest = n;
+    for (size_t a = axes.size(); a-- > 0;) {
+        size_t count = axes[a].values.size();
+        point[a] = axes[a].values[rest % count];
+        setParam(params, axes[a].field, point[a]);
+        rest /= count;
+    }
+    return params;
+}
+
+std::vector<sweepResult> runSweep(const simulationParams& base, const std::vector<sweepAxis>& axes,
+                                  const batchOptions& options)
+{
+    size_t points = sweepPoints(axes);
+
+    std::vector<simulationParams> scenarios;
+    std::vector<sweepResult> results(points);
+    for (size_t n = 0; n < points; n++)
+        scenarios.push_back(sweepPoint(base, axes, n, results[n].point));
+
+    // The table only reports final outcomes, so skip the per-year summaries.
+    batchOptions sweepOptions = options;
+    sweepOptions.yearly = false;
+
+    std::vector<batchResults> batches = runBatches(scenarios, sweepOptions);
+    for (size_t n = 0; n < points; n++)
+        results[n].results = batches[n];
+    return results;
+}
+
+void writeSweepCSV(std::ostream& out, const std::vector<sweepAxis>& axes, const std::vector<sweepResult>& results)
+{
+    out << std::fixed << std::setprecision(2);
+    for (const sweepAxis& axis : axes)
+        out << axis.field << ",";
+    out << "trials,meanNetWorth,p5NetWorth,p50NetWorth,p95NetWorth,bankruptcyRate,homeSaleRate" << std::endl;
+
+    for (const sweepResult& r : results) {
+        for (double value : r.point)
+            out << value << ",";
+        const batchResults& b = r.results;
+        out << b.trials << "," << b.meanNetWorth << "," << b.p5NetWorth << "," << b.p50NetWorth << ","
+            << b.p95NetWorth << "," << std::setprecision(4) << b.bankruptcyRate << "," << b.homeSaleRate
+            << std::setprecision(2) << std::endl;
+    }
+}
@@ -0,0 +1,58 @@
+/*
+    * sweep.h
+    * This header file defines the parameter sweep mode. A sweep varies any simulationParams fields
+    * over lists or ranges of values and runs the Monte Carlo batch at every point of the
+    * Cartesian grid, e.g. buying across home prices and mortgage rates.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "batch.h"
+
+struct sweepAxis
+{
+    std::string field; // simulationParams member name, e.g. "homePrice"
+    std::vector<double> values;
+};
+
+struct sweepResult
+{
+    std::vector<double> point; // value of each axis, in axis order
+    batchResults results;
+};
+
+// Sets / reads the simulationParams field with the given member name. homeOwner is 0 or 1.
+// Both return false for an unknown name.
+bool setParam(simulationParams& params, std::string_view name, double value);
+bool getParam(const simulationParams& params, std::string_view name, double& value);
+
+// Every name setParam accepts, in declaration order with homeOwner last.
+std::vector<std::string> paramNames();
+
+// Most values a start:stop:step range can expand to.
+const double MAX_AXIS_VALUES = 1e7;
+
+// Parses "field=start:stop:step" (stop included) or "field=v1,v2,...".
+// Prints the problem and returns false if the spec is invalid or the range too long.
+bool parseSweepAxis(const std::string& spec, sweepAxis& axis);
+
+// Number of points of the grid, and point n of it on top of base (the first axis varies
+// slowest); point receives the value of each axis.
+size_t sweepPoints(const std::vector<sweepAxis>& axes);
+simulationParams sweepPoint(const simulationParams& base, const std::vector<sweepAxis>& axes, size_t n,
+                            std::vector<double>& point);
+
+// Evaluates every combination of axis values on top of base. All points run in one parallel
+// pass with the same random streams, so differences between points aren't sampling noise.
+// The first axis varies slowest.
+std::vector<sweepResult> runSweep(const simulationParams& base, const std::vector<sweepAxis>& axes,
+                                  const batchOptions& options);
+
+// One CSV row per grid point: the axis values followed by the batch outcomes.
+void writeSweepCSV(std::ostream& out, const std::vector<sweepAxis>& axes, const std::vector<sweepResult>& results);
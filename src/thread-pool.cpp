@@ -0,0 +1,95 @@
+/*
+    * thread-pool.cpp
+    * This source file implements the persistent thread pool.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "thread-pool.h"
+
+ThreadPool::ThreadPool(int threadCount)
+{
+    if (threadCount <= 0)
+        threadCount = (int)std::thread::hardware_concurrency();
+    if (threadCount <= 0)
+        threadCount = 1;
+
+    workerCount = threadCount;
+    // worker 0 is whoever calls parallelFor
+    for (int i = 1; i < workerCount; i++)
+        threads.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& t : threads)
+        t.join();
+}
+
+void ThreadPool::runChunks(int worker)
+{
+    while (true) {
+        size_t begin = nextIndex.fetch_add(jobChunk, std::memory_order_relaxed);
+        if (begin >= jobCount)
+            break;
+        size_t end = begin + jobChunk < jobCount ? begin + jobChunk : jobCount;
+        (*job)(begin, end, worker);
+    }
+}
+
+void ThreadPool::workerLoop(int worker)
+{
+    unsigned long long seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+
+        runChunks(worker);
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (--busyWorkers == 0)
+            done.notify_one();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t chunkSize,
+                             const std::function<void(size_t, size_t, int)>& fn)
+{
+    if (count == 0)
+        return;
+    if (chunkSize == 0)
+        chunkSize = 1;
+
+    if (workerCount == 1 || count <= chunkSize) {
+        for (size_t begin = 0; begin < count; begin += chunkSize)
+            fn(begin, begin + chunkSize < count ? begin + chunkSize : count, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        job = &fn;
+        jobCount = count;
+        jobChunk = chunkSize;
+        nextIndex.store(0, std::memory_order_relaxed);
+        busyWorkers = workerCount - 1;
+        generation++;
+    }
+    wake.notify_all();
+
+    runChunks(0);
+
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [&] { return busyWorkers == 0; });
+    job = nullptr;
+}
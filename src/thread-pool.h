@@ -0,0 +1,55 @@
+/*
+    * thread-pool.h
+    * This header file defines a small persistent thread pool used to spread independent
+    * simulation trials across all cores.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    // threads <= 0 uses every hardware thread. The calling thread counts as one worker.
+    explicit ThreadPool(int threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return workerCount; }
+
+    // Calls fn(begin, end, worker) over [0, count) in chunks of at most chunkSize.
+    // Chunks are handed out from a shared counter, so fast workers take more of them.
+    // worker is in [0, size()) and is stable for the duration of one call.
+    void parallelFor(size_t count, size_t chunkSize,
+                     const std::function<void(size_t, size_t, int)>& fn);
+
+private:
+    void workerLoop(int worker);
+    void runChunks(int worker);
+
+    int workerCount;
+    std::vector<std::thread> threads;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    bool stopping = false;
+    unsigned long long generation = 0;
+    int busyWorkers = 0;
+
+    const std::function<void(size_t, size_t, int)>* job = nullptr;
+    size_t jobCount = 0;
+    size_t jobChunk = 1;
+    std::atomic<size_t> nextIndex{0};
+};
@@ -0,0 +1,318 @@
+/*
+    * trajectory.cpp
+    * This source file implements the binary trajectory writer, reader and CSV export.
+    *
+    * Contributors: Kade Miller
+*/
+
+#include "trajectory.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char MAGIC[8] = "FPTRAJ1";
+const uint32_t VERSION = 1;
+
+// Block 0 starts on a page boundary so mapped columns are aligned for any value type.
+const uint64_t DATA_ALIGNMENT = 4096;
+
+const char* FIELD_NAMES[TRAJECTORY_FIELDS] = {
+    "netWorth", "bankBalance", "etfBalance", "homeValue", "mortgageBalance", "equity"
+};
+
+uint64_t blockBytesFor(const trajectoryHeader& header, uint64_t count)
+{
+    return (uint64_t)header.fields * header.steps * count * encodingBytes((trajectoryEncoding)header.encoding);
+}
+
+}
+
+const char* trajectoryFieldName(int field)
+{
+    return field >= 0 && field < TRAJECTORY_FIELDS ? FIELD_NAMES[field] : "";
+}
+
+bool parseTrajectoryEncoding(const std::string& name, trajectoryEncoding& encoding)
+{
+    if (name == "float64")
+        encoding = ENCODING_FLOAT64;
+    else if (name == "float32")
+        encoding = ENCODING_FLOAT32;
+    else if (name == "delta")
+        encoding = ENCODING_DELTA;
+    else {
+        std::cout << "Expected encoding float64, float32 or delta, got " << name << std::endl;
+        return false;
+    }
+    return true;
+}
+
+size_t encodingBytes(trajectoryEncoding encoding)
+{
+    return encoding == ENCODING_FLOAT64 ? 8 : 4;
+}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+#ifdef _WIN32
+    if (file != nullptr)
+        std::fclose(file);
+#else
+    if (fd >= 0)
+        ::close(fd);
+#endif
+}
+
+bool TrajectoryWriter::open(const std::string& path, const simulationParams& params, uint64_t seed,
+                            uint64_t paths, int blockPaths, int interval, trajectoryEncoding encoding)
+{
+    if (interval <= 0 || 12 % interval != 0) {
+        std::cout << "The trajectory interval must divide 12 months, got " << interval << std::endl;
+        return false;
+    }
+
+    this->path = path;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.encoding = encoding;
+    header.fields = TRAJECTORY_FIELDS;
+    header.interval = interval;
+    header.steps = simulatedMonths(params) / interval + 1;
+    header.blockPaths = blockPaths;
+    header.paths = paths;
+    header.seed = seed;
+    header.blockBytes = blockBytesFor(header, blockPaths);
+    header.dataOffset = (sizeof(trajectoryHeader) + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+    header.params = params;
+
+#ifdef _WIN32
+    file = std::fopen(path.c_str(), "wb");
+    bool opened = file != nullptr && std::fwrite(&header, sizeof(header), 1, file) == 1;
+#else
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool opened = fd >= 0 && pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header);
+#endif
+    if (!opened) {
+        std::cout << "Could not write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool TrajectoryWriter::writeBlock(uint64_t block, size_t count, const double* values)
+{
+    const trajectoryEncoding encoding = (trajectoryEncoding)header.encoding;
+    const size_t steps = header.steps;
+    const size_t n = (size_t)TRAJECTORY_FIELDS * steps * count;
+
+    std::vector<unsigned char> buffer(n * encodingBytes(encoding));
+    bool ok = true;
+    if (encoding == ENCODING_FLOAT64) {
+        std::memcpy(buffer.data(), values, n * sizeof(double));
+    }
+    else if (encoding == ENCODING_FLOAT32) {
+        float* out = reinterpret_cast<float*>(buffer.data());
+        for (size_t i = 0; i < n; i++)
+            out[i] = (float)values[i];
+    }
+    else {
+        int32_t* out = reinterpret_cast<int32_t*>(buffer.data());
+        for (size_t field = 0; field < TRAJECTORY_FIELDS; field++) {
+            const double* in = values + field * steps * count;
+            int32_t* column = out + field * steps * count;
+            for (size_t i = 0; i < count; i++) {
+                // Deltas of the rounded cents, so summing them gives back each rounded value exactly.
+                long long previous = 0;
+                for (size_t step = 0; step < steps; step++) {
+                    double value = in[step * count + i];
+                    long long cents = std::isfinite(value) ? std::llround(value * 100.0) : 0;
+                    long long delta = cents - previous;
+                    if (!std::isfinite(value) || delta < INT32_MIN || delta > INT32_MAX)
+                        ok = false;
+                    column[step * count + i] = (int32_t)delta;
+                    previous = cents;
+                }
+            }
+        }
+    }
+
+    uint64_t offset = header.dataOffset + block * header.blockBytes;
+#ifdef _WIN32
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ok = ok && _fseeki64(file, offset, SEEK_SET) == 0 &&
+             std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+        blocksWritten++;
+    }
+#else
+    size_t written = 0;
+    while (ok && written < buffer.size()) {
+        ssize_t result = pwrite(fd, buffer.data() + written, buffer.size() - written, offset + written);
+        if (result <= 0)
+            ok = false;
+        else
+            written += result;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        blocksWritten++;
+    }
+#endif
+
+    if (!ok)
+        failed = true;
+    return ok;
+}
+
+bool TrajectoryWriter::close()
+{
+    uint64_t blocks = (header.paths + header.blockPaths - 1) / header.blockPaths;
+#ifdef _WIN32
+    bool closed = file != nullptr && std::fclose(file) == 0;
+    file = nullptr;
+#else
+    bool closed = fd >= 0 && ::close(fd) == 0;
+    fd = -1;
+#endif
+
+    if (failed && header.encoding == ENCODING_DELTA) {
+        std::cout << "A value changed by more than $21M in one step and doesn't fit the delta encoding;"
+                  << " use float32 or float64 for " << path << std::endl;
+        return false;
+    }
+    if (failed || !closed || blocksWritten != blocks) {
+        std::cout << "Could not write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool TrajectoryReader::open(const std::string& path)
+{
+    if (!file.open(path) || file.size() < sizeof(trajectoryHeader)) {
+        std::cout << "Could not read " << path << std::endl;
+        return false;
+    }
+
+    std::memcpy(&header, file.data(), sizeof(header));
+    bool valid = std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == VERSION &&
+                 header.encoding <= ENCODING_DELTA && header.fields == TRAJECTORY_FIELDS &&
+                 header.interval > 0 && 12 % header.interval == 0 && header.blockPaths > 0 &&
+                 header.blockBytes == blockBytesFor(header, header.blockPaths);
+    // The steps must be the ones the writer derived from params and the interval.
+    std::string problem;
+    valid = valid && checkParams(header.params, problem) &&
+            header.steps == (uint32_t)(simulatedMonths(header.params) / header.interval + 1);
+    if (valid) {
+        uint64_t count = blocks();
+        uint64_t expected = header.dataOffset;
+        if (count > 0)
+            expected += (count - 1) * header.blockBytes + blockBytesFor(header, blockSize(count - 1));
+        valid = file.size() >= expected;
+    }
+    if (!valid) {
+        std::cout << path << " is not a complete trajectory file" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+uint64_t TrajectoryReader::blocks() const
+{
+    return (header.paths + header.blockPaths - 1) / header.blockPaths;
+}
+
+size_t TrajectoryReader::blockSize(uint64_t block) const
+{
+    uint64_t first = block * header.blockPaths;
+    return (size_t)std::min<uint64_t>(header.blockPaths, header.paths - first);
+}
+
+trajectoryColumn TrajectoryReader::column(uint64_t block, int field, int step) const
+{
+    trajectoryColumn c;
+    c.count = blockSize(block);
+    c.encoding = (trajectoryEncoding)header.encoding;
+    uint64_t offset = header.dataOffset + block * header.blockBytes +
+                      ((uint64_t)field * header.steps + step) * c.count * encodingBytes(c.encoding);
+    c.data = file.data() + offset;
+    return c;
+}
+
+void TrajectoryReader::stepValues(int field, int step, std::vector<double>& out) const
+{
+    out.resize(header.paths);
+    size_t path = 0;
+    for (uint64_t b = 0; b < blocks(); b++) {
+        if (header.encoding != ENCODING_DELTA) {
+            trajectoryColumn c = column(b, field, step);
+            for (size_t i = 0; i < c.count; i++)
+                out[path + i] = c[i];
+            path += c.count;
+            continue;
+        }
+
+        // Sum the cent deltas of every step up to this one.
+        size_t count = blockSize(b);
+        std::vector<long long> cents(count, 0);
+        for (int s = 0; s <= step; s++) {
+            const int32_t* delta = static_cast<const int32_t*>(column(b, field, s).data);
+            for (size_t i = 0; i < count; i++)
+                cents[i] += delta[i];
+        }
+        for (size_t i = 0; i < count; i++)
+            out[path + i] = cents[i] / 100.0;
+        path += count;
+    }
+}
+
+void TrajectoryReader::pathValues(uint64_t path, int field, std::vector<double>& out) const
+{
+    out.resize(header.steps);
+    uint64_t block = path / header.blockPaths;
+    size_t lane = path % header.blockPaths;
+
+    long long cents = 0;
+    for (int step = 0; step < (int)header.steps; step++) {
+        trajectoryColumn c = column(block, field, step);
+        if (header.encoding == ENCODING_DELTA) {
+            cents += static_cast<const int32_t*>(c.data)[lane];
+            out[step] = cents / 100.0;
+        }
+        else {
+            out[step] = c[lane];
+        }
+    }
+}
+
+bool writeTrajectoryCSV(const TrajectoryReader& reader, std::ostream& out, uint64_t maxPaths)
+{
+    const trajectoryHeader& header = reader.info();
+    uint64_t paths = maxPaths > 0 ? std::min(maxPaths, reader.paths()) : reader.paths();
+
+    out << "path,month";
+    for (int field = 0; field < TRAJECTORY_FIELDS; field++)
+        out << "," << trajectoryFieldName(field);
+    out << "\n";
+
+    out << std::fixed << std::setprecision(2);
+    std::vector<std::vector<double>> values(TRAJECTORY_FIELDS);
+    for (uint64_t path = 0; path < paths && out; path++) {
+        for (int field = 0; field < TRAJECTORY_FIELDS; field++)
+            reader.pathValues(path, field, values[field]);
+        for (int step = 0; step < reader.steps(); step++) {
+            out << path << "," << step * header.interval;
+            for (int field = 0; field < TRAJECTORY_FIELDS; field++)
+                out << "," << values[field][step];
+            out << "\n";
+        }
+    }
+    return (bool)out;
+}
@@ -0,0 +1,160 @@
+/*
+    * trajectory.h
+    * This header file defines the binary trajectory format: every path of a batch, sampled every
+    * `interval` months, stored column by column so one field at one step across all paths can be
+    * read straight out of a memory-mapped file.
+    *
+    * Layout: a trajectoryHeader, then the paths in blocks of header.blockPaths (the batch chunk
+    * size; the last block may be shorter). Inside a block each field is stored step by step, and
+    * each step holds one value per path of the block:
+    *
+    *   block b at dataOffset + b * blockBytes: [field][step][path in block]
+    *
+    * Values are float64, float32, or int32 cent deltas from the same path's previous step
+    * (step 0 is the delta from zero), which keeps the file small and exact to the cent but has to
+    * be summed up to be read. All numbers are in the writing machine's byte order.
+    *
+    * Contributors: Kade Miller
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "mapped-file.h"
+#include "simulation.h"
+
+enum trajectoryField
+{
+    COLUMN_NET_WORTH,
+    COLUMN_BANK_BALANCE,
+    COLUMN_ETF_BALANCE,
+    COLUMN_HOME_VALUE,
+    COLUMN_MORTGAGE_BALANCE,
+    COLUMN_EQUITY,
+    TRAJECTORY_FIELDS
+};
+
+const char* trajectoryFieldName(int field);
+
+enum trajectoryEncoding
+{
+    ENCODING_FLOAT64,
+    ENCODING_FLOAT32,
+    ENCODING_DELTA // int32 cents, difference from the previous step
+};
+
+bool parseTrajectoryEncoding(const std::string& name, trajectoryEncoding& encoding);
+size_t encodingBytes(trajectoryEncoding encoding);
+
+struct trajectoryHeader
+{
+    char magic[8];       // "FPTRAJ1"
+    uint32_t version;
+    uint32_t encoding;   // trajectoryEncoding
+    uint32_t fields;     // TRAJECTORY_FIELDS
+    uint32_t interval;   // months between steps
+    uint32_t steps;      // steps per path, months / interval + 1 including the starting state
+    uint32_t blockPaths; // paths per block
+    uint64_t paths;
+    uint64_t seed;
+    uint64_t blockBytes; // size of a full block
+    uint64_t dataOffset; // where block 0 starts
+    simulationParams params;
+};
+
+// Streams blocks of paths into a trajectory file. Blocks can be written in any order and from
+// any thread; each one goes out as a single write at its own offset.
+class TrajectoryWriter
+{
+public:
+    TrajectoryWriter() = default;
+    ~TrajectoryWriter();
+    TrajectoryWriter(const TrajectoryWriter&) = delete;
+    TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+    // Creates path for `paths` paths of params sampled every interval months, which must
+    // divide 12. Prints why and returns false if that isn't possible.
+    bool open(const std::string& path, const simulationParams& params, uint64_t seed, uint64_t paths,
+              int blockPaths, int interval, trajectoryEncoding encoding);
+
+    // Writes block `block`. values holds TRAJECTORY_FIELDS * steps() * count doubles laid out
+    // [field][step][path], count being the number of paths in the block.
+    bool writeBlock(uint64_t block, size_t count, const double* values);
+
+    // Checks every block went out and closes the file. Returns false after any failed write or
+    // a delta that didn't fit in 32 bits.
+    bool close();
+
+    int interval() const { return header.interval; }
+    int steps() const { return header.steps; }
+
+private:
+    trajectoryHeader header = {};
+    std::string path;
+    int fd = -1;
+    std::mutex mutex; // guards blocksWritten, and the file where there is no positional write
+    std::FILE* file = nullptr;
+    bool failed = false;
+    uint64_t blocksWritten = 0;
+};
+
+// One field at one step for the paths of one block, pointing into the mapped file.
+struct trajectoryColumn
+{
+    const void* data;
+    size_t count;
+    trajectoryEncoding encoding;
+
+    // The stored value of path i; for ENCODING_DELTA that is the change since the previous step.
+    double operator[](size_t i) const
+    {
+        switch (encoding) {
+        case ENCODING_FLOAT32:
+            return static_cast<const float*>(data)[i];
+        case ENCODING_DELTA:
+            return static_cast<const int32_t*>(data)[i] * 0.01;
+        default:
+            return static_cast<const double*>(data)[i];
+        }
+    }
+};
+
+// Read-only view of a trajectory file. The file is memory-mapped, so opening it costs nothing
+// however large it is and only the columns actually read are paged in.
+class TrajectoryReader
+{
+public:
+    TrajectoryReader() = default;
+    TrajectoryReader(const TrajectoryReader&) = delete;
+    TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+
+    // Prints why and returns false if path isn't a complete trajectory file.
+    bool open(const std::string& path);
+
+    const trajectoryHeader& info() const { return header; }
+    uint64_t paths() const { return header.paths; }
+    int steps() const { return header.steps; }
+    uint64_t blocks() const;
+    size_t blockSize(uint64_t block) const;
+
+    // Zero-copy view of field at step for the paths of block.
+    trajectoryColumn column(uint64_t block, int field, int step) const;
+
+    // Value of field at step for every path, decoded into out (paths() values).
+    void stepValues(int field, int step, std::vector<double>& out) const;
+    // Value of field at every step of one path, decoded into out (steps() values).
+    void pathValues(uint64_t path, int field, std::vector<double>& out) const;
+
+private:
+    trajectoryHeader header = {};
+    MappedFile file;
+};
+
+// Writes one row per path and step: path, month, then every field. maxPaths limits the rows to
+// the first maxPaths paths (0 for all of them).
+bool writeTrajectoryCSV(const TrajectoryReader& reader, std::ostream& out, uint64_t maxPaths = 0);